@@ -0,0 +1,144 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+
+#include "allocationcounter.h"
+
+static std::atomic<qint64> totalAllocations(0);
+static std::atomic<qint64> totalBytes(0);
+
+#ifdef __GLIBC__
+#define ALLOCATION_COUNTER
+
+// The original functions of glibc.
+extern "C" {
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *memory, size_t size);
+    void *__libc_memalign(size_t alignment, size_t size);
+}
+
+inline void countAllocation(size_t size)
+{
+    totalAllocations.fetch_add(1, std::memory_order_relaxed);
+    totalBytes.fetch_add(qint64(size), std::memory_order_relaxed);
+}
+
+// The process uses these functions instead of the ones of glibc, operator
+// new and the Qt containers end up calling them too.
+extern "C" {
+    void *malloc(size_t size)
+    {
+        countAllocation(size);
+
+        return __libc_malloc(size);
+    }
+
+    void *calloc(size_t count, size_t size)
+    {
+        if (size > 0 && count > SIZE_MAX / size) {
+            errno = ENOMEM;
+
+            return nullptr;
+        }
+
+        countAllocation(count * size);
+
+        return __libc_calloc(count, size);
+    }
+
+    void *realloc(void *memory, size_t size)
+    {
+        // realloc(memory, 0) frees the memory.
+        if (size > 0 || !memory)
+            countAllocation(size);
+
+        return __libc_realloc(memory, size);
+    }
+
+    void *memalign(size_t alignment, size_t size)
+    {
+        countAllocation(size);
+
+        return __libc_memalign(alignment, size);
+    }
+
+    void *aligned_alloc(size_t alignment, size_t size)
+    {
+        countAllocation(size);
+
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void **memory, size_t alignment, size_t size)
+    {
+        // The alignment must be a power of two multiple of sizeof(void *).
+        if (alignment < sizeof(void *)
+            || alignment % sizeof(void *) != 0
+            || (alignment & (alignment - 1)) != 0)
+            return EINVAL;
+
+        countAllocation(size);
+        void *allocated = __libc_memalign(alignment, size);
+
+        if (!allocated)
+            return ENOMEM;
+
+        *memory = allocated;
+
+        return 0;
+    }
+}
+#endif
+
+AllocationCounter::AllocationCounter()
+{
+    this->restart();
+}
+
+bool AllocationCounter::isSupported()
+{
+#ifdef ALLOCATION_COUNTER
+    return true;
+#else
+    return false;
+#endif
+}
+
+qint64 AllocationCounter::allocations() const
+{
+    return totalAllocations.load(std::memory_order_relaxed)
+           - this->startAllocations;
+}
+
+qint64 AllocationCounter::allocatedBytes() const
+{
+    return totalBytes.load(std::memory_order_relaxed) - this->startBytes;
+}
+
+void AllocationCounter::restart()
+{
+    this->startAllocations = totalAllocations.load(std::memory_order_relaxed);
+    this->startBytes = totalBytes.load(std::memory_order_relaxed);
+}
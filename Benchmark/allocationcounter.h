@@ -0,0 +1,61 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <QtGlobal>
+
+// Counts the heap allocations of the whole process since it was created.
+//
+// It's meant for checking that the filters don't allocate memory while
+// filtering:
+//
+//     AllocationCounter counter;
+//     filter.process(in, out);
+//     Q_ASSERT(counter.allocations() == 0);
+//
+// All the threads are counted, including the threads of Qt. The counting
+// replaces malloc() and friends of the whole process, so it's only available
+// with glibc, and it's not part of the denoise library: only the programs
+// that build allocationcounter.cpp, the benchmark and the tests, count their
+// allocations.
+class AllocationCounter
+{
+    public:
+        AllocationCounter();
+
+        // Returns false if the allocations can't be counted, in that case
+        // the counters are always 0.
+        static bool isSupported();
+
+        // Number of allocations and bytes requested since the counter was
+        // created or restarted.
+        qint64 allocations() const;
+        qint64 allocatedBytes() const;
+
+        void restart();
+
+    private:
+        qint64 startAllocations;
+        qint64 startBytes;
+};
+
+#endif // ALLOCATIONCOUNTER_H
@@ -0,0 +1,628 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+#include <QThread>
+#include <QtAlgorithms>
+
+#include "allocationcounter.h"
+#include "gaussfilter.h"
+#include "meanfilter.h"
+#include "medianfilter.h"
+#include "pseudomedianfilter.h"
+#include "tilescheduler.h"
+
+// Seed of the synthetic images, all the runs use the same images.
+static const quint32 benchmarkSeed = 0x5eed;
+
+// Version of the JSON output, increase it when the fields change.
+static const int benchmarkFormatVersion = 4;
+
+// Linear congruential generator, the sequence of qrand() depends on the
+// platform.
+class Random
+{
+    public:
+        explicit Random(quint32 seed):
+            state(seed)
+        {
+        }
+
+        inline quint32 next()
+        {
+            this->state = 1664525 * this->state + 1013904223;
+
+            return this->state >> 8;
+        }
+
+    private:
+        quint32 state;
+};
+
+// A method of a filter, and the largest radius and image it's benchmarked
+// with. The slowest methods would take hours in the biggest images. The
+// approximated methods are compared with the exact method of the same
+// filter, reference.
+struct BenchmarkMethod
+{
+    const char *filter;
+    const char *method;
+    int maxRadius;
+    qint64 maxPixels;
+    bool usesSigma;
+    const char *reference;
+    DenoiseFilter *(*create)(TileScheduler *scheduler,
+                             int radius, qreal sigma);
+};
+
+static const BenchmarkMethod benchmarkMethods[] = {
+    {"gauss", "separable", 1024, Q_INT64_C(1) << 40, true, 0,
+     [] (TileScheduler *scheduler, int radius, qreal sigma) -> DenoiseFilter * {
+         GaussFilter *filter = new GaussFilter(scheduler);
+         filter->radius = radius;
+         filter->sigma = sigma;
+         filter->method = GaussMethodSeparable;
+
+         return filter;
+     }},
+    {"gauss", "recursive", 1024, Q_INT64_C(1) << 40, true, "separable",
+     [] (TileScheduler *scheduler, int radius, qreal sigma) -> DenoiseFilter * {
+         GaussFilter *filter = new GaussFilter(scheduler);
+         filter->radius = radius;
+         filter->sigma = sigma;
+         filter->method = GaussMethodRecursive;
+
+         return filter;
+     }},
+    {"gauss", "fixedpoint", 1024, Q_INT64_C(1) << 40, true, "separable",
+     [] (TileScheduler *scheduler, int radius, qreal sigma) -> DenoiseFilter * {
+         GaussFilter *filter = new GaussFilter(scheduler);
+         filter->radius = radius;
+         filter->sigma = sigma;
+         filter->method = GaussMethodFixedPoint;
+
+         return filter;
+     }},
+    {"gauss", "box", 1024, Q_INT64_C(1) << 40, true, "separable",
+     [] (TileScheduler *scheduler, int radius, qreal sigma) -> DenoiseFilter * {
+         GaussFilter *filter = new GaussFilter(scheduler);
+         filter->radius = radius;
+         filter->sigma = sigma;
+         filter->method = GaussMethodBox;
+
+         return filter;
+     }},
+    {"mean", "direct", 3, 3840 * 2160, true, 0,
+     [] (TileScheduler *scheduler, int radius, qreal sigma) -> DenoiseFilter * {
+         MeanFilter *filter = new MeanFilter(scheduler);
+         filter->radius = radius;
+         filter->sigma = sigma;
+         filter->method = MeanMethodDirect;
+
+         return filter;
+     }},
+    {"mean", "histogram", 1024, 4000 * 3000, true, 0,
+     [] (TileScheduler *scheduler, int radius, qreal sigma) -> DenoiseFilter * {
+         MeanFilter *filter = new MeanFilter(scheduler);
+         filter->radius = radius;
+         filter->sigma = sigma;
+         filter->method = MeanMethodHistogram;
+
+         return filter;
+     }},
+    {"mean", "float", 3, 3840 * 2160, true, "direct",
+     [] (TileScheduler *scheduler, int radius, qreal sigma) -> DenoiseFilter * {
+         MeanFilter *filter = new MeanFilter(scheduler);
+         filter->radius = radius;
+         filter->sigma = sigma;
+         filter->method = MeanMethodFloat;
+
+         return filter;
+     }},
+    {"median", "sort", 2, 1920 * 1080, false, 0,
+     [] (TileScheduler *scheduler, int radius, qreal sigma) -> DenoiseFilter * {
+         Q_UNUSED(sigma)
+         MedianFilter *filter = new MedianFilter(scheduler);
+         filter->radius = radius;
+         filter->method = MedianMethodSort;
+
+         return filter;
+     }},
+    {"median", "network", 3, Q_INT64_C(1) << 40, false, 0,
+     [] (TileScheduler *scheduler, int radius, qreal sigma) -> DenoiseFilter * {
+         Q_UNUSED(sigma)
+         MedianFilter *filter = new MedianFilter(scheduler);
+         filter->radius = radius;
+         filter->method = MedianMethodNetwork;
+
+         return filter;
+     }},
+    {"median", "histogram", 1024, Q_INT64_C(1) << 40, false, 0,
+     [] (TileScheduler *scheduler, int radius, qreal sigma) -> DenoiseFilter * {
+         Q_UNUSED(sigma)
+         MedianFilter *filter = new MedianFilter(scheduler);
+         filter->radius = radius;
+         filter->method = MedianMethodHistogram;
+
+         return filter;
+     }},
+    {"pseudomedian", "vanherk", 1024, Q_INT64_C(1) << 40, false, 0,
+     [] (TileScheduler *scheduler, int radius, qreal sigma) -> DenoiseFilter * {
+         Q_UNUSED(sigma)
+         PseudoMedianFilter *filter = new PseudoMedianFilter(scheduler);
+         filter->radius = radius;
+
+         return filter;
+     }}
+};
+
+// Options of the benchmark, the defaults are the full matrix.
+struct BenchmarkOptions
+{
+    QStringList filters;
+    QVector<QSize> sizes;
+    QVector<int> radii;
+    QVector<qreal> sigmas;
+    QVector<qreal> noises;
+    QVector<int> threads;
+    QVector<DenoiseColors> colors;
+    int repeats;
+    QString output;
+};
+
+// Smooth gradients with a checkerboard texture, and a fraction noise of the
+// pixels replaced by random colors, like the tools do with lena.png.
+void syntheticImage(QVector<quint32> &image,
+                    int width, int height, qreal noise)
+{
+    image.resize(width * height);
+    quint32 *pixels = image.data();
+
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++) {
+            quint32 r = quint32(255 * x / qMax(width - 1, 1));
+            quint32 g = quint32(255 * y / qMax(height - 1, 1));
+            quint32 b = ((x / 16 + y / 16) & 1)? 160: 96;
+            pixels[x + y * width] = 0xff000000 | (r << 16) | (g << 8) | b;
+        }
+
+    Random random(benchmarkSeed);
+    qint64 noisePixels = qint64(noise * width * height);
+
+    for (qint64 i = 0; i < noisePixels; i++) {
+        int x = int(random.next() % quint32(width));
+        int y = int(random.next() % quint32(height));
+        pixels[x + y * width] = 0xff000000 | (random.next() & 0xffffff);
+    }
+}
+
+// Peak signal to noise ratio between the color channels of two RGB32
+// images, in dB. Identical images give 100 dB.
+qreal psnr(const QVector<quint32> &a, const QVector<quint32> &b)
+{
+    qreal sum = 0;
+
+    for (int i = 0; i < a.size(); i++)
+        for (int shift = 0; shift < 24; shift += 8) {
+            int d = int((a[i] >> shift) & 0xff) - int((b[i] >> shift) & 0xff);
+            sum += d * d;
+        }
+
+    qreal mse = sum / (3. * qMax(a.size(), 1));
+
+    return mse > 0? qMin(10 * std::log10(255. * 255. / mse), 100.): 100.;
+}
+
+// Largest difference between the color channels of two RGB32 images.
+int maxDeviation(const QVector<quint32> &a, const QVector<quint32> &b)
+{
+    int deviation = 0;
+
+    for (int i = 0; i < a.size(); i++)
+        for (int shift = 0; shift < 24; shift += 8) {
+            int d = int((a[i] >> shift) & 0xff) - int((b[i] >> shift) & 0xff);
+            deviation = qMax(deviation, qAbs(d));
+        }
+
+    return deviation;
+}
+
+// Nearest rank percentile of the sorted samples.
+qreal percentile(const QVector<qreal> &samples, qreal p)
+{
+    int rank = int(std::ceil(p * samples.size()));
+
+    return samples[qBound(0, rank - 1, samples.size() - 1)];
+}
+
+qreal median(const QVector<qreal> &samples)
+{
+    int n = samples.size();
+
+    return n & 1?
+               samples[n / 2]:
+               (samples[n / 2 - 1] + samples[n / 2]) / 2;
+}
+
+template <typename T>
+QVector<T> parseList(const QString &list, T (*parse)(const QString &))
+{
+    QVector<T> values;
+
+    for (const QString &value: list.split(','))
+        values << parse(value);
+
+    return values;
+}
+
+int parseInt(const QString &value)
+{
+    return value.toInt();
+}
+
+qreal parseReal(const QString &value)
+{
+    return value.toDouble();
+}
+
+DenoiseColors parseColors(const QString &value)
+{
+    return value == "luma"? DenoiseColorsLuma: DenoiseColorsRGB;
+}
+
+QSize parseSize(const QString &value)
+{
+    QStringList size = value.split('x');
+
+    return size.size() == 2?
+               QSize(size[0].toInt(), size[1].toInt()): QSize();
+}
+
+bool parseOptions(const QStringList &arguments, BenchmarkOptions *options)
+{
+    int cores = QThread::idealThreadCount();
+
+    options->sizes = {QSize(640, 480),
+                      QSize(1280, 720),
+                      QSize(1920, 1080),
+                      QSize(3840, 2160),
+                      QSize(4000, 3000),
+                      QSize(8192, 6144)};
+    options->radii = {1, 3, 7, 15};
+    options->sigmas = {1, 3};
+    options->noises = {0.01, 0.1};
+    options->threads = {1};
+    options->colors = {DenoiseColorsRGB};
+    options->repeats = 7;
+
+    if (cores > 1)
+        options->threads << cores;
+
+    for (int i = 1; i < arguments.size(); i++) {
+        QString option = arguments[i];
+        QString value = arguments.value(i + 1);
+
+        if (option == "--quick") {
+            options->sizes = {QSize(640, 480), QSize(1920, 1080)};
+            options->radii = {1, 3};
+            options->sigmas = {1};
+            options->noises = {0.1};
+            options->repeats = 3;
+
+            continue;
+        }
+
+        if (value.isEmpty()) {
+            qCritical() << "Missing value for" << qPrintable(option);
+
+            return false;
+        }
+
+        i++;
+
+        if (option == "--filters")
+            options->filters = value.split(',');
+        else if (option == "--sizes")
+            options->sizes = parseList(value, parseSize);
+        else if (option == "--radii")
+            options->radii = parseList(value, parseInt);
+        else if (option == "--sigmas")
+            options->sigmas = parseList(value, parseReal);
+        else if (option == "--noises")
+            options->noises = parseList(value, parseReal);
+        else if (option == "--threads")
+            options->threads = parseList(value, parseInt);
+        else if (option == "--colors")
+            options->colors = parseList(value, parseColors);
+        else if (option == "--repeats")
+            options->repeats = qMax(value.toInt(), 1);
+        else if (option == "--output")
+            options->output = value;
+        else {
+            qCritical() << "Unknown option" << qPrintable(option);
+
+            return false;
+        }
+    }
+
+    for (const QSize &size: options->sizes)
+        if (size.isEmpty()) {
+            qCritical() << "Invalid image size";
+
+            return false;
+        }
+
+    return true;
+}
+
+const BenchmarkMethod *findMethod(const char *filter, const char *method)
+{
+    for (const BenchmarkMethod &benchmarkMethod: benchmarkMethods)
+        if (qstrcmp(benchmarkMethod.filter, filter) == 0
+            && qstrcmp(benchmarkMethod.method, method) == 0)
+            return &benchmarkMethod;
+
+    return 0;
+}
+
+// The filters can be selected by name, "median", or by method,
+// "median/network".
+bool isSelected(const BenchmarkOptions &options,
+                const BenchmarkMethod &method)
+{
+    if (options.filters.isEmpty())
+        return true;
+
+    QString name = QString(method.filter) + "/" + method.method;
+
+    return options.filters.contains(method.filter)
+           || options.filters.contains(name);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    BenchmarkOptions options;
+
+    if (!parseOptions(a.arguments(), &options)) {
+        qCritical() << "Usage: benchmark [--quick] [--filters f[/method],...]"
+                       " [--sizes WxH,...] [--radii r,...] [--sigmas s,...]"
+                       " [--noises n,...] [--threads t,...]"
+                       " [--colors rgb|luma,...] [--repeats n]"
+                       " [--output file.json]";
+
+        return EXIT_FAILURE;
+    }
+
+    QJsonArray results;
+    QVector<quint32> input;
+    QVector<quint32> output;
+    QVector<quint32> reference;
+
+    for (const QSize &size: options.sizes)
+        for (qreal noise: options.noises) {
+            int width = size.width();
+            int height = size.height();
+            qint64 pixels = qint64(width) * height;
+            syntheticImage(input, width, height, noise);
+            output.resize(input.size());
+            reference.resize(input.size());
+            DenoiseImage in(reinterpret_cast<const uchar *>(input.constData()),
+                            width, height, 4 * width,
+                            DenoiseFormatRGB32);
+            DenoiseImage out(reinterpret_cast<uchar *>(output.data()),
+                             width, height, 4 * width,
+                             DenoiseFormatRGB32);
+
+            // The reference outputs are written to their own buffer, the
+            // vectors would share the data if they were copied.
+            DenoiseImage referenceOut(reinterpret_cast<uchar *>(reference.data()),
+                                      width, height, 4 * width,
+                                      DenoiseFormatRGB32);
+
+            for (const BenchmarkMethod &method: benchmarkMethods) {
+                if (!isSelected(options, method) || pixels > method.maxPixels)
+                    continue;
+
+                for (int radius: options.radii) {
+                    if (radius > method.maxRadius)
+                        continue;
+
+                    // The sigma only changes the result of some filters.
+                    QVector<qreal> sigmas = method.usesSigma?
+                                                options.sigmas:
+                                                QVector<qreal> {0};
+
+                    for (qreal sigma: sigmas)
+                        for (int threads: options.threads)
+                            for (DenoiseColors colors: options.colors) {
+                                TileScheduler scheduler(threads);
+                                DenoiseFilter *filter =
+                                        method.create(&scheduler,
+                                                      radius, sigma);
+
+                                // The luma mode is compared with the output of
+                                // the RGB mode.
+                                QJsonValue quality;
+
+                                if (colors == DenoiseColorsLuma) {
+                                    filter->process(in, referenceOut);
+                                    filter->colors = colors;
+                                    filter->process(in, out);
+                                    quality = psnr(reference, output);
+                                }
+
+                                // The approximated methods are timed against
+                                // their reference, with the same options.
+                                const BenchmarkMethod *referenceMethod =
+                                        method.reference?
+                                            findMethod(method.filter,
+                                                       method.reference):
+                                            0;
+                                qreal referenceTime = 0;
+
+                                if (referenceMethod) {
+                                    DenoiseFilter *exact =
+                                            referenceMethod->create(&scheduler,
+                                                                    radius,
+                                                                    sigma);
+                                    exact->colors = colors;
+                                    exact->process(in, referenceOut);
+                                    QVector<qreal> referenceSamples;
+                                    QElapsedTimer timer;
+
+                                    for (int i = 0; i < options.repeats; i++) {
+                                        timer.start();
+                                        exact->process(in, referenceOut);
+                                        qint64 ns = timer.nsecsElapsed();
+                                        referenceSamples << 1e-6 * ns;
+                                    }
+
+                                    qSort(referenceSamples);
+                                    referenceTime = median(referenceSamples);
+                                    delete exact;
+                                }
+
+                                // The first run allocates the buffers, don't
+                                // measure it.
+                                filter->process(in, out);
+                                QVector<qreal> samples;
+                                QElapsedTimer timer;
+                                qint64 allocations = 0;
+                                qint64 allocatedBytes = 0;
+
+                                for (int i = 0; i < options.repeats; i++) {
+                                    AllocationCounter counter;
+                                    timer.start();
+                                    filter->process(in, out);
+                                    qint64 ns = timer.nsecsElapsed();
+                                    allocations += counter.allocations();
+                                    allocatedBytes += counter.allocatedBytes();
+                                    samples << 1e-6 * ns;
+                                }
+
+                                qSort(samples);
+                                qreal medianTime = median(samples);
+
+                                // Image read, image written and working
+                                // buffers.
+                                qint64 bytes = 2 * 4 * pixels
+                                             + filter->bufferSize();
+
+                                QJsonObject result;
+                                result["filter"] = method.filter;
+                                result["method"] = method.method;
+                                result["width"] = width;
+                                result["height"] = height;
+                                result["radius"] = radius;
+                                result["sigma"] = method.usesSigma?
+                                                      QJsonValue(sigma):
+                                                      QJsonValue();
+                                result["noise"] = noise;
+                                result["threads"] = scheduler.threadCount();
+                                result["colors"] = colors == DenoiseColorsLuma?
+                                                       "luma": "rgb";
+                                result["psnrVsRgb"] = quality;
+                                result["repeats"] = options.repeats;
+                                result["minMs"] = samples.first();
+                                result["medianMs"] = medianTime;
+                                result["p95Ms"] = percentile(samples, 0.95);
+                                result["megapixelsPerSecond"] =
+                                        1e-3 * pixels / medianTime;
+                                result["bytesPerPixel"] = qreal(bytes) / pixels;
+
+                                if (referenceMethod) {
+                                    result["reference"] = method.reference;
+                                    result["speedupVsReference"] =
+                                            referenceTime / medianTime;
+                                    result["maxDeviation"] =
+                                            maxDeviation(reference, output);
+                                } else {
+                                    result["reference"] = QJsonValue();
+                                    result["speedupVsReference"] = QJsonValue();
+                                    result["maxDeviation"] = QJsonValue();
+                                }
+
+                                // Heap allocations per call, after the first.
+                                if (AllocationCounter::isSupported()) {
+                                    result["allocations"] =
+                                            qreal(allocations)
+                                            / options.repeats;
+                                    result["allocatedBytes"] =
+                                            qreal(allocatedBytes)
+                                            / options.repeats;
+                                } else {
+                                    result["allocations"] = QJsonValue();
+                                    result["allocatedBytes"] = QJsonValue();
+                                }
+                                results << result;
+
+                                qDebug() << method.filter << method.method
+                                         << width << "x" << height
+                                         << "radius" << radius
+                                         << "threads" << scheduler.threadCount()
+                                         << (colors == DenoiseColorsLuma?
+                                                 "luma": "rgb")
+                                         << medianTime << "ms";
+
+                                delete filter;
+                            }
+                }
+            }
+        }
+
+    QJsonObject report;
+    report["benchmark"] = "denoise";
+    report["formatVersion"] = benchmarkFormatVersion;
+    report["qtVersion"] = qVersion();
+    report["cpuCount"] = QThread::idealThreadCount();
+    report["date"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    report["seed"] = qint64(benchmarkSeed);
+    report["results"] = results;
+    QByteArray json = QJsonDocument(report).toJson();
+
+    if (options.output.isEmpty()) {
+        fwrite(json.constData(), 1, size_t(json.size()), stdout);
+
+        return EXIT_SUCCESS;
+    }
+
+    QFile file(options.output);
+
+    if (!file.open(QIODevice::WriteOnly)
+        || file.write(json) != json.size()) {
+        qCritical() << "Can't write" << qPrintable(options.output);
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
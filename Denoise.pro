@@ -20,7 +20,17 @@
 TEMPLATE = subdirs
 
 SUBDIRS += \
+    DenoiseLib \
+    Benchmark \
     Gauss \
     Mean \
     Median \
-    PseudoMedian
+    PseudoMedian \
+    Tests
+
+Benchmark.depends = DenoiseLib
+Gauss.depends = DenoiseLib
+Mean.depends = DenoiseLib
+Median.depends = DenoiseLib
+PseudoMedian.depends = DenoiseLib
+Tests.depends = DenoiseLib
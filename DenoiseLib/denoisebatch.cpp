@@ -0,0 +1,456 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QSet>
+#include <QThread>
+#include <QThreadPool>
+
+#include "denoisebatch.h"
+#include "denoisefilter.h"
+#include "denoisetrace.h"
+#include "pipeline.h"
+
+class BatchJob
+{
+    public:
+        QString output;
+        QImage image;
+        qint64 bytes;
+};
+
+// Memory used by the images in flight and by the buffers of the filter. An
+// image bigger than the limit is still processed, alone.
+class MemoryBudget
+{
+    public:
+        explicit MemoryBudget(qint64 limit):
+            limit(limit),
+            used(0),
+            fixed(0),
+            peak(0)
+        {
+        }
+
+        void acquire(qint64 bytes)
+        {
+            QMutexLocker locker(&this->mutex);
+
+            while (this->used > 0
+                   && this->fixed + this->used + bytes > this->limit)
+                this->condition.wait(&this->mutex);
+
+            // The peak is updated when the memory is allocated, the images
+            // of unknown size reserve the whole budget.
+            this->used += bytes;
+        }
+
+        // Change a reservation to the memory actually used, without
+        // waiting, the memory is already allocated.
+        void update(qint64 reserved, qint64 bytes)
+        {
+            QMutexLocker locker(&this->mutex);
+            this->used += bytes - reserved;
+            this->peak = qMax(this->peak, this->fixed + this->used);
+            this->condition.wakeAll();
+        }
+
+        // Memory kept between images, the buffers of the filter.
+        void setFixed(qint64 bytes)
+        {
+            QMutexLocker locker(&this->mutex);
+            this->fixed = bytes;
+            this->peak = qMax(this->peak, this->fixed + this->used);
+            this->condition.wakeAll();
+        }
+
+        void release(qint64 bytes)
+        {
+            QMutexLocker locker(&this->mutex);
+            this->used -= bytes;
+            this->condition.wakeAll();
+        }
+
+        qint64 peakUsage()
+        {
+            QMutexLocker locker(&this->mutex);
+
+            return this->peak;
+        }
+
+    private:
+        QMutex mutex;
+        QWaitCondition condition;
+        qint64 limit;
+        qint64 used;
+        qint64 fixed;
+        qint64 peak;
+};
+
+// Memory for decoding an image of the given size and format, converting it
+// to 32 bits, and filtering it if the filter doesn't work in place.
+qint64 batchImageBytes(const QSize &size, QImage::Format format,
+                       bool inPlace)
+{
+    qint64 pixels = qint64(size.width()) * size.height();
+
+    // The formats that the reader doesn't tell are counted as 64 bits.
+    int bitsPerPixel = format == QImage::Format_Invalid?
+                           64: QImage::toPixelFormat(format).bitsPerPixel();
+    qint64 bytes = pixels * bitsPerPixel / 8 + 4 * pixels;
+
+    if (!inPlace)
+        bytes += 4 * pixels;
+
+    return bytes;
+}
+
+DenoiseBatch::DenoiseBatch(DenoiseFilter *filter):
+    decoders(qMax(QThread::idealThreadCount() / 2, 1)),
+    encoders(qMax(QThread::idealThreadCount() / 2, 1)),
+    memoryLimit(Q_INT64_C(1024) << 20),
+    filter(filter),
+    pixels(0),
+    totalTime(0),
+    peak(0),
+    budget(0),
+    decoded(0),
+    filtered(0)
+{
+}
+
+bool DenoiseBatch::parseArguments(const QStringList &arguments)
+{
+    bool batch = false;
+
+    for (int i = 1; i < arguments.size(); i++)
+        if (arguments[i] == "--batch") {
+            batch = true;
+            this->input = arguments.value(i + 1);
+            this->output = arguments.value(i + 2);
+            i += 2;
+        } else if (arguments[i] == "--decoders") {
+            this->decoders = qMax(arguments.value(i + 1).toInt(), 1);
+            i++;
+        } else if (arguments[i] == "--encoders") {
+            this->encoders = qMax(arguments.value(i + 1).toInt(), 1);
+            i++;
+        } else if (arguments[i] == "--memory") {
+            qint64 megabytes = arguments.value(i + 1).toLongLong();
+            this->memoryLimit = qMax(megabytes, Q_INT64_C(1)) << 20;
+            i++;
+        }
+
+    return batch;
+}
+
+bool DenoiseBatch::run()
+{
+    this->errors.clear();
+    this->nextFile.store(0);
+    this->imageCount.store(0);
+    this->failedCount.store(0);
+    this->pixels = 0;
+    this->totalTime = 0;
+    this->peak = 0;
+
+    if (!this->listFiles())
+        return false;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    this->budget = new MemoryBudget(this->memoryLimit);
+    this->decoded = new PipelineQueue<BatchJob>;
+    this->filtered = new PipelineQueue<BatchJob>;
+    this->activeDecoders.store(this->decoders);
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(this->decoders + this->encoders);
+
+    for (int i = 0; i < this->decoders; i++)
+        pool.start(new PipelineStage([this] () {
+            this->decodeLoop();
+        }));
+
+    for (int i = 0; i < this->encoders; i++)
+        pool.start(new PipelineStage([this] () {
+            this->encodeLoop();
+        }));
+
+    // The filter runs in this thread, one image at a time.
+    bool inPlace = this->filter->supportsInPlace();
+
+    forever {
+        BatchJob *job = this->decoded->pop();
+
+        if (!job)
+            break;
+
+        QImage &image = job->image;
+        DenoiseFormat format =
+                image.format() == QImage::Format_Grayscale8?
+                    DenoiseFormatGray8:
+                image.format() == QImage::Format_ARGB32?
+                    DenoiseFormatARGB32:
+                    DenoiseFormatRGB32;
+
+        if (inPlace) {
+            DenoiseImage frame(image.bits(),
+                               image.width(),
+                               image.height(),
+                               image.bytesPerLine(),
+                               format);
+            this->filter->process(frame, frame);
+        } else {
+            QImage outImage(image.size(), image.format());
+            this->filter->process(DenoiseImage(image.constBits(),
+                                               image.width(),
+                                               image.height(),
+                                               image.bytesPerLine(),
+                                               format),
+                                  DenoiseImage(outImage.bits(),
+                                               outImage.width(),
+                                               outImage.height(),
+                                               outImage.bytesPerLine(),
+                                               format));
+            image = outImage;
+        }
+
+        this->pixels += qint64(image.width()) * image.height();
+        this->budget->setFixed(this->filter->bufferSize());
+        this->filtered->push(job);
+    }
+
+    for (int i = 0; i < this->encoders; i++)
+        this->filtered->push(0);
+
+    pool.waitForDone();
+    this->totalTime = timer.nsecsElapsed();
+    this->peak = this->budget->peakUsage();
+
+    delete this->budget;
+    delete this->decoded;
+    delete this->filtered;
+    this->budget = 0;
+    this->decoded = 0;
+    this->filtered = 0;
+
+    return this->failedCount.load() == 0;
+}
+
+QString DenoiseBatch::errorString() const
+{
+    QMutexLocker locker(&this->errorMutex);
+
+    return this->errors.join("\n");
+}
+
+int DenoiseBatch::images() const
+{
+    return this->imageCount.load();
+}
+
+int DenoiseBatch::failedImages() const
+{
+    return this->failedCount.load();
+}
+
+qreal DenoiseBatch::imagesPerSecond() const
+{
+    return this->totalTime > 0?
+               1e9 * this->imageCount.load() / this->totalTime: 0;
+}
+
+qreal DenoiseBatch::megapixelsPerSecond() const
+{
+    return this->totalTime > 0?
+               1e3 * this->pixels / this->totalTime: 0;
+}
+
+qint64 DenoiseBatch::peakMemory() const
+{
+    return this->peak;
+}
+
+bool DenoiseBatch::listFiles()
+{
+    this->files.clear();
+    QFileInfo inputInfo(this->input);
+
+    if (this->input.isEmpty() || this->output.isEmpty()) {
+        this->addError("Missing input or output");
+
+        return false;
+    }
+
+    if (inputInfo.isDir()) {
+        QDir inputDir(this->input);
+        QStringList filters;
+
+        for (const QByteArray &format: QImageReader::supportedImageFormats())
+            filters << "*." + QString::fromLatin1(format);
+
+        QDirIterator it(this->input,
+                        filters,
+                        QDir::Files,
+                        QDirIterator::Subdirectories);
+
+        while (it.hasNext()) {
+            QString file = it.next();
+            this->files << qMakePair(file,
+                                     this->output + "/"
+                                     + inputDir.relativeFilePath(file));
+        }
+    } else {
+        QFile list(this->input);
+
+        if (!list.open(QIODevice::ReadOnly)) {
+            this->addError("Can't open " + this->input);
+
+            return false;
+        }
+
+        while (!list.atEnd()) {
+            QString file = QString::fromLocal8Bit(list.readLine()).trimmed();
+
+            if (!file.isEmpty())
+                this->files << qMakePair(file,
+                                         this->output + "/"
+                                         + QFileInfo(file).fileName());
+        }
+    }
+
+    // Create the output directories before starting, the encoders only
+    // write files.
+    QSet<QString> dirs;
+
+    for (const QPair<QString, QString> &file: this->files)
+        dirs << QFileInfo(file.second).absolutePath();
+
+    for (const QString &dir: dirs)
+        if (!QDir().mkpath(dir)) {
+            this->addError("Can't create " + dir);
+
+            return false;
+        }
+
+    return true;
+}
+
+void DenoiseBatch::decodeLoop()
+{
+    forever {
+        int i = this->nextFile.fetchAndAddOrdered(1);
+
+        if (i >= this->files.size())
+            break;
+
+        const QPair<QString, QString> &file = this->files[i];
+        QImageReader reader(file.first);
+
+        // Reserve the decoded image, its conversion and the filtered one,
+        // before reading. If the reader doesn't know the size, the whole
+        // budget is reserved until the image is decoded.
+        QSize size = reader.size();
+        bool inPlace = this->filter->supportsInPlace();
+        qint64 bytes = size.isValid()?
+                           batchImageBytes(size, reader.imageFormat(),
+                                           inPlace):
+                           this->memoryLimit;
+
+        this->budget->acquire(bytes);
+        DenoiseTraceScope stage("batch/decode");
+        QImage image = reader.read();
+        stage.next(0);
+
+        if (image.isNull()) {
+            this->budget->release(bytes);
+            this->addError(QString("Can't read %1: %2")
+                           .arg(file.first, reader.errorString()));
+
+            continue;
+        }
+
+        qint64 imageBytes = batchImageBytes(image.size(), image.format(),
+                                            inPlace);
+        this->budget->update(bytes, imageBytes);
+        bytes = imageBytes;
+
+        BatchJob *job = new BatchJob;
+        job->output = file.second;
+        stage.next("batch/convert");
+
+        if (image.format() == QImage::Format_Grayscale8)
+            job->image = image;
+        else if (image.hasAlphaChannel())
+            job->image = image.convertToFormat(QImage::Format_ARGB32);
+        else
+            job->image = image.convertToFormat(QImage::Format_RGB32);
+
+        // The decoded image is freed after the conversion.
+        qint64 decodedBytes = qint64(image.bytesPerLine()) * image.height();
+        image = QImage();
+        this->budget->release(decodedBytes);
+        job->bytes = bytes - decodedBytes;
+
+        this->decoded->push(job);
+    }
+
+    // The last decoder ends the stream.
+    if (!this->activeDecoders.deref())
+        this->decoded->push(0);
+}
+
+void DenoiseBatch::encodeLoop()
+{
+    forever {
+        BatchJob *job = this->filtered->pop();
+
+        if (!job)
+            return;
+
+        QImageWriter writer(job->output);
+        DenoiseTraceScope stage("batch/encode");
+
+        if (writer.write(job->image))
+            this->imageCount.ref();
+        else
+            this->addError(QString("Can't write %1: %2")
+                           .arg(job->output, writer.errorString()));
+
+        this->budget->release(job->bytes);
+        delete job;
+    }
+}
+
+void DenoiseBatch::addError(const QString &error)
+{
+    QMutexLocker locker(&this->errorMutex);
+    this->failedCount.ref();
+    this->errors << error;
+}
@@ -0,0 +1,103 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#ifndef DENOISEBATCH_H
+#define DENOISEBATCH_H
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class DenoiseFilter;
+class BatchJob;
+class MemoryBudget;
+template <typename T> class PipelineQueue;
+
+// Filter all the images of a directory, or of a list of files, and save
+// them in another directory.
+//
+// The images are decoded, filtered and encoded in three stages that run at
+// the same time. Several decoder and encoder threads keep the filter busy
+// when the codecs are slower than the filter, and the filter uses all the
+// cores of its scheduler for each image. The decoders wait before reading
+// an image when the images in flight, with their conversion to 32 bits, and
+// the buffers of the filter would use more than memoryLimit bytes. The
+// images that don't tell their size are read alone.
+class DenoiseBatch
+{
+    public:
+        explicit DenoiseBatch(DenoiseFilter *filter);
+
+        // A directory, the images in the subdirectories are also filtered,
+        // or a text file with a path in each line.
+        QString input;
+
+        // The images keep their path relative to the input directory, the
+        // images of a list are saved with their file name only.
+        QString output;
+
+        int decoders;
+        int encoders;
+        qint64 memoryLimit;
+
+        // Read the batch options, "--batch INPUT OUTPUT" enables the batch
+        // mode, "--decoders N" and "--encoders N" set the number of codec
+        // threads, and "--memory MB" the memory limit.
+        // Returns true if the batch mode was requested.
+        bool parseArguments(const QStringList &arguments);
+
+        // Filter all the images. Returns false if any image failed.
+        bool run();
+
+        QString errorString() const;
+
+        // Statistics of the last run.
+        int images() const;
+        int failedImages() const;
+        qreal imagesPerSecond() const;
+        qreal megapixelsPerSecond() const;
+        qint64 peakMemory() const;
+
+    private:
+        DenoiseFilter *filter;
+        QVector<QPair<QString, QString>> files;
+        QAtomicInt nextFile;
+        QAtomicInt activeDecoders;
+        QAtomicInt imageCount;
+        QAtomicInt failedCount;
+        QStringList errors;
+        mutable QMutex errorMutex;
+        qint64 pixels;
+        qint64 totalTime;
+        qint64 peak;
+        MemoryBudget *budget;
+        PipelineQueue<BatchJob> *decoded;
+        PipelineQueue<BatchJob> *filtered;
+
+        bool listFiles();
+        void decodeLoop();
+        void encodeLoop();
+        void addError(const QString &error);
+};
+
+#endif // DENOISEBATCH_H
@@ -0,0 +1,357 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#include <QtAlgorithms>
+
+#include "denoisechain.h"
+#include "denoisetrace.h"
+#include "tilescheduler.h"
+
+// A filter of the chain, as seen by a worker.
+struct ChainStage
+{
+    DenoiseLineFilter *filter;
+
+    // Prepared lines of the window, line y is in the slot y % ringLines.
+    quint8 *ring;
+    int ringLines;
+    int lineSize;
+
+    // Last output line, read by the next stage.
+    quint8 *output;
+
+    // Next line of the previous stage to prepare.
+    int next;
+    bool first;
+    const quint8 **window;
+};
+
+static const int chainLineAlignment = 16;
+
+inline int alignedLineSize(int size)
+{
+    return (size + chainLineAlignment - 1) & ~(chainLineAlignment - 1);
+}
+
+// Calculate the line y of a stage into dst, pulling the lines that it needs
+// from the previous stages. input is a line buffer for the stage 0 if the
+// samples of in are not consecutive.
+void chainLine(ChainStage *stages, int stage, int y,
+               const DenoiseChannel &in, quint8 *input,
+               quint8 *dst)
+{
+    ChainStage &current = stages[stage];
+    DenoiseLineFilter *filter = current.filter;
+    int radius = filter->radius;
+    int last = qMin(y + radius, filter->height - 1);
+
+    for (; current.next <= last; current.next++) {
+        const quint8 *src;
+
+        if (stage > 0) {
+            ChainStage &previous = stages[stage - 1];
+            chainLine(stages, stage - 1, current.next, in, input,
+                      previous.output);
+            src = previous.output;
+        } else if (in.pixelStride == 1) {
+            src = in.line(current.next);
+        } else {
+            const quint8 *line = in.line(current.next);
+
+            for (int x = 0; x < in.width; x++)
+                input[x] = line[x * in.pixelStride];
+
+            src = input;
+        }
+
+        filter->prepareLine(src, current.next,
+                            current.ring
+                            + (current.next % current.ringLines)
+                              * current.lineSize);
+    }
+
+    int yp = qMax(y - radius, 0);
+
+    for (int j = 0; j <= last - yp; j++)
+        current.window[j] = current.ring
+                            + ((yp + j) % current.ringLines)
+                              * current.lineSize;
+
+    filter->filterLine(current.window, y, current.first, dst);
+    current.first = false;
+}
+
+DenoiseChain::DenoiseChain(TileScheduler *scheduler):
+    DenoiseFilter(scheduler),
+    saved(0),
+    fused(true),
+    lineFiltersWorkers(0)
+{
+}
+
+DenoiseChain::~DenoiseChain()
+{
+    this->clearLineFilters();
+}
+
+void DenoiseChain::clearLineFilters()
+{
+    qDeleteAll(this->lineFilters);
+    this->lineFilters.clear();
+    this->lineFiltersOwners.clear();
+    this->lineFiltersKeys.clear();
+    this->lineFiltersSize = QSize();
+    this->lineFiltersWorkers = 0;
+}
+
+qint64 DenoiseChain::bufferSize() const
+{
+    qint64 size = DenoiseFilter::bufferSize() + this->images.size();
+
+    for (const DenoiseLineFilter *filter: this->lineFilters)
+        size += filter->bufferSize();
+
+    return size;
+}
+
+int DenoiseChain::borderSize() const
+{
+    int size = 0;
+
+    for (const DenoiseFilter *filter: this->filters)
+        size += filter->borderSize();
+
+    return size;
+}
+
+qint64 DenoiseChain::savedMemory() const
+{
+    return this->saved;
+}
+
+bool DenoiseChain::isFused() const
+{
+    return this->fused;
+}
+
+void DenoiseChain::filter(const DenoiseChannel &in, const DenoiseChannel &out)
+{
+    this->fused = this->filterLines(in, out);
+
+    if (!this->fused)
+        this->filterImages(in, out);
+}
+
+void DenoiseChain::filter(const DenoiseChannel16 &in,
+                          const DenoiseChannel16 &out)
+{
+    // The line filters only work with 8 bits samples.
+    this->fused = false;
+    this->filterImages(in, out);
+}
+
+void DenoiseChain::filter(const DenoiseChannelFloat &in,
+                          const DenoiseChannelFloat &out)
+{
+    this->fused = false;
+    this->filterImages(in, out);
+}
+
+// Each worker has its own line filters, they are created again only when
+// the size, the workers, the filters or their parameters change.
+bool DenoiseChain::createLineFilters(const QSize &size, int workers)
+{
+    int nStages = this->filters.size();
+    bool changed = size != this->lineFiltersSize
+                   || workers != this->lineFiltersWorkers
+                   || this->filters != this->lineFiltersOwners;
+
+    for (int i = 0; !changed && i < nStages; i++)
+        changed = this->filters[i]->lineFilterKey()
+                  != this->lineFiltersKeys[i];
+
+    if (!changed)
+        return !this->lineFilters.isEmpty();
+
+    this->clearLineFilters();
+    this->lineFiltersOwners = this->filters;
+    this->lineFiltersSize = size;
+    this->lineFiltersWorkers = workers;
+
+    for (const DenoiseFilter *filter: this->filters)
+        this->lineFiltersKeys << filter->lineFilterKey();
+
+    for (int i = 0; i < workers * nStages; i++) {
+        DenoiseLineFilter *filter =
+                this->filters[i % nStages]->createLineFilter(size);
+
+        if (!filter) {
+            qDeleteAll(this->lineFilters);
+            this->lineFilters.clear();
+
+            return false;
+        }
+
+        this->lineFilters << filter;
+    }
+
+    return true;
+}
+
+bool DenoiseChain::filterLines(const DenoiseChannel &in,
+                               const DenoiseChannel &out)
+{
+    int nStages = this->filters.size();
+    int width = in.width;
+    int height = in.height;
+    QSize size(width, height);
+    int workers = this->scheduler->threadCount();
+    ScratchArena &shared = this->sharedScratch();
+    ScratchArena *arenas = this->workerScratch();
+
+    if (nStages < 1)
+        return false;
+
+    DenoiseTraceScope stage("chain/fused");
+
+    if (!this->createLineFilters(size, workers))
+        return false;
+
+    DenoiseLineFilter **lineFilters = this->lineFilters.data();
+
+    // Memory of a worker: the rings and the output line of each stage, and
+    // the input and output lines for interleaved channels.
+    int *offsets = shared.allocate<int>(nStages);
+    int workerSize = 0;
+    int maxRadius = 0;
+    int totalRadius = 0;
+
+    for (int i = 0; i < nStages; i++) {
+        const DenoiseLineFilter *filter = lineFilters[i];
+        offsets[i] = workerSize;
+        workerSize += (2 * filter->radius + 1)
+                      * alignedLineSize(filter->lineSize())
+                    + alignedLineSize(width);
+        maxRadius = qMax(maxRadius, filter->radius);
+        totalRadius += filter->radius;
+    }
+
+    int inputOffset = workerSize;
+    workerSize += 2 * alignedLineSize(width);
+
+    // Intermediate images that would be stored applying the filters one
+    // after the other, minus the rings and the state of the line filters of
+    // each worker.
+    qint64 lineFiltersSize = 0;
+
+    for (int i = 0; i < workers * nStages; i++)
+        lineFiltersSize += lineFilters[i]->bufferSize();
+
+    this->saved = qint64(nStages - 1) * width * height
+                  - qint64(workerSize) * workers
+                  - lineFiltersSize;
+
+    this->scheduler->runLines(size, totalRadius,
+                              [&] (const Tile &tile, int worker) {
+        ScratchArena &arena = arenas[worker];
+        arena.reset();
+        quint8 *memory = arena.allocate<quint8>(workerSize);
+        quint8 *input = memory + inputOffset;
+        quint8 *output = input + alignedLineSize(width);
+        ChainStage *stages = arena.allocate<ChainStage>(nStages);
+        const quint8 **window =
+                arena.allocate<const quint8 *>(2 * maxRadius + 1);
+
+        // First line of each stage needed by the band.
+        int top = tile.rect.top();
+
+        for (int i = nStages - 1; i >= 0; i--) {
+            ChainStage &stage = stages[i];
+            stage.filter = lineFilters[worker * nStages + i];
+            stage.lineSize = alignedLineSize(stage.filter->lineSize());
+            stage.ringLines = 2 * stage.filter->radius + 1;
+            stage.ring = memory + offsets[i];
+            stage.output = stage.ring + stage.ringLines * stage.lineSize;
+            stage.window = window;
+            top = qMax(top - stage.filter->radius, 0);
+            stage.next = top;
+            stage.first = true;
+        }
+
+        for (int y = tile.rect.top(); y <= tile.rect.bottom(); y++) {
+            quint8 *dst = out.pixelStride == 1? out.line(y): output;
+            chainLine(stages, nStages - 1, y, in, input, dst);
+
+            if (out.pixelStride != 1) {
+                quint8 *oLine = out.line(y);
+
+                for (int x = 0; x < width; x++)
+                    oLine[x * out.pixelStride] = output[x];
+            }
+        }
+    });
+
+    return true;
+}
+
+template <typename T>
+void DenoiseChain::filterImages(const DenoiseTypedChannel<T> &in,
+                                const DenoiseTypedChannel<T> &out)
+{
+    int width = in.width;
+    int height = in.height;
+    int imageSize = width * height;
+    int stride = width * int(sizeof(T));
+    DenoiseFormat format = DenoiseSampleTraits<T>::grayFormat;
+    this->images.resize(2 * imageSize * int(sizeof(T)));
+    DenoiseTraceScope stage("chain/images");
+    T *src = reinterpret_cast<T *>(this->images.data());
+    T *dst = src + imageSize;
+
+    for (int y = 0; y < height; y++) {
+        const T *line = in.line(y);
+
+        for (int x = 0; x < width; x++)
+            src[x + y * width] = line[x * in.pixelStride];
+    }
+
+    for (DenoiseFilter *filter: this->filters) {
+        DenoiseImage image(reinterpret_cast<uchar *>(src),
+                           width, height, stride, format);
+
+        if (filter->supportsInPlace()) {
+            filter->process(image, image);
+        } else {
+            filter->process(image,
+                            DenoiseImage(reinterpret_cast<uchar *>(dst),
+                                         width, height, stride, format));
+            qSwap(src, dst);
+        }
+    }
+
+    for (int y = 0; y < height; y++) {
+        T *line = out.line(y);
+
+        for (int x = 0; x < width; x++)
+            line[x * out.pixelStride] = src[x + y * width];
+    }
+
+    this->saved = 0;
+}
@@ -0,0 +1,99 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#ifndef DENOISECHAIN_H
+#define DENOISECHAIN_H
+
+#include <QSize>
+#include <QVector>
+
+#include "denoisefilter.h"
+
+// Several filters applied one after the other in a single pass.
+//
+// The filters work line by line, each one keeps a ring with the window
+// lines of the previous filter, and the intermediate images are never
+// stored. Each worker of the chain scheduler filters a band of lines, the
+// lines around the band that the next filters read are calculated by the
+// workers of both bands.
+//
+// If any of the filters can't work line by line, or the samples are not 8
+// bits, the filters are applied one after the other storing the
+// intermediate images.
+//
+// The border mode of the chain extends its input once, by the border size of
+// all the filters, the border modes of the filters are only used when they
+// are not fused.
+class DenoiseChain: public DenoiseFilter
+{
+    public:
+        explicit DenoiseChain(TileScheduler *scheduler = 0);
+        ~DenoiseChain();
+
+        // The filters in the order they are applied, the chain doesn't take
+        // the ownership of them. The filters use the scheduler of the chain
+        // when working line by line.
+        QVector<DenoiseFilter *> filters;
+
+        // The line filters are kept while the size of the channels, the
+        // number of threads, the filters and their parameters don't change.
+        // They are created again on the next image after any change, this
+        // only releases their memory.
+        void clearLineFilters();
+
+        qint64 bufferSize() const;
+        int borderSize() const;
+
+        // Memory of the intermediate images of the last channel filtered,
+        // minus the memory used by the rings and the line filters, negative if
+        // the chain used more memory than storing the intermediate images.
+        qint64 savedMemory() const;
+
+        // Returns true if all the filters can work line by line.
+        bool isFused() const;
+
+    protected:
+        void filter(const DenoiseChannel &in, const DenoiseChannel &out);
+        void filter(const DenoiseChannel16 &in, const DenoiseChannel16 &out);
+        void filter(const DenoiseChannelFloat &in,
+                    const DenoiseChannelFloat &out);
+
+    private:
+        QVector<quint8> images;
+        qint64 saved;
+        bool fused;
+
+        // Line filters of each worker, workers * filters of them, empty if
+        // some filter can't work line by line.
+        QVector<DenoiseLineFilter *> lineFilters;
+        QVector<DenoiseFilter *> lineFiltersOwners;
+        QVector<quint64> lineFiltersKeys;
+        QSize lineFiltersSize;
+        int lineFiltersWorkers;
+
+        bool createLineFilters(const QSize &size, int workers);
+        bool filterLines(const DenoiseChannel &in, const DenoiseChannel &out);
+
+        template <typename T>
+        void filterImages(const DenoiseTypedChannel<T> &in,
+                          const DenoiseTypedChannel<T> &out);
+};
+
+#endif // DENOISECHAIN_H
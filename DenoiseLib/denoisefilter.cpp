@@ -0,0 +1,467 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#include <cstring>
+#include <QSize>
+
+#include "denoisefilter.h"
+#include "denoisetrace.h"
+#include "tilescheduler.h"
+
+// Position inside of a line of the given length that has the value of the
+// position i, or -1 if it has the constant value.
+inline int borderIndex(int i, int length, DenoiseBorder border)
+{
+    if (i >= 0 && i < length)
+        return i;
+
+    switch (border) {
+    case DenoiseBorderReplicate:
+        return qBound(0, i, length - 1);
+    case DenoiseBorderReflect: {
+        if (length < 2)
+            return 0;
+
+        // The reflected line repeats every 2 * (length - 1) pixels.
+        int period = 2 * (length - 1);
+        i = qAbs(i) % period;
+
+        return i < length? i: period - i;
+    }
+    default:
+        return -1;
+    }
+}
+
+// Copy in to the center of padded, and fill the padding around it.
+template <typename T>
+void padChannel(const DenoiseTypedChannel<T> &in,
+                const DenoiseTypedChannel<T> &padded,
+                int padding, DenoiseBorder border, T value,
+                TileScheduler &scheduler)
+{
+    int width = in.width;
+
+    scheduler.runLines(QSize(padded.width, padded.height), 0,
+                       [&] (const Tile &tile, int) {
+        for (int y = tile.rect.top(); y <= tile.rect.bottom(); y++) {
+            T *dst = padded.line(y);
+            int srcY = borderIndex(y - padding, in.height, border);
+
+            if (srcY < 0) {
+                for (int x = 0; x < padded.width; x++)
+                    dst[x] = value;
+
+                continue;
+            }
+
+            const T *src = in.line(srcY);
+
+            for (int x = 0; x < padding; x++) {
+                int left = borderIndex(x - padding, width, border);
+                int right = borderIndex(width + x, width, border);
+                dst[x] = left < 0? value: src[left * in.pixelStride];
+                dst[padding + width + x] =
+                        right < 0? value: src[right * in.pixelStride];
+            }
+
+            dst += padding;
+
+            if (in.pixelStride == 1)
+                memcpy(dst, src, size_t(width) * sizeof(T));
+            else
+                for (int x = 0; x < width; x++)
+                    dst[x] = src[x * in.pixelStride];
+        }
+    });
+}
+
+// Copy a plane to another of the same size.
+void copyPlane(const DenoiseChannel &src, const DenoiseChannel &dst,
+               TileScheduler &scheduler)
+{
+    scheduler.runLines(QSize(src.width, src.height), 0,
+                       [&] (const Tile &tile, int) {
+        for (int y = tile.rect.top(); y <= tile.rect.bottom(); y++)
+            memcpy(dst.line(y), src.line(y), size_t(src.width));
+    });
+}
+
+inline DenoiseImage planeImage(const DenoiseChannel &plane)
+{
+    return DenoiseImage(plane.data,
+                        plane.width, plane.height, plane.lineStride,
+                        DenoiseFormatGray8);
+}
+
+DenoiseLineFilter::DenoiseLineFilter(int width, int height, int radius):
+    width(width),
+    height(height),
+    radius(radius)
+{
+}
+
+DenoiseLineFilter::~DenoiseLineFilter()
+{
+}
+
+int DenoiseLineFilter::lineSize() const
+{
+    return this->width;
+}
+
+qint64 DenoiseLineFilter::bufferSize() const
+{
+    return 0;
+}
+
+void DenoiseLineFilter::prepareLine(const quint8 *in, int y, quint8 *line)
+{
+    Q_UNUSED(y)
+
+    memcpy(line, in, size_t(this->width));
+}
+
+DenoiseFilter::DenoiseFilter(TileScheduler *scheduler):
+    planar(true),
+    border(DenoiseBorderClipped),
+    borderValue(0),
+    colors(DenoiseColorsRGB),
+    chromaFilter(0),
+    tuner(0),
+    scheduler(scheduler? scheduler: TileScheduler::globalInstance()),
+    workerArenaCount(0),
+    tuningLocked(false)
+{
+}
+
+DenoiseFilter::~DenoiseFilter()
+{
+}
+
+TileScheduler *DenoiseFilter::tileScheduler() const
+{
+    return this->scheduler;
+}
+
+void DenoiseFilter::setTileScheduler(TileScheduler *scheduler)
+{
+    this->scheduler = scheduler? scheduler: TileScheduler::globalInstance();
+}
+
+void DenoiseFilter::lockTuning(const QSize &size, DenoiseFormat format)
+{
+    if (this->tuner && !size.isEmpty()) {
+        DenoiseImage image;
+        image.width = size.width();
+        image.height = size.height();
+        image.format = format;
+        this->tune(*this->tuner, image);
+    }
+
+    this->tuningLocked = true;
+
+    // The chroma planes are filtered as 8 bits gray images.
+    if (this->chromaFilter && this->isLuma(format))
+        this->chromaFilter->lockTuning(size, DenoiseFormatGray8);
+}
+
+void DenoiseFilter::unlockTuning()
+{
+    this->tuningLocked = false;
+
+    if (this->chromaFilter)
+        this->chromaFilter->unlockTuning();
+}
+
+bool DenoiseFilter::process(const DenoiseImage &in, const DenoiseImage &out)
+{
+    if (!in.isValid()
+        || !out.isValid()
+        || in.width != out.width
+        || in.height != out.height
+        || in.format != out.format)
+        return false;
+
+    DenoiseTraceScope stage("process");
+    this->begin(in);
+
+    if (this->tuner && !this->tuningLocked)
+        this->tune(*this->tuner, in);
+
+    if (in.data == out.data) {
+        if (in.stride != out.stride || !this->supportsInPlace())
+            return false;
+    } else {
+        out.copyExtraBytes(in);
+    }
+
+    int workers = this->scheduler->threadCount();
+
+    if (this->workerArenaCount != workers) {
+        this->workerArenas.reset(new ScratchArena[workers]);
+        this->workerArenaCount = workers;
+    }
+
+    switch (in.sample()) {
+    case DenoiseSampleUInt16:
+        this->filterChannels<quint16>(in, out);
+
+        return true;
+    case DenoiseSampleFloat:
+        this->filterChannels<float>(in, out);
+
+        return true;
+    default:
+        break;
+    }
+
+    if (this->isLuma(in.format)) {
+        this->filterLuma(in, out);
+
+        return true;
+    }
+
+    if (!this->planar || in.channels() < 2) {
+        this->filterChannels<quint8>(in, out);
+
+        return true;
+    }
+
+    this->inPlanes.deinterleave(in, *this->scheduler);
+    PlanarImage *outPlanes = &this->inPlanes;
+
+    if (!this->supportsInPlace()) {
+        this->outPlanes.resize(in.width, in.height, in.channels());
+        outPlanes = &this->outPlanes;
+    }
+
+    for (int c = 0; c < in.channels(); c++)
+        this->filterChannel(this->inPlanes.plane(c), outPlanes->plane(c));
+
+    outPlanes->interleave(out, *this->scheduler);
+
+    return true;
+}
+
+bool DenoiseFilter::supportsInPlace() const
+{
+    return false;
+}
+
+qint64 DenoiseFilter::bufferSize() const
+{
+    qint64 size = this->inPlanes.size()
+                + this->outPlanes.size()
+                + this->paddedIn.size()
+                + this->paddedOut.size()
+                + this->sharedArena.size();
+
+    for (int i = 0; i < this->workerArenaCount; i++)
+        size += this->workerArenas[i].size();
+
+    return size;
+}
+
+int DenoiseFilter::borderSize() const
+{
+    return 0;
+}
+
+int DenoiseFilter::haloSize(DenoiseFormat format) const
+{
+    int size = this->borderSize();
+
+    if (this->chromaFilter && this->isLuma(format))
+        size = qMax(size, this->chromaFilter->haloSize(DenoiseFormatGray8));
+
+    return size;
+}
+
+DenoiseLineFilter *DenoiseFilter::createLineFilter(const QSize &size) const
+{
+    Q_UNUSED(size)
+
+    return 0;
+}
+
+quint64 DenoiseFilter::lineFilterKey() const
+{
+    return 0;
+}
+
+void DenoiseFilter::tune(const DenoiseTuner &tuner, const DenoiseImage &image)
+{
+    Q_UNUSED(tuner)
+    Q_UNUSED(image)
+}
+
+void DenoiseFilter::begin(const DenoiseImage &image)
+{
+    Q_UNUSED(image)
+}
+
+ScratchArena *DenoiseFilter::workerScratch() const
+{
+    return this->workerArenas.data();
+}
+
+ScratchArena &DenoiseFilter::sharedScratch()
+{
+    return this->sharedArena;
+}
+
+template <typename T>
+void DenoiseFilter::filterChannels(const DenoiseImage &in,
+                                   const DenoiseImage &out)
+{
+    for (int c = 0; c < in.channels(); c++)
+        this->filterChannel(in.typedChannel<T>(c), out.typedChannel<T>(c));
+}
+
+// The luma mode only applies to the 8 bits color formats.
+bool DenoiseFilter::isLuma(DenoiseFormat format) const
+{
+    DenoiseImage image;
+    image.format = format;
+
+    return this->colors == DenoiseColorsLuma
+           && image.sample() == DenoiseSampleUInt8
+           && image.channels() == 3;
+}
+
+void DenoiseFilter::filterLuma(const DenoiseImage &in,
+                               const DenoiseImage &out)
+{
+    TileScheduler &scheduler = *this->scheduler;
+    this->inPlanes.deinterleave(in, scheduler);
+    this->inPlanes.rgbToYCbCr(scheduler);
+
+    // The planes are filtered in place, if the filter can't do it the
+    // output goes to outPlanes and it's copied back.
+    DenoiseChannel luma = this->inPlanes.plane(0);
+
+    if (this->supportsInPlace()) {
+        this->filterChannel(luma, luma);
+    } else {
+        this->outPlanes.resize(in.width, in.height, 1);
+        this->filterChannel(luma, this->outPlanes.plane(0));
+        copyPlane(this->outPlanes.plane(0), luma, scheduler);
+    }
+
+    if (this->chromaFilter)
+        for (int c = 1; c < 3; c++) {
+            DenoiseChannel chroma = this->inPlanes.plane(c);
+
+            if (this->chromaFilter->supportsInPlace()) {
+                this->chromaFilter->process(planeImage(chroma),
+                                            planeImage(chroma));
+            } else {
+                this->outPlanes.resize(in.width, in.height, 1);
+                DenoiseChannel filtered = this->outPlanes.plane(0);
+                this->chromaFilter->process(planeImage(chroma),
+                                            planeImage(filtered));
+                copyPlane(filtered, chroma, scheduler);
+            }
+        }
+
+    this->inPlanes.yCbCrToRgb(scheduler);
+    this->inPlanes.interleave(out, scheduler);
+}
+
+// The tiles of a worker change from call to call, so all the workers get
+// the memory of the one that used more, a worker that got no tiles now may
+// get them in the next call.
+void DenoiseFilter::reserveWorkerScratch()
+{
+    size_t size = 0;
+
+    for (int i = 0; i < this->workerArenaCount; i++)
+        size = qMax(size, this->workerArenas[i].peakSize());
+
+    for (int i = 0; i < this->workerArenaCount; i++)
+        this->workerArenas[i].reserve(size);
+}
+
+template <typename T>
+void DenoiseFilter::filterChannel(const DenoiseTypedChannel<T> &in,
+                                  const DenoiseTypedChannel<T> &out)
+{
+    this->sharedArena.reset();
+
+    int padding = this->border == DenoiseBorderClipped?
+                      0: this->borderSize();
+
+    if (padding < 1) {
+        this->filter(in, out);
+        this->reserveWorkerScratch();
+
+        // Resize the arena to what the channel used now, the single channel
+        // images would allocate again in the next call otherwise.
+        this->sharedArena.reset();
+
+        return;
+    }
+
+    // The padded channels are single planes with the samples of the right
+    // size.
+    int width = in.width;
+    int height = in.height;
+    int paddedWidth = width + 2 * padding;
+    int paddedHeight = height + 2 * padding;
+    int sampleSize = int(sizeof(T));
+    this->paddedIn.resize(sampleSize * paddedWidth, paddedHeight, 1);
+    DenoiseTypedChannel<T> paddedIn(reinterpret_cast<T *>(this->paddedIn.plane(0).data),
+                                    paddedWidth, paddedHeight,
+                                    1, this->paddedIn.lineStride());
+    DenoiseTypedChannel<T> paddedOut = paddedIn;
+
+    if (!this->supportsInPlace()) {
+        this->paddedOut.resize(sampleSize * paddedWidth, paddedHeight, 1);
+        paddedOut = DenoiseTypedChannel<T>(reinterpret_cast<T *>(this->paddedOut.plane(0).data),
+                                           paddedWidth, paddedHeight,
+                                           1, this->paddedOut.lineStride());
+    }
+
+    DenoiseTraceScope stage("border/pad");
+    padChannel(in, paddedIn, padding, this->border,
+               DenoiseSampleTraits<T>::bound(this->borderValue),
+               *this->scheduler);
+    stage.next(0);
+    this->filter(paddedIn, paddedOut);
+    this->reserveWorkerScratch();
+    stage.next("border/crop");
+
+    this->scheduler->runLines(QSize(width, height), 0,
+                              [&] (const Tile &tile, int) {
+        for (int y = tile.rect.top(); y <= tile.rect.bottom(); y++) {
+            const T *src = paddedOut.line(y + padding) + padding;
+            T *dst = out.line(y);
+
+            if (out.pixelStride == 1)
+                memcpy(dst, src, size_t(width) * sizeof(T));
+            else
+                for (int x = 0; x < width; x++)
+                    dst[x * out.pixelStride] = src[x];
+        }
+    });
+
+    this->sharedArena.reset();
+}
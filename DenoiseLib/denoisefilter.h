@@ -0,0 +1,273 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#ifndef DENOISEFILTER_H
+#define DENOISEFILTER_H
+
+#include <cstring>
+#include <QScopedArrayPointer>
+
+#include "denoiseimage.h"
+#include "planarimage.h"
+#include "scratcharena.h"
+
+class QSize;
+class DenoiseTuner;
+class TileScheduler;
+
+// Pixels read by the windows outside of the image.
+enum DenoiseBorder
+{
+    // The windows are clipped to the image.
+    DenoiseBorderClipped,
+    // The border pixels are repeated, aaa|abcd|ddd.
+    DenoiseBorderReplicate,
+    // The image is mirrored at the border pixels, dcb|abcd|cba.
+    DenoiseBorderReflect,
+    // The pixels outside of the image have a constant value.
+    DenoiseBorderConstant
+};
+
+// Color channels filtered in the images with 3 channels.
+enum DenoiseColors
+{
+    // Red, green and blue are filtered independently.
+    DenoiseColorsRGB,
+    // The image is converted to YCbCr, and only Y is filtered.
+    DenoiseColorsLuma
+};
+
+// Filters a channel line by line, DenoiseChain uses it to run several
+// filters in a single pass without storing the intermediate images. Each
+// worker of the chain has its own line filter.
+class DenoiseLineFilter
+{
+    public:
+        DenoiseLineFilter(int width, int height, int radius);
+        virtual ~DenoiseLineFilter();
+
+        int width;
+        int height;
+
+        // Lines above and below of the output line that are read to
+        // calculate it.
+        int radius;
+
+        // Size in bytes of the lines written by prepareLine().
+        virtual int lineSize() const;
+
+        // Memory kept by the filter besides the lines, in bytes.
+        virtual qint64 bufferSize() const;
+
+        // Convert the input line y to the form read by filterLine(), by
+        // default a copy of it. Any work that only depends on a line is done
+        // here, once for each line.
+        virtual void prepareLine(const quint8 *in, int y, quint8 *line);
+
+        // Calculate the output line y. lines are the prepared lines of the
+        // window, clipped to the image, from max(y - radius, 0) to
+        // min(y + radius, height - 1). The lines of a band are filtered in
+        // order, first is true for the first line of the band.
+        virtual void filterLine(const quint8 *const *lines, int y, bool first,
+                                quint8 *out) = 0;
+};
+
+// Mixes the parameters of a filter into a key, with FNV-1a.
+class DenoiseKey
+{
+    public:
+        DenoiseKey():
+            key(Q_UINT64_C(0xcbf29ce484222325))
+        {
+        }
+
+        inline DenoiseKey &operator <<(quint64 value)
+        {
+            for (int i = 0; i < 8; i++) {
+                this->key ^= (value >> (8 * i)) & 0xff;
+                this->key *= Q_UINT64_C(0x100000001b3);
+            }
+
+            return *this;
+        }
+
+        inline DenoiseKey &operator <<(int value)
+        {
+            return *this << quint64(qint64(value));
+        }
+
+        inline DenoiseKey &operator <<(qreal value)
+        {
+            quint64 bits;
+            memcpy(&bits, &value, sizeof(bits));
+
+            return *this << bits;
+        }
+
+        inline operator quint64() const
+        {
+            return this->key;
+        }
+
+    private:
+        quint64 key;
+};
+
+// Base class of the filters.
+//
+// The filters keep their working buffers between calls, so filtering
+// several images of the same size doesn't allocates memory again. The
+// temporary memory of the workers comes from their scratch arenas.
+class DenoiseFilter
+{
+    public:
+        // If scheduler is null the filter uses the global scheduler.
+        explicit DenoiseFilter(TileScheduler *scheduler = 0);
+        virtual ~DenoiseFilter();
+
+        TileScheduler *tileScheduler() const;
+        void setTileScheduler(TileScheduler *scheduler);
+
+        // Split the interleaved images in planes before filtering them, and
+        // join the planes after. It's enabled by default, the filters are
+        // faster with consecutive pixels, but it uses more memory. Only the
+        // 8 bits formats are split.
+        bool planar;
+
+        // Pixels outside of the image, the windows are clipped by default.
+        // The other modes filter a copy of the channel padded with
+        // borderSize() pixels at each side, so the filters only see clipped
+        // windows in the padding, and the output is the center of the copy.
+        DenoiseBorder border;
+
+        // Value of the pixels outside of the image for DenoiseBorderConstant,
+        // in the range of the samples.
+        qreal borderValue;
+
+        // The luma mode filters one channel instead of three, for about a
+        // third of the cost, at the price of keeping the chroma noise. It
+        // always splits the image in planes, and only applies to the 8 bits
+        // color formats.
+        DenoiseColors colors;
+
+        // Filter applied to Cb and Cr in the luma mode, usually a cheaper
+        // one with a smaller radius. The chroma is not filtered if it's
+        // null, the default. The filter doesn't take the ownership of it.
+        DenoiseFilter *chromaFilter;
+
+        // If set, the method of the filter is picked by the tuner for each
+        // image instead of the method set by hand, that is used again when
+        // the tuner is unset. The filters of a fused chain keep their
+        // method. It's null by default, the filter doesn't take the
+        // ownership of it.
+        const DenoiseTuner *tuner;
+
+        // Pick the method for the images of the given size and format with
+        // the tuner, if there is one, and keep it in the next calls to
+        // process() until unlockTuning(). The parts of an image, like the
+        // strips or the dirty rectangles of a frame, must be filtered with
+        // the method of the whole image.
+        void lockTuning(const QSize &size, DenoiseFormat format);
+        void unlockTuning();
+
+        // Filter in into out. Both images must have the same size and
+        // format, and must be the same buffer or not overlap at all. The
+        // bytes that are not part of a color channel are copied from in.
+        // Returns false if the images can't be filtered.
+        bool process(const DenoiseImage &in, const DenoiseImage &out);
+
+        // Returns true if out can be the same buffer as in.
+        virtual bool supportsInPlace() const;
+
+        // Memory used by the working buffers of the filter, in bytes.
+        virtual qint64 bufferSize() const;
+
+        // Pixels read at each side of a pixel to calculate it, it's the
+        // padding of the border modes.
+        virtual int borderSize() const;
+
+        // Pixels read at each side of a pixel of an image of the format,
+        // including the windows of the chroma filter in the luma mode. It's
+        // the halo of the parts of an image filtered separately.
+        int haloSize(DenoiseFormat format) const;
+
+        // Create a line filter with the current parameters, for channels of
+        // the given size. Returns null if the filter can't work line by
+        // line.
+        virtual DenoiseLineFilter *createLineFilter(const QSize &size) const;
+
+        // Key of the parameters createLineFilter() depends on, the line
+        // filters created before are outdated when it changes.
+        virtual quint64 lineFilterKey() const;
+
+    protected:
+        TileScheduler *scheduler;
+
+        // Pick the fastest method for the image from the cost model of the
+        // tuner, within its error bound. Only the size and the format of the
+        // image are read. The filters with a single method don't need to
+        // implement it.
+        virtual void tune(const DenoiseTuner &tuner, const DenoiseImage &image);
+
+        // Called by process() before filtering the channels of an image, the
+        // filters that keep statistics of the image reset them here.
+        virtual void begin(const DenoiseImage &image);
+
+        // Filter a single channel. Each sample type has its own version, so
+        // the filters can use the best accumulators and algorithms for it.
+        virtual void filter(const DenoiseChannel &in,
+                            const DenoiseChannel &out) = 0;
+        virtual void filter(const DenoiseChannel16 &in,
+                            const DenoiseChannel16 &out) = 0;
+        virtual void filter(const DenoiseChannelFloat &in,
+                            const DenoiseChannelFloat &out) = 0;
+
+        // Scratch arenas of the workers of the scheduler, indexed by worker.
+        // The tile functions reset() the arena of their worker before using
+        // it.
+        ScratchArena *workerScratch() const;
+
+        // Scratch arena shared by the workers, it's reset before each call
+        // to filter().
+        ScratchArena &sharedScratch();
+
+    private:
+        PlanarImage inPlanes;
+        PlanarImage outPlanes;
+        PlanarImage paddedIn;
+        PlanarImage paddedOut;
+        QScopedArrayPointer<ScratchArena> workerArenas;
+        int workerArenaCount;
+        ScratchArena sharedArena;
+        bool tuningLocked;
+
+        template <typename T>
+        void filterChannels(const DenoiseImage &in, const DenoiseImage &out);
+
+        bool isLuma(DenoiseFormat format) const;
+        void filterLuma(const DenoiseImage &in, const DenoiseImage &out);
+        void reserveWorkerScratch();
+
+        template <typename T>
+        void filterChannel(const DenoiseTypedChannel<T> &in,
+                           const DenoiseTypedChannel<T> &out);
+};
+
+#endif // DENOISEFILTER_H
@@ -0,0 +1,198 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#include <cstring>
+
+#include "denoiseimage.h"
+
+DenoiseImage::DenoiseImage():
+    data(0),
+    width(0),
+    height(0),
+    stride(0),
+    format(DenoiseFormatInvalid)
+{
+}
+
+DenoiseImage::DenoiseImage(uchar *data,
+                           int width, int height, int stride,
+                           DenoiseFormat format):
+    data(data),
+    width(width),
+    height(height),
+    stride(stride),
+    format(format)
+{
+}
+
+DenoiseImage::DenoiseImage(const uchar *data,
+                           int width, int height, int stride,
+                           DenoiseFormat format):
+    data(const_cast<uchar *>(data)),
+    width(width),
+    height(height),
+    stride(stride),
+    format(format)
+{
+}
+
+bool DenoiseImage::isValid() const
+{
+    return this->data
+           && this->width > 0
+           && this->height > 0
+           && this->format != DenoiseFormatInvalid
+           && this->stride >= this->width * this->bytesPerPixel();
+}
+
+int DenoiseImage::bytesPerPixel() const
+{
+    switch (this->format) {
+    case DenoiseFormatGray8:
+        return 1;
+    case DenoiseFormatRGB888:
+        return 3;
+    case DenoiseFormatRGB32:
+    case DenoiseFormatARGB32:
+        return 4;
+    case DenoiseFormatGray16:
+        return 2;
+    case DenoiseFormatRGBA64:
+        return 8;
+    case DenoiseFormatGrayFloat:
+        return 4;
+    case DenoiseFormatRGBAFloat:
+        return 16;
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+DenoiseSample DenoiseImage::sample() const
+{
+    switch (this->format) {
+    case DenoiseFormatGray16:
+    case DenoiseFormatRGBA64:
+        return DenoiseSampleUInt16;
+    case DenoiseFormatGrayFloat:
+    case DenoiseFormatRGBAFloat:
+        return DenoiseSampleFloat;
+    default:
+        break;
+    }
+
+    return DenoiseSampleUInt8;
+}
+
+int DenoiseImage::channels() const
+{
+    switch (this->format) {
+    case DenoiseFormatGray8:
+    case DenoiseFormatGray16:
+    case DenoiseFormatGrayFloat:
+        return 1;
+    case DenoiseFormatRGB888:
+    case DenoiseFormatRGB32:
+    case DenoiseFormatARGB32:
+    case DenoiseFormatRGBA64:
+    case DenoiseFormatRGBAFloat:
+        return 3;
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+DenoiseChannel DenoiseImage::channel(int channel) const
+{
+    return this->typedChannel<quint8>(channel);
+}
+
+void DenoiseImage::copyExtraBytes(const DenoiseImage &other) const
+{
+    if (this->data == other.data)
+        return;
+
+    // Position and size of the alpha channel.
+    int offset = 0;
+    int size = 0;
+
+    switch (this->format) {
+    case DenoiseFormatRGB32:
+    case DenoiseFormatARGB32:
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+        offset = 3;
+#endif
+        size = 1;
+        break;
+    case DenoiseFormatRGBA64:
+        offset = 6;
+        size = 2;
+        break;
+    case DenoiseFormatRGBAFloat:
+        offset = 12;
+        size = 4;
+        break;
+    default:
+        return;
+    }
+
+    int pixelSize = this->bytesPerPixel();
+
+    for (int y = 0; y < this->height; y++) {
+        const uchar *src = other.data + qptrdiff(y) * other.stride + offset;
+        uchar *dst = this->data + qptrdiff(y) * this->stride + offset;
+
+        if (size == 1) {
+            for (int x = 0; x < this->width; x++)
+                dst[pixelSize * x] = src[pixelSize * x];
+        } else {
+            for (int x = 0; x < this->width; x++)
+                memcpy(dst + pixelSize * x, src + pixelSize * x, size_t(size));
+        }
+    }
+}
+
+int DenoiseImage::channelOffset(int channel) const
+{
+    switch (this->format) {
+    case DenoiseFormatRGB888:
+        return channel;
+    case DenoiseFormatRGB32:
+    case DenoiseFormatARGB32:
+        // The words are stored in the native byte order.
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+        return 2 - channel;
+#else
+        return 1 + channel;
+#endif
+    case DenoiseFormatRGBA64:
+        return 2 * channel;
+    case DenoiseFormatRGBAFloat:
+        return 4 * channel;
+    default:
+        break;
+    }
+
+    return 0;
+}
@@ -0,0 +1,223 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#ifndef DENOISEIMAGE_H
+#define DENOISEIMAGE_H
+
+#include <QtGlobal>
+
+enum DenoiseFormat
+{
+    DenoiseFormatInvalid,
+    // 8 bits gray.
+    DenoiseFormatGray8,
+    // 24 bits, red, green and blue bytes in that order.
+    DenoiseFormatRGB888,
+    // 32 bits 0xffRRGGBB words, same as QImage::Format_RGB32.
+    DenoiseFormatRGB32,
+    // 32 bits 0xAARRGGBB words, same as QImage::Format_ARGB32.
+    DenoiseFormatARGB32,
+    // 16 bits gray, in the native byte order.
+    DenoiseFormatGray16,
+    // 64 bits, red, green, blue and alpha 16 bits words in that order, same
+    // as QImage::Format_RGBA64.
+    DenoiseFormatRGBA64,
+    // 32 bits floating point gray.
+    DenoiseFormatGrayFloat,
+    // 128 bits, red, green, blue and alpha floats in that order.
+    DenoiseFormatRGBAFloat
+};
+
+// Type of the samples of a format.
+enum DenoiseSample
+{
+    DenoiseSampleUInt8,
+    DenoiseSampleUInt16,
+    DenoiseSampleFloat
+};
+
+// A channel of an image, the samples are pixelStride samples apart and the
+// lines are lineStride bytes apart.
+template <typename T>
+class DenoiseTypedChannel
+{
+    public:
+        DenoiseTypedChannel():
+            data(0),
+            width(0),
+            height(0),
+            pixelStride(0),
+            lineStride(0)
+        {
+        }
+
+        DenoiseTypedChannel(T *data,
+                            int width, int height,
+                            int pixelStride, int lineStride):
+            data(data),
+            width(width),
+            height(height),
+            pixelStride(pixelStride),
+            lineStride(lineStride)
+        {
+        }
+
+        inline T *line(int y) const
+        {
+            return reinterpret_cast<T *>(reinterpret_cast<quint8 *>(this->data)
+                                         + qptrdiff(y) * this->lineStride);
+        }
+
+        inline T &pixel(int x, int y) const
+        {
+            return this->line(y)[x * this->pixelStride];
+        }
+
+        T *data;
+        int width;
+        int height;
+        int pixelStride;
+        int lineStride;
+};
+
+typedef DenoiseTypedChannel<quint8> DenoiseChannel;
+typedef DenoiseTypedChannel<quint16> DenoiseChannel16;
+typedef DenoiseTypedChannel<float> DenoiseChannelFloat;
+
+// Range and conversions of the sample types. The integer samples go from 0
+// to maximum(), the floating point samples usually go from 0 to 1, but they
+// are not limited.
+template <typename T> struct DenoiseSampleTraits;
+
+template <> struct DenoiseSampleTraits<quint8>
+{
+    static const DenoiseFormat grayFormat = DenoiseFormatGray8;
+    static const bool isInteger = true;
+
+    static inline qreal maximum()
+    {
+        return 255;
+    }
+
+    // Truncate a value known to be in range.
+    static inline quint8 fromReal(qreal value)
+    {
+        return quint8(value);
+    }
+
+    static inline quint8 bound(qreal value)
+    {
+        return quint8(qBound(0., value, 255.));
+    }
+};
+
+template <> struct DenoiseSampleTraits<quint16>
+{
+    static const DenoiseFormat grayFormat = DenoiseFormatGray16;
+    static const bool isInteger = true;
+
+    static inline qreal maximum()
+    {
+        return 65535;
+    }
+
+    static inline quint16 fromReal(qreal value)
+    {
+        return quint16(value);
+    }
+
+    static inline quint16 bound(qreal value)
+    {
+        return quint16(qBound(0., value, 65535.));
+    }
+};
+
+template <> struct DenoiseSampleTraits<float>
+{
+    static const DenoiseFormat grayFormat = DenoiseFormatGrayFloat;
+    static const bool isInteger = false;
+
+    static inline qreal maximum()
+    {
+        return 1;
+    }
+
+    static inline float fromReal(qreal value)
+    {
+        return float(value);
+    }
+
+    static inline float bound(qreal value)
+    {
+        return float(value);
+    }
+};
+
+// An image in memory owned by the caller. The filters never write in the
+// input image, the constructor taking a const pointer is only a
+// convenience for that case.
+class DenoiseImage
+{
+    public:
+        DenoiseImage();
+        DenoiseImage(uchar *data,
+                     int width, int height, int stride,
+                     DenoiseFormat format);
+        DenoiseImage(const uchar *data,
+                     int width, int height, int stride,
+                     DenoiseFormat format);
+
+        bool isValid() const;
+        int bytesPerPixel() const;
+        DenoiseSample sample() const;
+
+        // Number of color channels, the filters process each one of them
+        // independently.
+        int channels() const;
+        DenoiseChannel channel(int channel) const;
+
+        // Channel of an image with samples of type T.
+        template <typename T>
+        inline DenoiseTypedChannel<T> typedChannel(int channel) const
+        {
+            uchar *data = this->data + this->channelOffset(channel);
+
+            return DenoiseTypedChannel<T>(reinterpret_cast<T *>(data),
+                                          this->width, this->height,
+                                          this->bytesPerPixel() / int(sizeof(T)),
+                                          this->stride);
+        }
+
+        // Copy the bytes that are not part of any color channel, like the
+        // alpha channel, from other.
+        void copyExtraBytes(const DenoiseImage &other) const;
+
+        uchar *data;
+        int width;
+        int height;
+        int stride;
+        DenoiseFormat format;
+
+    private:
+        // Position of the first sample of a channel, in bytes.
+        int channelOffset(int channel) const;
+};
+
+#endif // DENOISEIMAGE_H
@@ -0,0 +1,293 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#include <cstring>
+#include <QSize>
+
+#include "denoiseincremental.h"
+#include "denoisefilter.h"
+#include "tilescheduler.h"
+
+// Copy height lines of lineSize bytes.
+void copyLines(const uchar *src, int srcStride,
+               uchar *dst, int dstStride,
+               int lineSize, int height,
+               TileScheduler &scheduler)
+{
+    scheduler.runLines(QSize(lineSize, height), 0,
+                       [&] (const Tile &tile, int) {
+        for (int y = tile.rect.top(); y <= tile.rect.bottom(); y++)
+            memcpy(dst + y * dstStride, src + y * srcStride, size_t(lineSize));
+    });
+}
+
+DenoiseIncremental::DenoiseIncremental(DenoiseFilter *filter):
+    tileSize(64),
+    filter(filter),
+    width(0),
+    height(0),
+    format(DenoiseFormatInvalid),
+    tiles(0),
+    tilesX(0),
+    tilesY(0),
+    ratio(0)
+{
+}
+
+bool DenoiseIncremental::process(const DenoiseImage &in,
+                                 const DenoiseImage &out)
+{
+    // The dirty rectangles are filtered with the method tuned for the whole
+    // frame, the halo around them depends on it too.
+    this->filter->lockTuning(QSize(in.width, in.height), in.format);
+    bool ok = this->processFrame(in, out);
+    this->filter->unlockTuning();
+
+    return ok;
+}
+
+bool DenoiseIncremental::processFrame(const DenoiseImage &in,
+                                      const DenoiseImage &out)
+{
+    if (!in.isValid()
+        || !out.isValid()
+        || in.width != out.width
+        || in.height != out.height
+        || in.format != out.format)
+        return false;
+
+    TileScheduler &scheduler = *this->filter->tileScheduler();
+    int width = in.width;
+    int height = in.height;
+    QSize size(width, height);
+    int bytesPerPixel = in.bytesPerPixel();
+    int lineSize = width * bytesPerPixel;
+    int tileSize = qMax(this->tileSize, 1);
+
+    if (this->previous.isEmpty()
+        || width != this->width
+        || height != this->height
+        || in.format != this->format
+        || tileSize != this->tiles) {
+        this->reset();
+
+        // The input is kept before filtering it, in place filters overwrite
+        // it.
+        this->previous.resize(lineSize * height);
+        copyLines(in.data, in.stride,
+                  this->previous.data(), lineSize,
+                  lineSize, height, scheduler);
+
+        if (!this->filter->process(in, out)) {
+            this->reset();
+
+            return false;
+        }
+
+        this->width = width;
+        this->height = height;
+        this->format = in.format;
+        this->tiles = tileSize;
+        this->tilesX = (width + tileSize - 1) / tileSize;
+        this->tilesY = (height + tileSize - 1) / tileSize;
+        this->filtered.resize(lineSize * height);
+        this->changed.resize(this->tilesX * this->tilesY);
+        this->dirty.resize(this->tilesX * this->tilesY);
+        copyLines(out.data, out.stride,
+                  this->filtered.data(), lineSize,
+                  lineSize, height, scheduler);
+        this->ratio = 1;
+
+        return true;
+    }
+
+    // Compare the tiles with the previous frame, and keep the changed ones
+    // for the next frame.
+    uchar *previous = this->previous.data();
+    quint8 *changed = this->changed.data();
+
+    scheduler.run(size, QSize(tileSize, tileSize), 0,
+                  [&] (const Tile &tile, int) {
+        int offset = tile.rect.x() * bytesPerPixel;
+        size_t bytes = size_t(tile.rect.width() * bytesPerPixel);
+        bool isChanged = false;
+
+        for (int y = tile.rect.top(); y <= tile.rect.bottom(); y++) {
+            const uchar *src = in.data + y * in.stride + offset;
+            uchar *dst = previous + y * lineSize + offset;
+
+            if (isChanged || memcmp(dst, src, bytes)) {
+                memcpy(dst, src, bytes);
+                isChanged = true;
+            }
+        }
+
+        changed[tile.index] = isChanged;
+    });
+
+    // A tile must be filtered again if any tile closer than the halo
+    // changed.
+    int tilesX = this->tilesX;
+    int tilesY = this->tilesY;
+    int halo = this->filter->haloSize(in.format);
+    int reach = (halo + tileSize - 1) / tileSize;
+    quint8 *dirty = this->dirty.data();
+
+    for (int ty = 0; ty < tilesY; ty++)
+        for (int tx = 0; tx < tilesX; tx++) {
+            bool isDirty = false;
+
+            for (int j = qMax(ty - reach, 0);
+                 !isDirty && j <= qMin(ty + reach, tilesY - 1);
+                 j++)
+                for (int i = qMax(tx - reach, 0);
+                     i <= qMin(tx + reach, tilesX - 1);
+                     i++)
+                    if (changed[i + j * tilesX]) {
+                        isDirty = true;
+
+                        break;
+                    }
+
+            dirty[tx + ty * tilesX] = isDirty;
+        }
+
+    // The dirty tiles are filtered in rectangles, each run of dirty tiles
+    // of a row is extended down while the same tiles are dirty in the rows
+    // below.
+    qint64 area = 0;
+
+    for (int ty = 0; ty < tilesY; ty++)
+        for (int tx = 0; tx < tilesX; tx++) {
+            if (!dirty[tx + ty * tilesX])
+                continue;
+
+            int left = tx;
+
+            while (tx + 1 < tilesX && dirty[tx + 1 + ty * tilesX])
+                tx++;
+
+            int bottom = ty;
+
+            for (int j = ty + 1; j < tilesY; j++) {
+                int i = left;
+
+                while (i <= tx && dirty[i + j * tilesX])
+                    i++;
+
+                if (i <= tx)
+                    break;
+
+                memset(dirty + left + j * tilesX, 0, size_t(tx - left + 1));
+                bottom = j;
+            }
+
+            QRect rect = QRect(left * tileSize,
+                               ty * tileSize,
+                               (tx - left + 1) * tileSize,
+                               (bottom - ty + 1) * tileSize)
+                         .intersected(QRect(QPoint(0, 0), size));
+
+            if (!this->filterRect(in, rect, halo)) {
+                this->reset();
+
+                return false;
+            }
+
+            area += qint64(rect.width()) * rect.height();
+        }
+
+    this->ratio = qreal(area) / (qreal(width) * height);
+
+    // The output is written at the end, it can be the input.
+    copyLines(this->filtered.constData(), lineSize,
+              out.data, out.stride,
+              lineSize, height, scheduler);
+
+    return true;
+}
+
+void DenoiseIncremental::reset()
+{
+    this->previous.clear();
+    this->filtered.clear();
+    this->width = 0;
+    this->height = 0;
+    this->format = DenoiseFormatInvalid;
+    this->tiles = 0;
+    this->tilesX = 0;
+    this->tilesY = 0;
+    this->ratio = 0;
+}
+
+qreal DenoiseIncremental::dirtyRatio() const
+{
+    return this->ratio;
+}
+
+qint64 DenoiseIncremental::bufferSize() const
+{
+    return this->previous.size()
+         + this->filtered.size()
+         + this->crop.size()
+         + this->changed.size()
+         + this->dirty.size();
+}
+
+bool DenoiseIncremental::filterRect(const DenoiseImage &in,
+                                    const QRect &rect, int halo)
+{
+    QRect source = rect.adjusted(-halo, -halo, halo, halo)
+                   .intersected(QRect(0, 0, this->width, this->height));
+    int bytesPerPixel = in.bytesPerPixel();
+    int lineSize = this->width * bytesPerPixel;
+    int cropStride = source.width() * bytesPerPixel;
+    this->crop.resize(cropStride * source.height());
+
+    DenoiseImage cropIn(in.data
+                        + source.y() * in.stride
+                        + source.x() * bytesPerPixel,
+                        source.width(),
+                        source.height(),
+                        in.stride,
+                        in.format);
+    DenoiseImage cropOut(this->crop.data(),
+                         source.width(),
+                         source.height(),
+                         cropStride,
+                         in.format);
+
+    if (!this->filter->process(cropIn, cropOut))
+        return false;
+
+    // Only the pixels of rect have the whole window inside of the source.
+    const uchar *src = this->crop.constData()
+                       + (rect.y() - source.y()) * cropStride
+                       + (rect.x() - source.x()) * bytesPerPixel;
+    uchar *dst = this->filtered.data()
+                 + rect.y() * lineSize
+                 + rect.x() * bytesPerPixel;
+
+    for (int y = 0; y < rect.height(); y++)
+        memcpy(dst + y * lineSize, src + y * cropStride,
+               size_t(rect.width() * bytesPerPixel));
+
+    return true;
+}
@@ -0,0 +1,92 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#ifndef DENOISEINCREMENTAL_H
+#define DENOISEINCREMENTAL_H
+
+#include <QRect>
+#include <QVector>
+
+#include "denoiseimage.h"
+
+class DenoiseFilter;
+
+// Filter the frames of a video from a static camera, where most of each
+// frame is the same as in the previous one.
+//
+// Each frame is compared with the previous one in tiles of tileSize, the
+// tiles that changed are grown by the haloSize() of the filter, and only
+// those are filtered again, the rest of the output is copied from the
+// previous filtered frame. The filter runs over the rectangles of dirty
+// tiles plus the halo around them, so its working buffers, like the
+// integral images of the mean filter, only cover the dirty area too.
+//
+// The comparison and the copy of the output still touch the whole frame,
+// but at memcmp() and memcpy() speed, the cost of the filter depends on
+// the changed area instead of the size of the frame. The output is the
+// same as filtering the whole frame, except for the recursive gauss, that
+// cuts its response at 3 sigma.
+class DenoiseIncremental
+{
+    public:
+        explicit DenoiseIncremental(DenoiseFilter *filter);
+
+        // Size of the tiles compared between frames, smaller tiles filter
+        // less unchanged pixels but more halo around them.
+        int tileSize;
+
+        // Filter a frame. The first frame, and the frames of other size or
+        // format than the previous one, are filtered completely.
+        bool process(const DenoiseImage &in, const DenoiseImage &out);
+
+        // Forget the previous frame, the next one is filtered completely.
+        void reset();
+
+        // Fraction of the last frame that was filtered.
+        qreal dirtyRatio() const;
+
+        qint64 bufferSize() const;
+
+    private:
+        DenoiseFilter *filter;
+        int width;
+        int height;
+        DenoiseFormat format;
+        int tiles;
+        int tilesX;
+        int tilesY;
+
+        // Previous input and output frames, with lines of width pixels.
+        QVector<uchar> previous;
+        QVector<uchar> filtered;
+
+        // Output of the filter for a dirty rectangle and its halo.
+        QVector<uchar> crop;
+
+        // One flag per tile.
+        QVector<quint8> changed;
+        QVector<quint8> dirty;
+        qreal ratio;
+
+        bool processFrame(const DenoiseImage &in, const DenoiseImage &out);
+        bool filterRect(const DenoiseImage &in, const QRect &rect, int halo);
+};
+
+#endif // DENOISEINCREMENTAL_H
@@ -0,0 +1,465 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#include <QThreadPool>
+
+#ifdef Q_OS_WIN
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include "denoisestream.h"
+#include "denoisefilter.h"
+#include "denoiseincremental.h"
+#include "denoisetrace.h"
+#include "pipeline.h"
+
+// Longest Y4M header line accepted.
+static const int maxHeaderSize = 1024;
+
+class StreamFrame
+{
+    public:
+        StreamFrame():
+            readTime(0)
+        {
+        }
+
+        QVector<uchar> data;
+
+        // Only used if the filter can't work in place.
+        QVector<uchar> filtered;
+
+        // Time when the frame was read, in nanoseconds.
+        qint64 readTime;
+};
+
+DenoiseStream::DenoiseStream(DenoiseFilter *filter):
+    queueSize(3),
+    incremental(false),
+    filter(filter),
+    input(0),
+    output(0),
+    y4m(false),
+    frameBytes(0),
+    freeFrames(0),
+    readFrames(0),
+    filteredFrames(0),
+    frameCount(0),
+    totalTime(0),
+    totalLatency(0),
+    maximumLatency(0),
+    dirtyArea(0),
+    totalArea(0)
+{
+}
+
+bool DenoiseStream::parseArguments(const QStringList &arguments)
+{
+    bool stream = false;
+
+    for (int i = 1; i < arguments.size(); i++)
+        if (arguments[i] == "--stream") {
+            stream = true;
+        } else if (arguments[i] == "--incremental") {
+            this->incremental = true;
+        } else if (arguments[i] == "--size") {
+            QStringList size = arguments.value(i + 1).split('x');
+
+            // A wrong size is reported when the stream starts.
+            this->frameSize = size.size() == 2?
+                                  QSize(size[0].toInt(), size[1].toInt()):
+                                  QSize(0, 0);
+            i++;
+        }
+
+    return stream;
+}
+
+bool DenoiseStream::run(FILE *input, FILE *output)
+{
+#ifdef Q_OS_WIN
+    _setmode(_fileno(input), _O_BINARY);
+    _setmode(_fileno(output), _O_BINARY);
+#endif
+
+    this->input = input;
+    this->output = output;
+    this->error.clear();
+    this->abort.store(0);
+    this->frameCount = 0;
+    this->totalTime = 0;
+    this->totalLatency = 0;
+    this->maximumLatency = 0;
+    this->dirtyArea = 0;
+    this->totalArea = 0;
+
+    if (!this->readHeader())
+        return false;
+
+    if (this->y4m
+        && fwrite(this->header.constData(), 1, size_t(this->header.size()),
+                  output) != size_t(this->header.size())) {
+        this->setError("Can't write the stream header");
+
+        return false;
+    }
+
+    // Allocate all the frames.
+    bool inPlace = this->filter->supportsInPlace();
+    int queueSize = qMax(this->queueSize, 1);
+    this->freeFrames = new PipelineQueue<StreamFrame>(queueSize);
+    this->readFrames = new PipelineQueue<StreamFrame>(queueSize);
+    this->filteredFrames = new PipelineQueue<StreamFrame>(queueSize);
+
+    for (int i = 0; i < queueSize; i++) {
+        StreamFrame *frame = new StreamFrame;
+        frame->data.resize(this->frameBytes);
+
+        if (!inPlace)
+            frame->filtered.resize(this->frameBytes);
+
+        this->frameBuffers << frame;
+        this->freeFrames->push(frame);
+    }
+
+    // Each plane is compared with the same plane of the previous frame.
+    QVector<DenoiseIncremental *> incrementals;
+
+    if (this->incremental)
+        for (int i = 0; i < this->planes.size(); i++)
+            incrementals << new DenoiseIncremental(this->filter);
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(2);
+    this->timer.start();
+    pool.start(new PipelineStage([this] () {
+        this->readLoop();
+    }));
+    pool.start(new PipelineStage([this] () {
+        this->writeLoop();
+    }));
+
+    forever {
+        StreamFrame *frame = this->readFrames->pop();
+
+        if (!frame)
+            break;
+
+        if (!this->abort.load()) {
+            uchar *data = frame->data.data();
+            uchar *filtered = inPlace? data: frame->filtered.data();
+
+            for (int i = 0; i < this->planes.size(); i++) {
+                const Plane &plane = this->planes[i];
+                DenoiseImage in(data + plane.offset,
+                                plane.width,
+                                plane.height,
+                                plane.stride,
+                                plane.format);
+                DenoiseImage out(filtered + plane.offset,
+                                 plane.width,
+                                 plane.height,
+                                 plane.stride,
+                                 plane.format);
+                qint64 area = qint64(plane.width) * plane.height;
+
+                if (this->incremental) {
+                    incrementals[i]->process(in, out);
+                    this->dirtyArea += incrementals[i]->dirtyRatio() * area;
+                } else {
+                    this->filter->process(in, out);
+                    this->dirtyArea += area;
+                }
+
+                this->totalArea += area;
+            }
+        }
+
+        this->filteredFrames->push(frame);
+    }
+
+    this->filteredFrames->push(0);
+    pool.waitForDone();
+    this->totalTime = this->timer.nsecsElapsed();
+
+    qDeleteAll(incrementals);
+    qDeleteAll(this->frameBuffers);
+    this->frameBuffers.clear();
+    delete this->freeFrames;
+    delete this->readFrames;
+    delete this->filteredFrames;
+    this->freeFrames = 0;
+    this->readFrames = 0;
+    this->filteredFrames = 0;
+
+    return this->errorString().isEmpty();
+}
+
+QString DenoiseStream::errorString() const
+{
+    QMutexLocker locker(&this->errorMutex);
+
+    return this->error;
+}
+
+qint64 DenoiseStream::frames() const
+{
+    return this->frameCount;
+}
+
+qreal DenoiseStream::framesPerSecond() const
+{
+    return this->totalTime > 0?
+               1e9 * this->frameCount / this->totalTime: 0;
+}
+
+qreal DenoiseStream::averageLatency() const
+{
+    return this->frameCount > 0?
+               1e-6 * this->totalLatency / this->frameCount: 0;
+}
+
+qreal DenoiseStream::maxLatency() const
+{
+    return 1e-6 * this->maximumLatency;
+}
+
+qreal DenoiseStream::dirtyRatio() const
+{
+    return this->totalArea > 0? this->dirtyArea / this->totalArea: 0;
+}
+
+bool DenoiseStream::readHeader()
+{
+    this->planes.clear();
+    this->header.clear();
+    this->y4m = !this->frameSize.isValid();
+
+    if (!this->y4m) {
+        if (this->frameSize.isEmpty()) {
+            this->setError("Invalid frame size");
+
+            return false;
+        }
+
+        Plane plane = {0,
+                       this->frameSize.width(),
+                       this->frameSize.height(),
+                       4 * this->frameSize.width(),
+                       DenoiseFormatRGB32};
+        this->planes << plane;
+        this->frameBytes = plane.stride * plane.height;
+
+        return true;
+    }
+
+    // YUV4MPEG2 W<width> H<height> [F<fps>] [I<interlacing>]
+    // [A<aspect ratio>] [C<color space>] [X<comment>]
+    for (int c = fgetc(this->input); c != '\n'; c = fgetc(this->input)) {
+        if (c == EOF || this->header.size() >= maxHeaderSize) {
+            this->setError("Invalid Y4M header");
+
+            return false;
+        }
+
+        this->header.append(char(c));
+    }
+
+    QStringList params = QString::fromLatin1(this->header).split(' ');
+    this->header.append('\n');
+
+    if (params.value(0) != "YUV4MPEG2") {
+        this->setError("The input is not a Y4M stream");
+
+        return false;
+    }
+
+    int width = 0;
+    int height = 0;
+    QString colorSpace = "420";
+
+    for (const QString &param: params)
+        if (param.startsWith("W"))
+            width = param.mid(1).toInt();
+        else if (param.startsWith("H"))
+            height = param.mid(1).toInt();
+        else if (param.startsWith("C"))
+            colorSpace = param.mid(1);
+
+    if (width < 1 || height < 1) {
+        this->setError("Invalid frame size");
+
+        return false;
+    }
+
+    // The chroma planes are subsampled depending on the color space.
+    int chromaWidth = 0;
+    int chromaHeight = 0;
+
+    if (colorSpace == "420"
+        || colorSpace == "420jpeg"
+        || colorSpace == "420paldv"
+        || colorSpace == "420mpeg2") {
+        chromaWidth = (width + 1) / 2;
+        chromaHeight = (height + 1) / 2;
+    } else if (colorSpace == "422") {
+        chromaWidth = (width + 1) / 2;
+        chromaHeight = height;
+    } else if (colorSpace == "444") {
+        chromaWidth = width;
+        chromaHeight = height;
+    } else if (colorSpace != "mono") {
+        this->setError(QString("Unsupported Y4M color space: %1")
+                       .arg(colorSpace));
+
+        return false;
+    }
+
+    Plane luma = {0, width, height, width, DenoiseFormatGray8};
+    this->planes << luma;
+    this->frameBytes = width * height;
+
+    for (int i = 0; chromaWidth > 0 && i < 2; i++) {
+        Plane chroma = {this->frameBytes,
+                        chromaWidth,
+                        chromaHeight,
+                        chromaWidth,
+                        DenoiseFormatGray8};
+        this->planes << chroma;
+        this->frameBytes += chromaWidth * chromaHeight;
+    }
+
+    return true;
+}
+
+bool DenoiseStream::readFrame(StreamFrame *frame)
+{
+    DenoiseTraceScope stage("stream/read");
+
+    if (this->y4m) {
+        // FRAME [parameters]
+        QByteArray frameHeader;
+
+        for (int c = fgetc(this->input); c != '\n'; c = fgetc(this->input)) {
+            // The stream can only end before a frame.
+            if (c == EOF && frameHeader.isEmpty())
+                return false;
+
+            if (c == EOF || frameHeader.size() >= maxHeaderSize) {
+                this->setError("Invalid Y4M frame header");
+
+                return false;
+            }
+
+            frameHeader.append(char(c));
+        }
+
+        if (!frameHeader.startsWith("FRAME")) {
+            this->setError("Invalid Y4M frame header");
+
+            return false;
+        }
+    }
+
+    size_t bytes = fread(frame->data.data(), 1, size_t(this->frameBytes),
+                         this->input);
+
+    if (bytes == size_t(this->frameBytes))
+        return true;
+
+    if (bytes > 0 || this->y4m)
+        this->setError("Truncated frame");
+
+    return false;
+}
+
+// The parameters of the input frame headers are not written, the frames
+// only have the parameters of the stream header.
+bool DenoiseStream::writeFrame(const StreamFrame *frame)
+{
+    static const char frameHeader[] = "FRAME\n";
+    DenoiseTraceScope stage("stream/write");
+
+    if (this->y4m
+        && fwrite(frameHeader, 1, sizeof(frameHeader) - 1, this->output)
+           != sizeof(frameHeader) - 1)
+        return false;
+
+    const QVector<uchar> &data = frame->filtered.isEmpty()?
+                                     frame->data: frame->filtered;
+
+    if (fwrite(data.constData(), 1, size_t(this->frameBytes), this->output)
+        != size_t(this->frameBytes))
+        return false;
+
+    // Send the frame now, don't wait for the buffer to fill.
+    return fflush(this->output) == 0;
+}
+
+void DenoiseStream::readLoop()
+{
+    forever {
+        StreamFrame *frame = this->freeFrames->pop();
+
+        if (this->abort.load() || !this->readFrame(frame)) {
+            this->readFrames->push(0);
+
+            return;
+        }
+
+        frame->readTime = this->timer.nsecsElapsed();
+        this->readFrames->push(frame);
+    }
+}
+
+void DenoiseStream::writeLoop()
+{
+    forever {
+        StreamFrame *frame = this->filteredFrames->pop();
+
+        if (!frame)
+            return;
+
+        // After an error the frames are only returned to the reader, until
+        // it notices it must stop.
+        if (!this->abort.load()) {
+            if (this->writeFrame(frame)) {
+                qint64 latency = this->timer.nsecsElapsed() - frame->readTime;
+                this->frameCount++;
+                this->totalLatency += latency;
+                this->maximumLatency = qMax(this->maximumLatency, latency);
+            } else {
+                this->setError("Can't write the frame");
+                this->abort.store(1);
+            }
+        }
+
+        this->freeFrames->push(frame);
+    }
+}
+
+void DenoiseStream::setError(const QString &error)
+{
+    QMutexLocker locker(&this->errorMutex);
+
+    if (this->error.isEmpty())
+        this->error = error;
+}
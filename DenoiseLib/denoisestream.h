@@ -0,0 +1,131 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#ifndef DENOISESTREAM_H
+#define DENOISESTREAM_H
+
+#include <cstdio>
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "denoiseimage.h"
+
+class DenoiseFilter;
+class DenoiseIncremental;
+class StreamFrame;
+template <typename T> class PipelineQueue;
+
+// Filter a video stream, reading the frames from input and writing the
+// filtered frames to output.
+//
+// The input can be raw RGB32 frames of a known size, or a Y4M stream with 8
+// bits planes, in which case each plane is filtered as a gray image. The
+// frames are read, filtered and written in three stages that run at the
+// same time, the reader and the writer have their own threads, and the
+// filter runs in the calling thread. All the frame buffers are allocated
+// once, when the stream starts, and go around the stages until the end of
+// the stream.
+class DenoiseStream
+{
+    public:
+        explicit DenoiseStream(DenoiseFilter *filter);
+
+        // Size of the raw frames, if the size is not valid the input is
+        // read as Y4M.
+        QSize frameSize;
+
+        // Number of frames in flight. Three frames keeps the three stages
+        // busy, more frames absorb the jitter of the input at the cost of
+        // latency and memory.
+        int queueSize;
+
+        // Only filter again the tiles that changed since the previous frame,
+        // for static cameras.
+        bool incremental;
+
+        // Read the stream options, "--stream" enables the streaming mode,
+        // "--size WIDTHxHEIGHT" reads raw RGB32 frames instead of Y4M, and
+        // "--incremental" enables the incremental mode.
+        // Returns true if the streaming mode was requested.
+        bool parseArguments(const QStringList &arguments);
+
+        // Filter all the frames in input. Returns false on error.
+        bool run(FILE *input, FILE *output);
+
+        QString errorString() const;
+
+        // Statistics of the last run.
+        qint64 frames() const;
+        qreal framesPerSecond() const;
+
+        // Time in milliseconds since a frame was read until it was written.
+        qreal averageLatency() const;
+        qreal maxLatency() const;
+
+        // Fraction of the pixels filtered in the incremental mode.
+        qreal dirtyRatio() const;
+
+    private:
+        struct Plane
+        {
+            int offset;
+            int width;
+            int height;
+            int stride;
+            DenoiseFormat format;
+        };
+
+        DenoiseFilter *filter;
+        FILE *input;
+        FILE *output;
+        QString error;
+        mutable QMutex errorMutex;
+        bool y4m;
+        QByteArray header;
+        QVector<Plane> planes;
+        int frameBytes;
+        QVector<StreamFrame *> frameBuffers;
+        PipelineQueue<StreamFrame> *freeFrames;
+        PipelineQueue<StreamFrame> *readFrames;
+        PipelineQueue<StreamFrame> *filteredFrames;
+        QAtomicInt abort;
+        QElapsedTimer timer;
+        qint64 frameCount;
+        qint64 totalTime;
+        qint64 totalLatency;
+        qint64 maximumLatency;
+        qreal dirtyArea;
+        qint64 totalArea;
+
+        bool readHeader();
+        bool readFrame(StreamFrame *frame);
+        bool writeFrame(const StreamFrame *frame);
+        void readLoop();
+        void writeLoop();
+        void setError(const QString &error);
+};
+
+#endif // DENOISESTREAM_H
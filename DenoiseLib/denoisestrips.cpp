@@ -0,0 +1,327 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#include <cctype>
+#include <cstring>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QVector>
+
+#include "denoisestrips.h"
+#include "denoisefilter.h"
+#include "denoisetrace.h"
+
+// Header of a binary PNM image.
+struct PnmHeader
+{
+    char type;
+    int width;
+    int height;
+    int maxValue;
+};
+
+// Read a number of the header, skipping the blanks and comments before it.
+bool readPnmNumber(QFile &file, int *value)
+{
+    char c = 0;
+
+    forever {
+        if (!file.getChar(&c))
+            return false;
+
+        if (c == '#') {
+            while (c != '\n')
+                if (!file.getChar(&c))
+                    return false;
+        } else if (!isspace(c)) {
+            break;
+        }
+    }
+
+    qint64 number = 0;
+
+    while (c >= '0' && c <= '9') {
+        number = 10 * number + c - '0';
+
+        if (number > 0x7fffffff || !file.getChar(&c))
+            return false;
+    }
+
+    // A single blank ends the number, after the maximum value it's the
+    // last byte of the header.
+    if (!isspace(c))
+        return false;
+
+    *value = int(number);
+
+    return true;
+}
+
+bool readPnmHeader(QFile &file, PnmHeader *header)
+{
+    char magic[2];
+
+    if (file.read(magic, 2) != 2
+        || magic[0] != 'P'
+        || (magic[1] != '5' && magic[1] != '6'))
+        return false;
+
+    header->type = magic[1];
+
+    return readPnmNumber(file, &header->width)
+           && readPnmNumber(file, &header->height)
+           && readPnmNumber(file, &header->maxValue)
+           && header->width > 0
+           && header->height > 0
+           && header->maxValue > 0
+           && header->maxValue < 65536;
+}
+
+// The 16 bits samples are stored in big endian.
+inline void swapSamples(uchar *data, qint64 bytes, DenoiseFormat format)
+{
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    if (format != DenoiseFormatGray16)
+        return;
+
+    for (qint64 i = 0; i + 1 < bytes; i += 2)
+        qSwap(data[i], data[i + 1]);
+#else
+    Q_UNUSED(data)
+    Q_UNUSED(bytes)
+    Q_UNUSED(format)
+#endif
+}
+
+// Keeps the method tuned for the whole image while the strips are
+// filtered.
+class TuningLock
+{
+    public:
+        TuningLock(DenoiseFilter *filter,
+                   const QSize &size,
+                   DenoiseFormat format):
+            filter(filter)
+        {
+            this->filter->lockTuning(size, format);
+        }
+
+        ~TuningLock()
+        {
+            this->filter->unlockTuning();
+        }
+
+    private:
+        DenoiseFilter *filter;
+};
+
+DenoiseStrips::DenoiseStrips(DenoiseFilter *filter):
+    stripHeight(256),
+    filter(filter),
+    totalTime(0),
+    peak(0)
+{
+}
+
+bool DenoiseStrips::parseArguments(const QStringList &arguments)
+{
+    bool strips = false;
+
+    for (int i = 1; i < arguments.size(); i++)
+        if (arguments[i] == "--strips") {
+            strips = true;
+            this->input = arguments.value(i + 1);
+            this->output = arguments.value(i + 2);
+            i += 2;
+        } else if (arguments[i] == "--strip-height") {
+            this->stripHeight = qMax(arguments.value(i + 1).toInt(), 1);
+            i++;
+        }
+
+    return strips;
+}
+
+bool DenoiseStrips::run()
+{
+    this->error.clear();
+    this->size = QSize();
+    this->totalTime = 0;
+    this->peak = 0;
+
+    QFile input(this->input);
+
+    if (!input.open(QIODevice::ReadOnly)) {
+        this->error = QString("Can't read %1").arg(this->input);
+
+        return false;
+    }
+
+    PnmHeader header;
+
+    if (!readPnmHeader(input, &header)) {
+        this->error = QString("%1 is not a binary PGM or PPM image")
+                      .arg(this->input);
+
+        return false;
+    }
+
+    DenoiseFormat format;
+
+    if (header.type == '6') {
+        if (header.maxValue > 255) {
+            this->error = "16 bits PPM images are not supported";
+
+            return false;
+        }
+
+        format = DenoiseFormatRGB888;
+    } else {
+        format = header.maxValue > 255?
+                     DenoiseFormatGray16: DenoiseFormatGray8;
+    }
+
+    QFile output(this->output);
+
+    if (!output.open(QIODevice::WriteOnly)) {
+        this->error = QString("Can't write %1").arg(this->output);
+
+        return false;
+    }
+
+    QByteArray outHeader = QString("P%1\n%2 %3\n%4\n")
+                           .arg(header.type)
+                           .arg(header.width)
+                           .arg(header.height)
+                           .arg(header.maxValue)
+                           .toLatin1();
+
+    if (output.write(outHeader) != outHeader.size()) {
+        this->error = QString("Can't write %1").arg(this->output);
+
+        return false;
+    }
+
+    int width = header.width;
+    int height = header.height;
+    int pixelBytes = format == DenoiseFormatRGB888? 3:
+                     format == DenoiseFormatGray16? 2: 1;
+    int lineBytes = width * pixelBytes;
+
+    // The strips are filtered with the method of the whole image, its
+    // border size is the halo.
+    TuningLock lock(this->filter, QSize(width, height), format);
+    int halo = qMax(this->filter->haloSize(format), 0);
+    int strip = qMax(this->stripHeight, 1);
+    int capacity = qMin(strip + 2 * halo, height);
+    QVector<uchar> inLines(lineBytes * capacity);
+    QVector<uchar> outLines(lineBytes * capacity);
+    uchar *in = inLines.data();
+    uchar *out = outLines.data();
+
+    // First line of the image in the buffer, and lines loaded.
+    int first = 0;
+    int loaded = 0;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int y = 0; y < height; y += strip) {
+        int top = qMax(y - halo, 0);
+        int bottom = qMin(y + strip + halo, height);
+
+        // Drop the lines above the halo of the strip, and read the lines
+        // below the loaded ones.
+        int drop = top - first;
+
+        if (drop > 0) {
+            loaded -= drop;
+            memmove(in, in + qptrdiff(drop) * lineBytes,
+                    size_t(loaded) * size_t(lineBytes));
+            first = top;
+        }
+
+        uchar *newLines = in + qptrdiff(loaded) * lineBytes;
+        qint64 bytes = qint64(bottom - first - loaded) * lineBytes;
+        DenoiseTraceScope stage("strips/read");
+
+        if (input.read(reinterpret_cast<char *>(newLines), bytes) != bytes) {
+            this->error = QString("%1 is truncated").arg(this->input);
+
+            return false;
+        }
+
+        swapSamples(newLines, bytes, format);
+        loaded = bottom - first;
+        stage.next(0);
+
+        if (!this->filter->process(DenoiseImage(in, width, loaded,
+                                                lineBytes, format),
+                                   DenoiseImage(out, width, loaded,
+                                                lineBytes, format))) {
+            this->error = "Can't filter the image";
+
+            return false;
+        }
+
+        // Write the lines of the strip.
+        uchar *lines = out + qptrdiff(y - first) * lineBytes;
+        bytes = qint64(qMin(y + strip, height) - y) * lineBytes;
+        swapSamples(lines, bytes, format);
+        stage.next("strips/write");
+
+        if (output.write(reinterpret_cast<const char *>(lines), bytes)
+            != bytes) {
+            this->error = QString("Can't write %1").arg(this->output);
+
+            return false;
+        }
+
+        this->peak = qMax(this->peak,
+                          2 * qint64(lineBytes) * capacity
+                          + this->filter->bufferSize());
+    }
+
+    this->totalTime = timer.nsecsElapsed();
+    this->size = QSize(width, height);
+
+    return true;
+}
+
+QString DenoiseStrips::errorString() const
+{
+    return this->error;
+}
+
+QSize DenoiseStrips::imageSize() const
+{
+    return this->size;
+}
+
+qreal DenoiseStrips::megapixelsPerSecond() const
+{
+    return this->totalTime > 0?
+               1e3 * this->size.width() * this->size.height()
+               / this->totalTime: 0;
+}
+
+qint64 DenoiseStrips::peakMemory() const
+{
+    return this->peak;
+}
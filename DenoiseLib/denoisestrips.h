@@ -0,0 +1,82 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#ifndef DENOISESTRIPS_H
+#define DENOISESTRIPS_H
+
+#include <QSize>
+#include <QString>
+#include <QStringList>
+
+class DenoiseFilter;
+
+// Filter an image too big for the memory in horizontal strips.
+//
+// The image is read from a binary PGM or PPM file a strip at a time, each
+// strip is filtered along with the halo lines above and below it that its
+// windows read, and the filtered lines are written before reading the next
+// strip. Only stripHeight + 2 * halo lines are kept in memory, the memory
+// depends on the width of the image and the radius of the filter, not on
+// the height of the image. The working buffers of the filter, like the
+// integral images of the mean filter, also cover a single strip.
+//
+// The filter is tuned once for the whole image, and the halo is its
+// haloSize(), so the output is the same as filtering the whole image,
+// except for the recursive gauss, that cuts its response at 3 sigma.
+class DenoiseStrips
+{
+    public:
+        explicit DenoiseStrips(DenoiseFilter *filter);
+
+        // 8 bits PPM, 8 or 16 bits PGM.
+        QString input;
+        QString output;
+
+        // Lines filtered at once. Bigger strips filter less halo lines
+        // again, smaller strips use less memory.
+        int stripHeight;
+
+        // Read the strips options, "--strips INPUT OUTPUT" enables the strips
+        // mode, and "--strip-height N" sets the lines of each strip.
+        // Returns true if the strips mode was requested.
+        bool parseArguments(const QStringList &arguments);
+
+        // Filter the image. Returns false on error.
+        bool run();
+
+        QString errorString() const;
+
+        // Statistics of the last run.
+        QSize imageSize() const;
+        qreal megapixelsPerSecond() const;
+
+        // Memory of the strip buffers plus the working buffers of the
+        // filter, in bytes.
+        qint64 peakMemory() const;
+
+    private:
+        DenoiseFilter *filter;
+        QString error;
+        QSize size;
+        qint64 totalTime;
+        qint64 peak;
+};
+
+#endif // DENOISESTRIPS_H
@@ -0,0 +1,472 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <QDebug>
+#include <QFile>
+
+#ifdef Q_OS_LINUX
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "denoisetrace.h"
+
+// Events buffered by each thread before writing them to the file.
+static const int traceBufferEvents = 4096;
+
+// Events recorded by a thread, only the thread appends them.
+class TraceThread
+{
+    public:
+        explicit TraceThread(int index):
+            index(index),
+            stage(0),
+            countersOpened(false)
+        {
+            for (int i = 0; i < DenoiseTraceCounterCount; i++)
+                this->counters[i] = -1;
+        }
+
+        ~TraceThread()
+        {
+#ifdef Q_OS_LINUX
+            for (int i = 0; i < DenoiseTraceCounterCount; i++)
+                if (this->counters[i] >= 0)
+                    close(this->counters[i]);
+#endif
+        }
+
+        int index;
+        QVector<DenoiseTraceEvent> events;
+        const char *stage;
+
+        // Locks the events against the other threads, that clear and read
+        // them.
+        QMutex mutex;
+
+        // Read the counters of the thread, returns false if they are not
+        // available.
+        bool readCounters(qint64 *values)
+        {
+#ifdef Q_OS_LINUX
+            if (!this->countersOpened)
+                this->openCounters();
+
+            if (this->counters[0] < 0)
+                return false;
+
+            // The whole group is read at once.
+            struct
+            {
+                quint64 count;
+                quint64 values[DenoiseTraceCounterCount];
+            } group;
+
+            if (read(this->counters[0], &group, sizeof(group))
+                != ssize_t(sizeof(group))
+                || group.count != DenoiseTraceCounterCount)
+                return false;
+
+            for (int i = 0; i < DenoiseTraceCounterCount; i++)
+                values[i] = qint64(group.values[i]);
+
+            return true;
+#else
+            Q_UNUSED(values)
+
+            return false;
+#endif
+        }
+
+    private:
+        // perf_event_open() descriptors, the first one leads the group.
+        int counters[DenoiseTraceCounterCount];
+        bool countersOpened;
+
+#ifdef Q_OS_LINUX
+        static int openCounter(quint64 config, int group)
+        {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = config;
+            attr.read_format = PERF_FORMAT_GROUP;
+
+            // Only the user space, as allowed by the default paranoid level.
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+
+            // Count the calling thread in any CPU.
+            return int(syscall(__NR_perf_event_open, &attr, 0, -1, group, 0));
+        }
+
+        void openCounters()
+        {
+            static const quint64 configs[DenoiseTraceCounterCount] = {
+                PERF_COUNT_HW_CPU_CYCLES,
+                PERF_COUNT_HW_INSTRUCTIONS,
+                PERF_COUNT_HW_CACHE_MISSES
+            };
+
+            this->countersOpened = true;
+
+            for (int i = 0; i < DenoiseTraceCounterCount; i++) {
+                this->counters[i] = openCounter(configs[i],
+                                                i > 0? this->counters[0]: -1);
+
+                if (this->counters[i] >= 0)
+                    continue;
+
+                // All the counters or none.
+                for (int j = 0; j < i; j++) {
+                    close(this->counters[j]);
+                    this->counters[j] = -1;
+                }
+
+                break;
+            }
+        }
+#endif
+};
+
+// Buffer of the calling thread in the global trace.
+static thread_local TraceThread *currentThread = 0;
+
+inline void sortEvents(QVector<DenoiseTraceEvent> &events)
+{
+    std::stable_sort(events.begin(), events.end(),
+                     [] (const DenoiseTraceEvent &a,
+                         const DenoiseTraceEvent &b) {
+        return a.start < b.start;
+    });
+}
+
+QAtomicInt DenoiseTrace::recording;
+
+DenoiseTrace::DenoiseTrace():
+    counters(false),
+    countersFailed(false),
+    csv(false)
+{
+}
+
+DenoiseTrace *DenoiseTrace::globalInstance()
+{
+    static DenoiseTrace trace;
+
+    return &trace;
+}
+
+DenoiseTrace::~DenoiseTrace()
+{
+    this->stop();
+
+    if (!this->fileName.isEmpty() && !this->save())
+        qWarning() << qPrintable(this->error);
+
+    qDeleteAll(this->threads);
+}
+
+bool DenoiseTrace::parseArguments(const QStringList &arguments)
+{
+    bool trace = false;
+
+    for (int i = 1; i < arguments.size(); i++)
+        if (arguments[i] == "--trace") {
+            // A missing file name is reported when saving.
+            this->fileName = arguments.value(i + 1);
+            trace = true;
+            i++;
+        } else if (arguments[i] == "--trace-counters") {
+            this->counters = true;
+        }
+
+    return trace;
+}
+
+void DenoiseTrace::start()
+{
+    QMutexLocker locker(&this->mutex);
+
+    for (TraceThread *thread: this->threads) {
+        QMutexLocker threadLocker(&thread->mutex);
+        thread->events.clear();
+    }
+
+    this->countersFailed = false;
+
+    if (!this->fileName.isEmpty())
+        this->open();
+
+    this->timer.start();
+    DenoiseTrace::recording.store(1);
+}
+
+void DenoiseTrace::stop()
+{
+    DenoiseTrace::recording.store(0);
+}
+
+const char *DenoiseTrace::currentStage()
+{
+    return currentThread? currentThread->stage: 0;
+}
+
+bool DenoiseTrace::hasCounters() const
+{
+    QMutexLocker locker(&this->mutex);
+
+    return this->counters && !this->countersFailed;
+}
+
+QVector<DenoiseTraceEvent> DenoiseTrace::events() const
+{
+    QMutexLocker locker(&this->mutex);
+    QVector<DenoiseTraceEvent> events;
+
+    for (TraceThread *thread: this->threads) {
+        QMutexLocker threadLocker(&thread->mutex);
+        events += thread->events;
+    }
+
+    sortEvents(events);
+
+    return events;
+}
+
+bool DenoiseTrace::save()
+{
+    QMutexLocker locker(&this->mutex);
+    QVector<DenoiseTraceEvent> events;
+
+    for (TraceThread *thread: this->threads) {
+        QMutexLocker threadLocker(&thread->mutex);
+        events += thread->events;
+        thread->events.clear();
+    }
+
+    sortEvents(events);
+
+    // The trace was not started, or a block couldn't be written.
+    if (!this->file.isOpen()
+        && (!this->error.isEmpty() || !this->open()))
+        return false;
+
+    QString text = this->format(events);
+
+    // Names of the threads, the metadata events close the list without a
+    // trailing comma.
+    if (!this->csv) {
+        int threads = this->threads.size();
+
+        for (int i = 0; i < threads; i++)
+            text += QString("{\"name\": \"thread_name\", \"ph\": \"M\","
+                            " \"pid\": 1, \"tid\": %1,"
+                            " \"args\": {\"name\": \"Thread %2\"}}%3\n")
+                    .arg(i)
+                    .arg(i)
+                    .arg(i + 1 < threads? ",": "");
+
+        text += "]}\n";
+    }
+
+    bool ok = this->write(text);
+    this->file.close();
+
+    return ok;
+}
+
+QString DenoiseTrace::errorString() const
+{
+    return this->error;
+}
+
+TraceThread *DenoiseTrace::thread()
+{
+    if (!currentThread) {
+        QMutexLocker locker(&this->mutex);
+        currentThread = new TraceThread(this->threads.size());
+        this->threads << currentThread;
+    }
+
+    return currentThread;
+}
+
+// Write the header of the file, the mutex must be locked.
+bool DenoiseTrace::open()
+{
+    this->file.close();
+    this->file.setFileName(this->fileName);
+    this->csv = this->fileName.endsWith(".csv", Qt::CaseInsensitive);
+    this->error.clear();
+
+    if (!this->file.open(QIODevice::WriteOnly)) {
+        this->error = QString("Can't write the trace to %1")
+                      .arg(this->fileName);
+
+        return false;
+    }
+
+    if (this->csv)
+        return this->write("stage,thread,start_us,duration_us,"
+                           "cycles,instructions,llc_misses\n");
+
+    return this->write("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+}
+
+// Write the buffer of a thread to the file. The events are dropped if the
+// file can't be written, so the buffer doesn't grow past
+// traceBufferEvents.
+void DenoiseTrace::flush(TraceThread *thread)
+{
+    QVector<DenoiseTraceEvent> events;
+
+    {
+        QMutexLocker threadLocker(&thread->mutex);
+        events = thread->events;
+        thread->events.clear();
+    }
+
+    sortEvents(events);
+    QMutexLocker locker(&this->mutex);
+    this->write(this->format(events));
+}
+
+// The events as lines of the CSV, or as complete events ("X") of the Chrome
+// trace, with the times in microseconds.
+QString DenoiseTrace::format(const QVector<DenoiseTraceEvent> &events) const
+{
+    QString text;
+
+    for (const DenoiseTraceEvent &event: events) {
+        if (this->csv) {
+            text += QString("%1,%2,%3,%4")
+                    .arg(QString(event.name))
+                    .arg(event.thread)
+                    .arg(QString::number(1e-3 * event.start, 'f', 3))
+                    .arg(QString::number(1e-3 * event.duration, 'f', 3));
+
+            // The counters are left empty if they were not collected.
+            for (int i = 0; i < DenoiseTraceCounterCount; i++)
+                text += event.counters[i] >= 0?
+                            QString(",%1").arg(event.counters[i]):
+                            QString(",");
+
+            text += "\n";
+
+            continue;
+        }
+
+        text += QString("{\"name\": \"%1\", \"cat\": \"denoise\","
+                        " \"ph\": \"X\", \"pid\": 1, \"tid\": %2,"
+                        " \"ts\": %3, \"dur\": %4")
+                .arg(QString(event.name))
+                .arg(event.thread)
+                .arg(QString::number(1e-3 * event.start, 'f', 3))
+                .arg(QString::number(1e-3 * event.duration, 'f', 3));
+
+        if (event.counters[0] >= 0)
+            text += QString(", \"args\": {\"cycles\": %1,"
+                            " \"instructions\": %2, \"llcMisses\": %3}")
+                    .arg(event.counters[DenoiseTraceCycles])
+                    .arg(event.counters[DenoiseTraceInstructions])
+                    .arg(event.counters[DenoiseTraceCacheMisses]);
+
+        text += "},\n";
+    }
+
+    return text;
+}
+
+// Append to the file, the mutex must be locked. The file is closed if it
+// fails.
+bool DenoiseTrace::write(const QString &text)
+{
+    if (!this->file.isOpen())
+        return false;
+
+    QByteArray data = text.toLocal8Bit();
+
+    if (this->file.write(data) != data.size()) {
+        this->error = QString("Can't write the trace to %1")
+                      .arg(this->fileName);
+        this->file.close();
+
+        return false;
+    }
+
+    return true;
+}
+
+void DenoiseTraceScope::begin(const char *name)
+{
+    DenoiseTrace *trace = DenoiseTrace::globalInstance();
+    this->thread = trace->thread();
+    this->name = name;
+    this->parent = this->thread->stage;
+    this->thread->stage = name;
+
+    if (!trace->counters || !this->thread->readCounters(this->counters)) {
+        for (int i = 0; i < DenoiseTraceCounterCount; i++)
+            this->counters[i] = -1;
+
+        if (trace->counters) {
+            QMutexLocker locker(&trace->mutex);
+            trace->countersFailed = true;
+        }
+    }
+
+    // The counters are read first, so the time doesn't include the system
+    // call.
+    this->start = trace->timer.nsecsElapsed();
+}
+
+void DenoiseTraceScope::end()
+{
+    DenoiseTrace *trace = DenoiseTrace::globalInstance();
+    qint64 end = trace->timer.nsecsElapsed();
+    DenoiseTraceEvent event;
+    event.name = this->name;
+    event.thread = this->thread->index;
+    event.start = this->start;
+    event.duration = end - this->start;
+    qint64 counters[DenoiseTraceCounterCount];
+    bool hasCounters = this->counters[0] >= 0
+                       && this->thread->readCounters(counters);
+
+    for (int i = 0; i < DenoiseTraceCounterCount; i++)
+        event.counters[i] = hasCounters? counters[i] - this->counters[i]: -1;
+
+    this->thread->mutex.lock();
+    this->thread->events << event;
+    bool full = this->thread->events.size() >= traceBufferEvents;
+    this->thread->mutex.unlock();
+
+    // Without a file the events are kept until events() is called.
+    if (full && !trace->fileName.isEmpty())
+        trace->flush(this->thread);
+
+    this->thread->stage = this->parent;
+    this->thread = 0;
+}
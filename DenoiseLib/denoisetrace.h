@@ -0,0 +1,176 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#ifndef DENOISETRACE_H
+#define DENOISETRACE_H
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class TraceThread;
+
+// Hardware counters of a stage.
+enum DenoiseTraceCounter
+{
+    DenoiseTraceCycles,
+    DenoiseTraceInstructions,
+    DenoiseTraceCacheMisses,
+    DenoiseTraceCounterCount
+};
+
+// A stage run by a thread. The times are in nanoseconds since the trace
+// started, and the counters are -1 if they were not collected.
+struct DenoiseTraceEvent
+{
+    const char *name;
+    int thread;
+    qint64 start;
+    qint64 duration;
+    qint64 counters[DenoiseTraceCounterCount];
+};
+
+// Time spent in each stage of the tools and the filters, by thread.
+//
+// The stages are marked with DenoiseTraceScope, that only checks a flag
+// while the trace is not recording. Each thread records its events in its
+// own buffer, that is written to the file when it's full, so the memory
+// used by the trace doesn't grow with the running time. The events left in
+// the buffers are written when the trace is saved. The workers of the tile scheduler record their share of the work with the
+// name of the stage that started it, so the trace shows how busy each
+// thread was.
+//
+// On Linux, the cycles, instructions and last level cache misses of each
+// stage can also be read with perf_event_open(), if the kernel allows it
+// (see /proc/sys/kernel/perf_event_paranoid).
+class DenoiseTrace
+{
+    public:
+        // The process has a single trace.
+        static DenoiseTrace *globalInstance();
+
+        ~DenoiseTrace();
+
+        // The trace is written here while recording and finished when the
+        // process ends, as CSV if the name ends in ".csv", and as a Chrome
+        // trace otherwise, that can be opened in chrome://tracing or
+        // Perfetto. The events are only sorted by time inside each block
+        // written. Without a file name the events are kept in memory.
+        QString fileName;
+
+        // Read the hardware counters, it costs a system call at the start
+        // and the end of each stage.
+        bool counters;
+
+        // Read the trace options, "--trace FILE" records the trace, and
+        // "--trace-counters" adds the hardware counters. Returns true if
+        // the trace was requested.
+        bool parseArguments(const QStringList &arguments);
+
+        // Start recording, the previous events are discarded and the file
+        // is written again from the start.
+        void start();
+        void stop();
+
+        static inline bool isRecording()
+        {
+            return DenoiseTrace::recording.load() != 0;
+        }
+
+        // Innermost stage of the calling thread, or 0.
+        static const char *currentStage();
+
+        // Returns true if the hardware counters could be read.
+        bool hasCounters() const;
+
+        // The events recorded and not written to the file yet, sorted by
+        // start time.
+        QVector<DenoiseTraceEvent> events() const;
+
+        // Write the events left in the buffers and finish the file.
+        bool save();
+        QString errorString() const;
+
+    private:
+        static QAtomicInt recording;
+        mutable QMutex mutex;
+        QVector<TraceThread *> threads;
+        QElapsedTimer timer;
+        bool countersFailed;
+        QFile file;
+        bool csv;
+        QString error;
+
+        DenoiseTrace();
+        TraceThread *thread();
+        bool open();
+        void flush(TraceThread *thread);
+        QString format(const QVector<DenoiseTraceEvent> &events) const;
+        bool write(const QString &text);
+
+        friend class DenoiseTraceScope;
+};
+
+// Records the time between its construction and its destruction as the
+// stage name, that must be a string literal.
+class DenoiseTraceScope
+{
+    public:
+        inline explicit DenoiseTraceScope(const char *name):
+            thread(0)
+        {
+            if (name && DenoiseTrace::isRecording())
+                this->begin(name);
+        }
+
+        inline ~DenoiseTraceScope()
+        {
+            if (this->thread)
+                this->end();
+        }
+
+        // End the stage and start the next one, if name is not 0.
+        inline void next(const char *name)
+        {
+            if (this->thread)
+                this->end();
+
+            if (name && DenoiseTrace::isRecording())
+                this->begin(name);
+        }
+
+    private:
+        TraceThread *thread;
+        const char *name;
+        const char *parent;
+        qint64 start;
+        qint64 counters[DenoiseTraceCounterCount];
+
+        void begin(const char *name);
+        void end();
+
+        Q_DISABLE_COPY(DenoiseTraceScope)
+};
+
+#endif // DENOISETRACE_H
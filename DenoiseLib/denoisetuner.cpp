@@ -0,0 +1,391 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSize>
+#include <QStringList>
+
+#include "denoisetuner.h"
+#include "gaussfilter.h"
+#include "meanfilter.h"
+#include "medianfilter.h"
+#include "tilescheduler.h"
+
+// Sizes of the channels the methods are timed with, the small one gives the
+// fixed cost of each call. The windows clipped by the borders are slower in
+// some methods, the big size keeps them a small part of the time per pixel.
+static const int tunerSmallSize = 64;
+static const int tunerBigSize = 384;
+static const int tunerRepeats = 2;
+
+// A method of a filter and the radius it's timed with, the first one is
+// also timed with the small channel.
+struct TunerMethod
+{
+    const char *method;
+    DenoiseGrowth growth;
+    int radius[denoiseTunerRadius];
+    DenoiseFilter *(*create)(TileScheduler *scheduler, int radius);
+};
+
+static const TunerMethod tunerMethods[] = {
+    {"gauss/separable", DenoiseGrowthLinear, {1, 4, 8},
+     [] (TileScheduler *scheduler, int radius) -> DenoiseFilter * {
+         GaussFilter *filter = new GaussFilter(scheduler);
+         filter->radius = radius;
+         filter->sigma = radius;
+         filter->method = GaussMethodSeparable;
+
+         return filter;
+     }},
+    {"gauss/recursive", DenoiseGrowthConstant, {1, 4, 8},
+     [] (TileScheduler *scheduler, int radius) -> DenoiseFilter * {
+         GaussFilter *filter = new GaussFilter(scheduler);
+         filter->radius = radius;
+         filter->sigma = radius;
+         filter->method = GaussMethodRecursive;
+
+         return filter;
+     }},
+    {"gauss/fixedpoint", DenoiseGrowthLinear, {1, 4, 8},
+     [] (TileScheduler *scheduler, int radius) -> DenoiseFilter * {
+         GaussFilter *filter = new GaussFilter(scheduler);
+         filter->radius = radius;
+         filter->sigma = radius;
+         filter->method = GaussMethodFixedPoint;
+
+         return filter;
+     }},
+    {"gauss/box", DenoiseGrowthConstant, {1, 4, 8},
+     [] (TileScheduler *scheduler, int radius) -> DenoiseFilter * {
+         GaussFilter *filter = new GaussFilter(scheduler);
+         filter->radius = radius;
+         filter->sigma = radius;
+         filter->method = GaussMethodBox;
+
+         return filter;
+     }},
+    {"mean/direct", DenoiseGrowthQuadratic, {1, 2, 3},
+     [] (TileScheduler *scheduler, int radius) -> DenoiseFilter * {
+         MeanFilter *filter = new MeanFilter(scheduler);
+         filter->radius = radius;
+         filter->method = MeanMethodDirect;
+
+         return filter;
+     }},
+    {"mean/histogram", DenoiseGrowthLinear, {1, 2, 4},
+     [] (TileScheduler *scheduler, int radius) -> DenoiseFilter * {
+         MeanFilter *filter = new MeanFilter(scheduler);
+         filter->radius = radius;
+         filter->method = MeanMethodHistogram;
+
+         return filter;
+     }},
+    {"mean/float", DenoiseGrowthQuadratic, {1, 2, 3},
+     [] (TileScheduler *scheduler, int radius) -> DenoiseFilter * {
+         MeanFilter *filter = new MeanFilter(scheduler);
+         filter->radius = radius;
+         filter->method = MeanMethodFloat;
+
+         return filter;
+     }},
+    {"median/sort", DenoiseGrowthQuadratic, {1, 2, 3},
+     [] (TileScheduler *scheduler, int radius) -> DenoiseFilter * {
+         MedianFilter *filter = new MedianFilter(scheduler);
+         filter->radius = radius;
+         filter->method = MedianMethodSort;
+
+         return filter;
+     }},
+    {"median/network", DenoiseGrowthLinear, {1, 2, 3},
+     [] (TileScheduler *scheduler, int radius) -> DenoiseFilter * {
+         MedianFilter *filter = new MedianFilter(scheduler);
+         filter->radius = radius;
+         filter->method = MedianMethodNetwork;
+
+         return filter;
+     }},
+    {"median/histogram", DenoiseGrowthLinear, {1, 4, 8},
+     [] (TileScheduler *scheduler, int radius) -> DenoiseFilter * {
+         MedianFilter *filter = new MedianFilter(scheduler);
+         filter->radius = radius;
+         filter->method = MedianMethodHistogram;
+
+         return filter;
+     }}
+};
+
+// Factor of the cost per pixel that depends on the radius.
+inline qreal growthFactor(DenoiseGrowth growth, int radius)
+{
+    int kw = 2 * radius + 1;
+
+    switch (growth) {
+    case DenoiseGrowthLinear:
+        return kw;
+    case DenoiseGrowthQuadratic:
+        return kw * kw;
+    default:
+        return 0;
+    }
+}
+
+// Minimum time, in nanoseconds, of filtering the channel, after a first call
+// that allocates the buffers of the filter.
+qreal filterTime(DenoiseFilter *filter, const DenoiseImage &in,
+                 const DenoiseImage &out)
+{
+    filter->process(in, out);
+    qint64 best = -1;
+
+    for (int i = 0; i < tunerRepeats; i++) {
+        QElapsedTimer timer;
+        timer.start();
+        filter->process(in, out);
+        qint64 time = timer.nsecsElapsed();
+
+        if (best < 0 || time < best)
+            best = time;
+    }
+
+    return best;
+}
+
+DenoiseTuner::DenoiseTuner(TileScheduler *scheduler):
+    maxError(1),
+    scheduler(scheduler? scheduler: TileScheduler::globalInstance())
+{
+}
+
+bool DenoiseTuner::parseArguments(const QStringList &arguments)
+{
+    bool tune = false;
+
+    for (int i = 1; i < arguments.size(); i++)
+        if (arguments[i] == "--tune") {
+            // Without a file the costs are measured on each run.
+            this->cacheFile = arguments.value(i + 1);
+            tune = true;
+            i++;
+        }
+
+    return tune;
+}
+
+bool DenoiseTuner::calibrate()
+{
+    if (this->load())
+        return true;
+
+    this->measure();
+
+    if (!this->cacheFile.isEmpty())
+        this->save();
+
+    return this->isCalibrated();
+}
+
+bool DenoiseTuner::isCalibrated() const
+{
+    return !this->costs.isEmpty();
+}
+
+qreal DenoiseTuner::cost(const QString &method,
+                         int radius,
+                         const QSize &size) const
+{
+    for (const DenoiseCost &cost: this->costs) {
+        if (cost.method != method)
+            continue;
+
+        qreal pixel = 0;
+
+        if (cost.growth == DenoiseGrowthConstant) {
+            // The measures only differ by the noise of the timer.
+            for (int i = 0; i < denoiseTunerRadius; i++)
+                pixel += cost.pixel[i] / denoiseTunerRadius;
+        } else if (radius <= cost.radius[0]) {
+            pixel = cost.pixel[0];
+        } else {
+            // Interpolate between the two measured radius around radius, or
+            // extrapolate from the last two.
+            int i = 1;
+
+            while (i < denoiseTunerRadius - 1 && cost.radius[i] < radius)
+                i++;
+
+            qreal g0 = growthFactor(cost.growth, cost.radius[i - 1]);
+            qreal g1 = growthFactor(cost.growth, cost.radius[i]);
+            qreal slope = qMax((cost.pixel[i] - cost.pixel[i - 1])
+                               / (g1 - g0), qreal(0));
+            pixel = cost.pixel[i - 1]
+                    + slope * (growthFactor(cost.growth, radius) - g0);
+        }
+
+        return cost.fixed + qreal(size.width()) * size.height() * pixel;
+    }
+
+    return -1;
+}
+
+bool DenoiseTuner::load()
+{
+    if (this->cacheFile.isEmpty())
+        return false;
+
+    QFile file(this->cacheFile);
+
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    // The first line has the number of threads the model was measured with,
+    // and each of the next lines a method:
+    //
+    //     method growth fixed radius0 pixel0 radius1 pixel1 radius2 pixel2
+    QStringList header = QString::fromLocal8Bit(file.readLine()).trimmed()
+                                                                .split(' ');
+
+    if (header.size() != 2
+        || header[0] != "threads"
+        || header[1].toInt() != this->scheduler->threadCount())
+        return false;
+
+    QVector<DenoiseCost> costs;
+
+    while (!file.atEnd()) {
+        QStringList fields = QString::fromLocal8Bit(file.readLine()).trimmed()
+                                                                    .split(' ');
+
+        if (fields.size() != 3 + 2 * denoiseTunerRadius)
+            return false;
+
+        DenoiseCost cost;
+        int growth = fields[1].toInt();
+
+        if (growth < DenoiseGrowthConstant || growth > DenoiseGrowthQuadratic)
+            return false;
+
+        cost.method = fields[0];
+        cost.growth = DenoiseGrowth(growth);
+        cost.fixed = fields[2].toDouble();
+
+        for (int i = 0; i < denoiseTunerRadius; i++) {
+            cost.radius[i] = fields[3 + 2 * i].toInt();
+            cost.pixel[i] = fields[4 + 2 * i].toDouble();
+        }
+
+        costs << cost;
+    }
+
+    // The cache is measured again if any method is missing.
+    if (costs.size() != int(sizeof(tunerMethods) / sizeof(TunerMethod)))
+        return false;
+
+    this->costs = costs;
+
+    return true;
+}
+
+bool DenoiseTuner::save() const
+{
+    QFile file(this->cacheFile);
+
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QString cache = QString("threads %1\n")
+                    .arg(this->scheduler->threadCount());
+
+    for (const DenoiseCost &cost: this->costs) {
+        cache += QString("%1 %2 %3")
+                 .arg(cost.method)
+                 .arg(int(cost.growth))
+                 .arg(cost.fixed);
+
+        for (int i = 0; i < denoiseTunerRadius; i++)
+            cache += QString(" %1 %2").arg(cost.radius[i]).arg(cost.pixel[i]);
+
+        cache += "\n";
+    }
+
+    QByteArray data = cache.toLocal8Bit();
+
+    return file.write(data) == data.size();
+}
+
+void DenoiseTuner::measure()
+{
+    // The synthetic channel is noise, the histogram and the sorting methods
+    // are slower with it than with smooth images, so the model is on the
+    // safe side for them.
+    QVector<uchar> input(tunerBigSize * tunerBigSize);
+    QVector<uchar> output(input.size());
+    quint32 state = 1;
+
+    for (uchar &pixel: input) {
+        state = 1664525 * state + 1013904223;
+        pixel = uchar(state >> 24);
+    }
+
+    qreal smallPixels = tunerSmallSize * tunerSmallSize;
+    qreal bigPixels = tunerBigSize * tunerBigSize;
+    DenoiseImage smallIn(input.constData(),
+                         tunerSmallSize, tunerSmallSize, tunerSmallSize,
+                         DenoiseFormatGray8);
+    DenoiseImage smallOut(output.data(),
+                          tunerSmallSize, tunerSmallSize, tunerSmallSize,
+                          DenoiseFormatGray8);
+    DenoiseImage bigIn(input.constData(),
+                       tunerBigSize, tunerBigSize, tunerBigSize,
+                       DenoiseFormatGray8);
+    DenoiseImage bigOut(output.data(),
+                        tunerBigSize, tunerBigSize, tunerBigSize,
+                        DenoiseFormatGray8);
+    this->costs.clear();
+
+    for (const TunerMethod &method: tunerMethods) {
+        DenoiseCost cost;
+        cost.method = method.method;
+        cost.growth = method.growth;
+        cost.fixed = 0;
+
+        for (int i = 0; i < denoiseTunerRadius; i++) {
+            DenoiseFilter *filter = method.create(this->scheduler,
+                                                  method.radius[i]);
+            qreal bigTime = filterTime(filter, bigIn, bigOut);
+
+            // The fixed cost is where the line of the time of both sizes
+            // crosses 0 pixels.
+            if (i == 0) {
+                qreal smallTime = filterTime(filter, smallIn, smallOut);
+                qreal slope = (bigTime - smallTime)
+                            / (bigPixels - smallPixels);
+                cost.fixed = qMax(smallTime - slope * smallPixels, qreal(0));
+            }
+
+            cost.radius[i] = method.radius[i];
+            cost.pixel[i] = qMax(bigTime - cost.fixed, qreal(0)) / bigPixels;
+            delete filter;
+        }
+
+        this->costs << cost;
+    }
+}
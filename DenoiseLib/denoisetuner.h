@@ -0,0 +1,112 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#ifndef DENOISETUNER_H
+#define DENOISETUNER_H
+
+#include <QString>
+#include <QVector>
+
+class QSize;
+class QStringList;
+class TileScheduler;
+
+// How the cost of a method grows with the radius.
+enum DenoiseGrowth
+{
+    DenoiseGrowthConstant,
+    // Proportional to the width of the window.
+    DenoiseGrowthLinear,
+    // Proportional to the area of the window.
+    DenoiseGrowthQuadratic
+};
+
+// Number of radius each method is timed with.
+static const int denoiseTunerRadius = 3;
+
+// Measured cost of a method, in nanoseconds.
+struct DenoiseCost
+{
+    QString method;
+    DenoiseGrowth growth;
+
+    // Cost of each call, and cost per pixel of each radius.
+    qreal fixed;
+    int radius[denoiseTunerRadius];
+    qreal pixel[denoiseTunerRadius];
+};
+
+// Cost model of the methods of the filters, measured on the host.
+//
+// Each method is timed filtering synthetic 8 bits channels of two sizes and
+// a few small radius. The cost of a channel is the fixed cost of a call
+// plus the cost per pixel of the radius, which is interpolated between the
+// measured radius, and extrapolated for the big ones, following the growth
+// of the method: constant, or proportional to the width or the area of the
+// window. The model is cached in a file, so the methods are measured once
+// for each host and thread count.
+//
+// A filter with a tuner picks, for each image, the cheapest of its methods
+// with an error below maxError. That also routes the degenerate kernels to
+// cheaper equivalents, like a gaussian with a sigma much bigger than its
+// radius, that is a box filter.
+class DenoiseTuner
+{
+    public:
+        // If scheduler is null the methods are timed with the global
+        // scheduler, it should be the one used by the filters.
+        explicit DenoiseTuner(TileScheduler *scheduler = 0);
+
+        // File where the cost model is cached, it's not cached if empty.
+        QString cacheFile;
+
+        // Maximum difference between an approximated method and the exact
+        // one, in 8 bits levels.
+        qreal maxError;
+
+        // Read the tuner options, "--tune FILE" sets the cache file.
+        // Returns true if the tuner was requested.
+        bool parseArguments(const QStringList &arguments);
+
+        // Load the cost model from the cache file, or measure it and save
+        // it if the file doesn't exists or it was measured with a different
+        // number of threads. Returns false if the methods can't be measured.
+        bool calibrate();
+
+        bool isCalibrated() const;
+
+        // Estimated time, in nanoseconds, to filter a channel of the given
+        // size. The methods are named like in the benchmark,
+        // "gauss/separable". Returns a negative value if the method was not
+        // calibrated.
+        qreal cost(const QString &method,
+                   int radius,
+                   const QSize &size) const;
+
+    private:
+        TileScheduler *scheduler;
+        QVector<DenoiseCost> costs;
+
+        bool load();
+        bool save() const;
+        void measure();
+};
+
+#endif // DENOISETUNER_H
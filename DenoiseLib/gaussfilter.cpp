@@ -0,0 +1,1259 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#include <cstring>
+#include <QtMath>
+
+#if defined(Q_PROCESSOR_X86) && defined(Q_CC_GNU)
+#include <immintrin.h>
+#define GAUSS_SIMD
+#endif
+
+#include "denoisetrace.h"
+#include "denoisetuner.h"
+#include "gaussfilter.h"
+#include "tilescheduler.h"
+
+enum SimdLevel
+{
+    SimdLevelNone,
+    SimdLevelSSE41,
+    SimdLevelAVX2
+};
+
+// The fixed point weights sums 1 << gaussWeightBits, and the output of the
+// horizontal pass keeps gaussFractionBits bits of precision.
+static const int gaussWeightBits = 14;
+static const int gaussFractionBits = 6;
+static const int gaussHorizontalShift = gaussWeightBits - gaussFractionBits;
+static const int gaussVerticalShift = gaussWeightBits + gaussFractionBits;
+
+// Write the 2 * radius + 1 weights of the kernel.
+inline void gaussKernel(int radius, qreal sigma, qreal *kernel)
+{
+    int kw = 2 * radius + 1;
+    qreal sum = 0;
+
+    /* Create convolution matrix according to the formula:
+     *
+     *                    1             (-((i - radius) ^ 2 + (y - radius) ^ 2))
+     * weight = -------------------- exp(--------------------------------------)
+     *          2 * M_PI * sigma ^ 2    (             2 * sigma ^ 2            )
+     *
+     * Since the weights are normalized, the term:
+     *
+     *
+     *                    1
+     * weight = --------------------
+     *          2 * M_PI * sigma ^ 2
+     *
+     * is not required here.
+     *
+     * The exponential can be split as:
+     *
+     *     (-(i - radius) ^ 2)     (-(j - radius) ^ 2)
+     * exp(-------------------)exp(-------------------)
+     *     (  2 * sigma ^ 2  )     (  2 * sigma ^ 2  )
+     *
+     * so the matrix is the product of a row and a column vector, and we only
+     * need to keep one of them.
+     */
+    for (int i = 0; i < kw; i++) {
+        int x = i - radius;
+        qreal sigma2 = -2 * sigma * sigma;
+        qreal weight = exp(x * x / sigma2);
+        kernel[i] = weight;
+        sum += weight;
+    }
+
+    // Normalize weights.
+    for (int i = 0; i < kw; i++)
+        kernel[i] /= sum;
+}
+
+// For every position in a line of the given length, calculate the inverse of
+// the sum of the weights that falls inside the line.
+inline void gaussNormalization(const qreal *kernel, int radius, int length,
+                               qreal *norm)
+{
+    for (int i = 0; i < length; i++) {
+        int kMin = qMax(radius - i, 0);
+        int kMax = qMin(radius + length - 1 - i, 2 * radius);
+        qreal sum = 0;
+
+        for (int k = kMin; k <= kMax; k++)
+            sum += kernel[k];
+
+        norm[i] = 1 / sum;
+    }
+}
+
+// Apply the kernel at the given position of the line, ignoring the weights
+// outside of it. The samples of the line are stride elements apart.
+template <typename T> inline qreal convolve(const T *line, int stride,
+                                            int pos,
+                                            int length,
+                                            const qreal *kernel,
+                                            int radius,
+                                            qreal norm)
+{
+    int kMin = qMax(radius - pos, 0);
+    int kMax = qMin(radius + length - 1 - pos, 2 * radius);
+    const T *pixel = line + (pos - radius) * stride;
+    qreal sum = 0;
+
+    for (int k = kMin; k <= kMax; k++)
+        sum += kernel[k] * pixel[k * stride];
+
+    sum *= norm;
+
+    return sum;
+}
+
+template <typename T>
+void gaussSeparable(const DenoiseTypedChannel<T> &in,
+                    const DenoiseTypedChannel<T> &out,
+                    const qreal *kernel,
+                    int radius,
+                    QVector<qreal> &transposed,
+                    ScratchArena &shared,
+                    TileScheduler &scheduler)
+{
+    int width = in.width;
+    int height = in.height;
+    QSize size(width, height);
+    qreal *normX = shared.allocate<qreal>(width);
+    qreal *normY = shared.allocate<qreal>(height);
+    gaussNormalization(kernel, radius, width, normX);
+    gaussNormalization(kernel, radius, height, normY);
+
+    // The intermediate image is stored transposed, that way both passes
+    // read the pixels sequentially.
+    transposed.resize(width * height);
+
+    // The workers only use raw pointers, QVector is not thread safe for non
+    // const access.
+    qreal *tPixels = transposed.data();
+
+    // Horizontal pass.
+    scheduler.runLines(size, 0, [&] (const Tile &tile, int) {
+        for (int y = tile.rect.top(); y <= tile.rect.bottom(); y++) {
+            const T *iLine = in.line(y);
+
+            for (int x = 0; x < width; x++)
+                tPixels[y + x * height] =
+                        convolve(iLine, in.pixelStride, x, width,
+                                 kernel, radius, normX[x]);
+        }
+    });
+
+    // Vertical pass.
+    scheduler.runColumns(size, 0, [&] (const Tile &tile, int) {
+        for (int x = tile.rect.left(); x <= tile.rect.right(); x++) {
+            const qreal *tLine = tPixels + x * height;
+
+            for (int y = 0; y < height; y++)
+                out.pixel(x, y) =
+                        DenoiseSampleTraits<T>::fromReal(convolve(tLine, 1,
+                                                                  y, height,
+                                                                  kernel,
+                                                                  radius,
+                                                                  normY[y]));
+        }
+    });
+}
+
+// Largest radius of the box filter with 32 bits sums for 8 bits samples,
+// 255 * (2 * radius + 1) ^ 2 fits in 31 bits.
+static const int gaussBoxMaxRadius32 = 1024;
+
+// Type of the sums of the box filter, exact for the integer samples. The 8
+// bits samples use 32 bits sums up to gaussBoxMaxRadius32, the conversion
+// to qreal is vectorized for them.
+template <typename T> struct BoxSum
+{
+    typedef qint64 Type;
+};
+
+template <> struct BoxSum<float>
+{
+    typedef qreal Type;
+};
+
+// Sum of the window clipped to the line, at every position of it. The sum
+// is updated moving the window one sample at a time, so the cost doesn't
+// depends on the radius. The samples of the line are stride elements apart.
+template <typename T, typename Sum>
+inline void boxLine(const T *src, int stride, int length, int radius,
+                    Sum *dst)
+{
+    Sum sum = 0;
+
+    for (int i = 0; i < qMin(radius, length); i++)
+        sum += src[i * stride];
+
+    for (int i = 0; i < length; i++) {
+        if (i + radius < length)
+            sum += src[(i + radius) * stride];
+
+        if (i - radius > 0)
+            sum -= src[(i - radius - 1) * stride];
+
+        dst[i] = sum;
+    }
+}
+
+// Box filter, it's the limit of the gaussian when sigma is much bigger than
+// the radius, and the windows are clipped the same way.
+template <typename T, typename Sum>
+void gaussBox(const DenoiseTypedChannel<T> &in,
+              const DenoiseTypedChannel<T> &out,
+              int radius,
+              ScratchArena &shared,
+              ScratchArena *arenas,
+              TileScheduler &scheduler)
+{
+    int width = in.width;
+    int height = in.height;
+    QSize size(width, height);
+
+    // Sums of the horizontal windows.
+    Sum *lineSums = shared.allocate<Sum>(width * height);
+
+    // The average of the integer samples is truncated, the same as the
+    // other methods, half a pixel is added to the sum so the product by
+    // the inverse of the window area gives the exact quotient.
+    qreal bias = DenoiseSampleTraits<T>::isInteger? 0.5: 0;
+
+    // Horizontal pass.
+    scheduler.runLines(size, 0, [&] (const Tile &tile, int) {
+        for (int y = tile.rect.top(); y <= tile.rect.bottom(); y++)
+            boxLine(in.line(y), in.pixelStride, width, radius,
+                    lineSums + y * width);
+    });
+
+    // Vertical pass, each worker keeps the sums of the columns of the
+    // window, moving it down one line at a time. The lines outside of the
+    // image are read as zeros.
+    scheduler.runLines(size, radius, [&] (const Tile &tile, int worker) {
+        ScratchArena &arena = arenas[worker];
+        arena.reset();
+        Sum *columns = arena.allocate<Sum>(width);
+        Sum *zeros = arena.allocate<Sum>(width);
+        qreal *norms = arena.allocate<qreal>(width);
+        int top = tile.rect.top();
+
+        for (int x = 0; x < width; x++) {
+            columns[x] = 0;
+            zeros[x] = 0;
+            norms[x] = qreal(1)
+                       / (qMin(x + radius, width - 1) - qMax(x - radius, 0) + 1);
+        }
+
+        // Sum of the window of the line above the band.
+        for (int y = qMax(top - radius - 1, 0);
+             y < qMin(top + radius, height);
+             y++) {
+            const Sum *line = lineSums + y * width;
+
+            for (int x = 0; x < width; x++)
+                columns[x] += line[x];
+        }
+
+        for (int y = top; y <= tile.rect.bottom(); y++) {
+            const Sum *next = y + radius < height?
+                                  lineSums + (y + radius) * width: zeros;
+            const Sum *previous = y - radius > 0?
+                                      lineSums + (y - radius - 1) * width:
+                                      zeros;
+            qreal norm = qreal(1)
+                         / (qMin(y + radius, height - 1) - qMax(y - radius, 0) + 1);
+            T *oLine = out.line(y);
+
+            for (int x = 0; x < width; x++) {
+                columns[x] += next[x] - previous[x];
+                oLine[x * out.pixelStride] =
+                        DenoiseSampleTraits<T>::fromReal((columns[x] + bias)
+                                                         * norms[x] * norm);
+            }
+        }
+    });
+}
+
+// Recursive approximation of the gaussian filter, as described in:
+//
+// I.T. Young, L.J. van Vliet, "Recursive implementation of the Gaussian
+// filter", Signal Processing 44 (1995) 139-151.
+//
+// The borders are initialized as if the line were extended with its first
+// and last pixels, following:
+//
+// B. Triggs, M. Sdika, "Boundary conditions for Young-van Vliet recursive
+// filtering", IEEE Transactions on Signal Processing 54 (2006) 2365-2367.
+class RecursiveGauss
+{
+    public:
+        RecursiveGauss(qreal sigma)
+        {
+            // The coefficients are only valid for sigma >= 0.5.
+            sigma = qMax(sigma, 0.5);
+            qreal q = sigma < 2.5?
+                          3.97156 - 4.14554 * sqrt(1 - 0.26891 * sigma):
+                          0.98711 * sigma - 0.96330;
+            qreal q2 = q * q;
+            qreal q3 = q2 * q;
+            qreal b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+
+            this->a[0] = (2.44413 * q + 2.85619 * q2 + 1.26661 * q3) / b0;
+            this->a[1] = -(1.4281 * q2 + 1.26661 * q3) / b0;
+            this->a[2] = 0.422205 * q3 / b0;
+            this->b = 1 - (this->a[0] + this->a[1] + this->a[2]);
+
+            qreal a1 = this->a[0];
+            qreal a2 = this->a[1];
+            qreal a3 = this->a[2];
+            qreal c = this->b / ((1 + a1 - a2 + a3)
+                                 * (1 - a1 - a2 - a3)
+                                 * (1 + a2 + (a1 - a3) * a3));
+
+            this->m[0][0] = c * (-a3 * a1 + 1 - a3 * a3 - a2);
+            this->m[0][1] = c * (a3 + a1) * (a2 + a3 * a1);
+            this->m[0][2] = c * a3 * (a1 + a3 * a2);
+            this->m[1][0] = c * (a1 + a3 * a2);
+            this->m[1][1] = c * (1 - a2) * (a2 + a3 * a1);
+            this->m[1][2] = c * a3 * (1 - a3 * a1 - a3 * a3 - a2);
+            this->m[2][0] = c * (a3 * a1 + a2 + a1 * a1 - a2 * a2);
+            this->m[2][1] = c * (a1 * a2 + a3 * a2 * a2 - a1 * a3 * a3
+                                 - a3 * a3 * a3 - a3 * a2 + a3);
+            this->m[2][2] = c * a3 * (a1 + a3 * a2);
+        }
+
+        // Filter the line in place, the cost per pixel doesn't depends on
+        // sigma.
+        void filter(qreal *line, int length) const
+        {
+            if (length < 1)
+                return;
+
+            // The anti-causal pass converges to the last input pixel, read
+            // it before the causal pass overwrites it.
+            qreal iPlus = line[length - 1];
+
+            // Causal pass.
+            qreal u1 = line[0];
+            qreal u2 = u1;
+            qreal u3 = u1;
+
+            for (int i = 0; i < length; i++) {
+                qreal u = this->b * line[i];
+                u += this->a[0] * u1;
+                u += this->a[1] * u2;
+                u += this->a[2] * u3;
+                u3 = u2;
+                u2 = u1;
+                u1 = u;
+                line[i] = u;
+            }
+
+            // The last three outputs of the causal pass, relative to the
+            // value it converges to.
+            qreal du[3];
+
+            for (int k = 0; k < 3; k++)
+                du[k] = line[qMax(length - 1 - k, 0)] - iPlus;
+
+            // Initial values of the anti-causal pass, v[n - 1], v[n], and
+            // v[n + 1].
+            qreal v[3];
+
+            for (int k = 0; k < 3; k++) {
+                v[k] = iPlus;
+                v[k] += this->m[k][0] * du[0];
+                v[k] += this->m[k][1] * du[1];
+                v[k] += this->m[k][2] * du[2];
+            }
+
+            // Anti-causal pass.
+            qreal v1 = v[0];
+            qreal v2 = v[1];
+            qreal v3 = v[2];
+            line[length - 1] = v1;
+
+            for (int i = length - 2; i >= 0; i--) {
+                qreal v = this->b * line[i];
+                v += this->a[0] * v1;
+                v += this->a[1] * v2;
+                v += this->a[2] * v3;
+                v3 = v2;
+                v2 = v1;
+                v1 = v;
+                line[i] = v;
+            }
+        }
+
+        qreal b;
+        qreal a[3];
+        qreal m[3][3];
+};
+
+template <typename T>
+void gaussRecursive(const DenoiseTypedChannel<T> &in,
+                    const DenoiseTypedChannel<T> &out,
+                    qreal sigma,
+                    QVector<qreal> &transposed,
+                    ScratchArena *arenas,
+                    TileScheduler &scheduler)
+{
+    int width = in.width;
+    int height = in.height;
+    QSize size(width, height);
+    RecursiveGauss gauss(sigma);
+    transposed.resize(width * height);
+    qreal *tPixels = transposed.data();
+
+    // Horizontal pass, each worker has its own line buffer.
+    scheduler.runLines(size, 0, [&] (const Tile &tile, int worker) {
+        ScratchArena &arena = arenas[worker];
+        arena.reset();
+        qreal *line = arena.allocate<qreal>(width);
+
+        for (int y = tile.rect.top(); y <= tile.rect.bottom(); y++) {
+            const T *iLine = in.line(y);
+
+            for (int x = 0; x < width; x++)
+                line[x] = iLine[x * in.pixelStride];
+
+            gauss.filter(line, width);
+
+            for (int x = 0; x < width; x++)
+                tPixels[y + x * height] = line[x];
+        }
+    });
+
+    // Vertical pass.
+    scheduler.runColumns(size, 0, [&] (const Tile &tile, int) {
+        for (int x = tile.rect.left(); x <= tile.rect.right(); x++) {
+            qreal *tLine = tPixels + x * height;
+            gauss.filter(tLine, height);
+
+            for (int y = 0; y < height; y++)
+                out.pixel(x, y) = DenoiseSampleTraits<T>::bound(tLine[y]);
+        }
+    });
+}
+
+// Calculate the maximum difference, in 8 bits levels, between the output of
+// the recursive filter and the exact kernel, away from the borders.
+//
+// The filter is applied to an impulse to get it's response, and the worst
+// case is given by the image that matches the sign of the difference of both
+// responses:
+//
+// error = 255 * sum(|recursive(i, j) - kernel(i, j)|)
+//
+// Both filters are separable so we calculate it as the sum of the products
+// of the 1D responses.
+qreal recursiveGaussError(const qreal *kernel, int radius, qreal sigma)
+{
+    // Use a line long enough to contain the tails of the recursive filter.
+    int responseRadius = qMax(radius, qCeil(6 * sigma));
+    int length = 2 * responseRadius + 1;
+    QVector<qreal> line(length, 0);
+    line[responseRadius] = 1;
+    RecursiveGauss(sigma).filter(line.data(), length);
+
+    QVector<qreal> exact(length, 0);
+
+    for (int i = 0; i < 2 * radius + 1; i++)
+        exact[responseRadius - radius + i] = kernel[i];
+
+    qreal error = 0;
+
+    for (int j = 0; j < length; j++)
+        for (int i = 0; i < length; i++)
+            error += qAbs(line[i] * line[j] - exact[i] * exact[j]);
+
+    return 255 * error;
+}
+
+// Calculate the maximum difference, in 8 bits levels, between the box
+// filter and the exact kernel, the same way as recursiveGaussError().
+qreal boxGaussError(const qreal *kernel, int radius)
+{
+    int kw = 2 * radius + 1;
+    qreal box = qreal(1) / (kw * kw);
+    qreal error = 0;
+
+    for (int j = 0; j < kw; j++)
+        for (int i = 0; i < kw; i++)
+            error += qAbs(kernel[i] * kernel[j] - box);
+
+    return 255 * error;
+}
+
+// Quantize the weights in the range [kMin, kMax], normalized to the sum of
+// them, so the fixed point weights sums exactly 1 << gaussWeightBits.
+inline void quantizeWeights(const qreal *weights,
+                            int kMin, int kMax,
+                            qint16 *fixed)
+{
+    qreal sum = 0;
+
+    for (int k = kMin; k <= kMax; k++)
+        sum += weights[k];
+
+    int fixedSum = 0;
+    int center = kMin;
+
+    for (int k = kMin; k <= kMax; k++) {
+        fixed[k] = qint16(qRound((1 << gaussWeightBits) * weights[k] / sum));
+        fixedSum += fixed[k];
+
+        if (weights[k] > weights[center])
+            center = k;
+    }
+
+    // Put the rounding error in the biggest weight.
+    fixed[center] += (1 << gaussWeightBits) - fixedSum;
+}
+
+// Fixed point version of the kernel for a line of the given length.
+// The positions close to the borders have their own renormalized weights,
+// same as gaussNormalization(). The weights are written to weights, that
+// must have room for weightsSize(radius) values.
+class FixedKernel
+{
+    public:
+        FixedKernel(const qreal *kernel, int radius, int length,
+                    qint16 *weights):
+            interior(weights),
+            border(weights + 2 * radius + 1),
+            radius(radius),
+            length(length)
+        {
+            int kw = 2 * radius + 1;
+            quantizeWeights(kernel, 0, kw - 1, this->interior);
+            memset(this->border, 0, size_t(2 * radius * kw) * sizeof(qint16));
+
+            for (int pos = 0; pos < length; pos++) {
+                int kMin;
+                int kMax;
+                this->range(pos, &kMin, &kMax);
+
+                if (kMin == 0 && kMax == kw - 1)
+                    continue;
+
+                quantizeWeights(kernel, kMin, kMax,
+                                this->border + this->slot(pos) * kw);
+            }
+        }
+
+        static inline int weightsSize(int radius)
+        {
+            return (2 * radius + 1) * (2 * radius + 1);
+        }
+
+        // Range of the kernel that falls inside the line.
+        inline void range(int pos, int *kMin, int *kMax) const
+        {
+            *kMin = qMax(this->radius - pos, 0);
+            *kMax = qMin(this->radius + this->length - 1 - pos,
+                         2 * this->radius);
+        }
+
+        inline bool isInterior(int pos) const
+        {
+            return pos >= this->radius && pos < this->length - this->radius;
+        }
+
+        // Weights for the given position, indexed from the start of the
+        // kernel.
+        inline const qint16 *weights(int pos) const
+        {
+            if (this->isInterior(pos))
+                return this->interior;
+
+            return this->border + this->slot(pos) * (2 * this->radius + 1);
+        }
+
+        qint16 *interior;
+        qint16 *border;
+        int radius;
+        int length;
+
+    private:
+        inline int slot(int pos) const
+        {
+            return pos < this->radius?
+                       pos: pos - this->length + 2 * this->radius;
+        }
+};
+
+// Horizontal pass, the output keeps gaussFractionBits of precision.
+inline void fixedConvolveH(const quint8 *src, qint16 *dst,
+                           int xMin, int xMax,
+                           const FixedKernel &kernel)
+{
+    for (int x = xMin; x < xMax; x++) {
+        int kMin;
+        int kMax;
+        kernel.range(x, &kMin, &kMax);
+        const qint16 *weights = kernel.weights(x);
+        const quint8 *pixel = src + x - kernel.radius;
+        qint32 sum = 0;
+
+        for (int k = kMin; k <= kMax; k++)
+            sum += weights[k] * pixel[k];
+
+        dst[x] = qint16((sum + (1 << (gaussHorizontalShift - 1)))
+                        >> gaussHorizontalShift);
+    }
+}
+
+// Vertical pass, lines are the taps lines of the window.
+inline void fixedConvolveV(const qint16 *const *lines,
+                           quint8 *dst,
+                           int xMin, int xMax,
+                           const qint16 *weights, int taps)
+{
+    for (int x = xMin; x < xMax; x++) {
+        qint32 sum = 0;
+
+        for (int k = 0; k < taps; k++)
+            sum += weights[k] * lines[k][x];
+
+        // Truncate the result, same as the floating point version does.
+        dst[x] = quint8(sum >> gaussVerticalShift);
+    }
+}
+
+#ifdef GAUSS_SIMD
+// The SIMD versions multiply two taps at once with madd, each 32 bits lane
+// holds the pixels of both taps, and the weights are packed the same way.
+inline qint32 weightsPair(const qint16 *weights, int k, int taps)
+{
+    return quint16(weights[k])
+           | (k + 1 < taps? qint32(weights[k + 1]) << 16: 0);
+}
+
+// Process the interior pixels in blocks, and return the first pixel that
+// was not processed.
+__attribute__((target("avx2")))
+int fixedConvolveHAVX2(const quint8 *src, qint16 *dst,
+                       int xMin, int xMax,
+                       const FixedKernel &kernel)
+{
+    int radius = kernel.radius;
+    int kw = 2 * radius + 1;
+    const qint16 *weights = kernel.interior;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i round = _mm256_set1_epi32(1 << (gaussHorizontalShift - 1));
+    int x = qMax(xMin, radius);
+    xMax = qMin(xMax, kernel.length - radius);
+
+    for (; x + 16 <= xMax; x += 16) {
+        const quint8 *pixel = src + x - radius;
+        __m256i sumLo = round;
+        __m256i sumHi = round;
+
+        for (int k = 0; k < kw; k += 2) {
+            __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (pixel + k)));
+            __m256i b = k + 1 < kw?
+                            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (pixel + k + 1))):
+                            zero;
+            __m256i w = _mm256_set1_epi32(weightsPair(weights, k, kw));
+            sumLo = _mm256_add_epi32(sumLo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w));
+            sumHi = _mm256_add_epi32(sumHi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w));
+        }
+
+        sumLo = _mm256_srai_epi32(sumLo, gaussHorizontalShift);
+        sumHi = _mm256_srai_epi32(sumHi, gaussHorizontalShift);
+        _mm256_storeu_si256((__m256i *) (dst + x), _mm256_packs_epi32(sumLo, sumHi));
+    }
+
+    return x;
+}
+
+__attribute__((target("avx2")))
+int fixedConvolveVAVX2(const qint16 *const *lines,
+                       quint8 *dst,
+                       int xMin, int xMax,
+                       const qint16 *weights, int taps)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    int x = xMin;
+
+    for (; x + 16 <= xMax; x += 16) {
+        __m256i sumLo = zero;
+        __m256i sumHi = zero;
+
+        for (int k = 0; k < taps; k += 2) {
+            __m256i a = _mm256_loadu_si256((const __m256i *) (lines[k] + x));
+            __m256i b = k + 1 < taps?
+                            _mm256_loadu_si256((const __m256i *) (lines[k + 1] + x)):
+                            zero;
+            __m256i w = _mm256_set1_epi32(weightsPair(weights, k, taps));
+            sumLo = _mm256_add_epi32(sumLo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w));
+            sumHi = _mm256_add_epi32(sumHi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w));
+        }
+
+        sumLo = _mm256_srai_epi32(sumLo, gaussVerticalShift);
+        sumHi = _mm256_srai_epi32(sumHi, gaussVerticalShift);
+        __m256i result = _mm256_packs_epi32(sumLo, sumHi);
+
+        // packus works on each 128 bits lane, move the 8 bytes of the high
+        // lane next to the low ones.
+        result = _mm256_packus_epi16(result, result);
+        result = _mm256_permute4x64_epi64(result, 0xd8);
+        _mm_storeu_si128((__m128i *) (dst + x), _mm256_castsi256_si128(result));
+    }
+
+    return x;
+}
+
+__attribute__((target("sse4.1")))
+int fixedConvolveHSSE41(const quint8 *src, qint16 *dst,
+                        int xMin, int xMax,
+                        const FixedKernel &kernel)
+{
+    int radius = kernel.radius;
+    int kw = 2 * radius + 1;
+    const qint16 *weights = kernel.interior;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(1 << (gaussHorizontalShift - 1));
+    int x = qMax(xMin, radius);
+    xMax = qMin(xMax, kernel.length - radius);
+
+    for (; x + 8 <= xMax; x += 8) {
+        const quint8 *pixel = src + x - radius;
+        __m128i sumLo = round;
+        __m128i sumHi = round;
+
+        for (int k = 0; k < kw; k += 2) {
+            __m128i a = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *) (pixel + k)));
+            __m128i b = k + 1 < kw?
+                            _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *) (pixel + k + 1))):
+                            zero;
+            __m128i w = _mm_set1_epi32(weightsPair(weights, k, kw));
+            sumLo = _mm_add_epi32(sumLo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+            sumHi = _mm_add_epi32(sumHi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+        }
+
+        sumLo = _mm_srai_epi32(sumLo, gaussHorizontalShift);
+        sumHi = _mm_srai_epi32(sumHi, gaussHorizontalShift);
+        _mm_storeu_si128((__m128i *) (dst + x), _mm_packs_epi32(sumLo, sumHi));
+    }
+
+    return x;
+}
+
+__attribute__((target("sse4.1")))
+int fixedConvolveVSSE41(const qint16 *const *lines,
+                        quint8 *dst,
+                        int xMin, int xMax,
+                        const qint16 *weights, int taps)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int x = xMin;
+
+    for (; x + 8 <= xMax; x += 8) {
+        __m128i sumLo = zero;
+        __m128i sumHi = zero;
+
+        for (int k = 0; k < taps; k += 2) {
+            __m128i a = _mm_loadu_si128((const __m128i *) (lines[k] + x));
+            __m128i b = k + 1 < taps?
+                            _mm_loadu_si128((const __m128i *) (lines[k + 1] + x)):
+                            zero;
+            __m128i w = _mm_set1_epi32(weightsPair(weights, k, taps));
+            sumLo = _mm_add_epi32(sumLo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+            sumHi = _mm_add_epi32(sumHi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+        }
+
+        sumLo = _mm_srai_epi32(sumLo, gaussVerticalShift);
+        sumHi = _mm_srai_epi32(sumHi, gaussVerticalShift);
+        __m128i result = _mm_packs_epi32(sumLo, sumHi);
+        _mm_storel_epi64((__m128i *) (dst + x), _mm_packus_epi16(result, result));
+    }
+
+    return x;
+}
+#endif
+
+inline SimdLevel simdLevel()
+{
+#ifdef GAUSS_SIMD
+    if (__builtin_cpu_supports("avx2"))
+        return SimdLevelAVX2;
+
+    if (__builtin_cpu_supports("sse4.1"))
+        return SimdLevelSSE41;
+#endif
+
+    return SimdLevelNone;
+}
+
+// Horizontal pass of a line of consecutive pixels.
+inline void fixedLineH(const quint8 *src, qint16 *dst, int width,
+                       const FixedKernel &kernel,
+                       SimdLevel simd)
+{
+    int x = 0;
+
+#ifdef GAUSS_SIMD
+    // Left border.
+    fixedConvolveH(src, dst, 0, qMin(kernel.radius, width), kernel);
+
+    if (simd == SimdLevelAVX2)
+        x = fixedConvolveHAVX2(src, dst, kernel.radius, width, kernel);
+    else if (simd == SimdLevelSSE41)
+        x = fixedConvolveHSSE41(src, dst, kernel.radius, width, kernel);
+#else
+    Q_UNUSED(simd)
+#endif
+
+    // Remaining pixels and right border.
+    fixedConvolveH(src, dst, x, width, kernel);
+}
+
+// Vertical pass of the line y, lines are the lines of the window clipped to
+// the image.
+inline void fixedLineV(const qint16 *const *lines, quint8 *dst,
+                       int width, int y,
+                       const FixedKernel &kernel,
+                       SimdLevel simd)
+{
+    int kMin;
+    int kMax;
+    kernel.range(y, &kMin, &kMax);
+    const qint16 *weights = kernel.weights(y) + kMin;
+    int taps = kMax - kMin + 1;
+    int x = 0;
+
+#ifdef GAUSS_SIMD
+    if (simd == SimdLevelAVX2)
+        x = fixedConvolveVAVX2(lines, dst, 0, width, weights, taps);
+    else if (simd == SimdLevelSSE41)
+        x = fixedConvolveVSSE41(lines, dst, 0, width, weights, taps);
+#else
+    Q_UNUSED(simd)
+#endif
+
+    fixedConvolveV(lines, dst, x, width, weights, taps);
+}
+
+void gaussFixedPoint(const DenoiseChannel &in,
+                     const DenoiseChannel &out,
+                     const qreal *kernel,
+                     int radius,
+                     SimdLevel simd,
+                     QVector<qint16> &blurred,
+                     ScratchArena &shared,
+                     ScratchArena *arenas,
+                     TileScheduler &scheduler)
+{
+    int width = in.width;
+    int height = in.height;
+    QSize size(width, height);
+    int weightsSize = FixedKernel::weightsSize(radius);
+    FixedKernel kernelX(kernel, radius, width,
+                        shared.allocate<qint16>(weightsSize));
+    FixedKernel kernelY(kernel, radius, height,
+                        shared.allocate<qint16>(weightsSize));
+    blurred.resize(width * height);
+    qint16 *blurredPixels = blurred.data();
+
+    // Horizontal pass. The SIMD code needs consecutive pixels, the lines of
+    // interleaved channels are copied to a line buffer of the worker first.
+    scheduler.runLines(size, 0, [&] (const Tile &tile, int worker) {
+        ScratchArena &arena = arenas[worker];
+        arena.reset();
+        quint8 *row = arena.allocate<quint8>(width);
+
+        for (int y = tile.rect.top(); y <= tile.rect.bottom(); y++) {
+            const quint8 *src = in.line(y);
+
+            if (in.pixelStride != 1) {
+                for (int i = 0; i < width; i++)
+                    row[i] = src[i * in.pixelStride];
+
+                src = row;
+            }
+
+            fixedLineH(src, blurredPixels + y * width, width, kernelX, simd);
+        }
+    });
+
+    // Vertical pass.
+    scheduler.runLines(size, radius, [&] (const Tile &tile, int worker) {
+        ScratchArena &arena = arenas[worker];
+        arena.reset();
+        quint8 *row = arena.allocate<quint8>(width);
+        const qint16 **window = arena.allocate<const qint16 *>(2 * radius + 1);
+
+        for (int y = tile.rect.top(); y <= tile.rect.bottom(); y++) {
+            int yp = qMax(y - radius, 0);
+            int kh = qMin(y + radius, height - 1) - yp + 1;
+
+            for (int j = 0; j < kh; j++)
+                window[j] = blurredPixels + (yp + j) * width;
+
+            quint8 *dst = out.pixelStride == 1? out.line(y): row;
+            fixedLineV(window, dst, width, y, kernelY, simd);
+
+            if (out.pixelStride != 1) {
+                quint8 *oLine = out.line(y);
+
+                for (int i = 0; i < width; i++)
+                    oLine[i * out.pixelStride] = row[i];
+            }
+        }
+    });
+}
+
+// Line by line versions of the separable and the fixed point methods, the
+// prepared lines have the result of the horizontal pass.
+class GaussSeparableLines: public DenoiseLineFilter
+{
+    public:
+        GaussSeparableLines(int width, int height,
+                            const QVector<qreal> &kernel, int radius):
+            DenoiseLineFilter(width, height, radius),
+            kernel(kernel),
+            normX(width),
+            normY(height),
+            sums(width)
+        {
+            gaussNormalization(kernel.constData(), radius, width,
+                               this->normX.data());
+            gaussNormalization(kernel.constData(), radius, height,
+                               this->normY.data());
+        }
+
+        int lineSize() const
+        {
+            return this->width * int(sizeof(qreal));
+        }
+
+        qint64 bufferSize() const
+        {
+            return (this->kernel.size()
+                    + this->normX.size()
+                    + this->normY.size()
+                    + this->sums.size()) * qint64(sizeof(qreal));
+        }
+
+        void prepareLine(const quint8 *in, int y, quint8 *line)
+        {
+            Q_UNUSED(y)
+            qreal *dst = reinterpret_cast<qreal *>(line);
+
+            for (int x = 0; x < this->width; x++)
+                dst[x] = convolve(in, 1, x, this->width,
+                                  this->kernel.constData(), this->radius,
+                                  this->normX[x]);
+        }
+
+        void filterLine(const quint8 *const *lines, int y, bool first,
+                        quint8 *out)
+        {
+            Q_UNUSED(first)
+            int kMin = qMax(this->radius - y, 0);
+            int kMax = qMin(this->radius + this->height - 1 - y,
+                            2 * this->radius);
+            qreal *sums = this->sums.data();
+
+            // Same order of the sums as convolve(), so the result is the
+            // same as the full frame version.
+            memset(sums, 0, size_t(this->width) * sizeof(qreal));
+
+            for (int k = kMin; k <= kMax; k++) {
+                const qreal *line =
+                        reinterpret_cast<const qreal *>(lines[k - kMin]);
+                qreal weight = this->kernel[k];
+
+                for (int x = 0; x < this->width; x++)
+                    sums[x] += weight * line[x];
+            }
+
+            qreal norm = this->normY[y];
+
+            for (int x = 0; x < this->width; x++)
+                out[x] = quint8(sums[x] * norm);
+        }
+
+    private:
+        QVector<qreal> kernel;
+        QVector<qreal> normX;
+        QVector<qreal> normY;
+        QVector<qreal> sums;
+};
+
+class GaussFixedPointLines: public DenoiseLineFilter
+{
+    public:
+        GaussFixedPointLines(int width, int height,
+                             const QVector<qreal> &kernel, int radius):
+            DenoiseLineFilter(width, height, radius),
+            weights(2 * FixedKernel::weightsSize(radius)),
+            kernelX(kernel.constData(), radius, width,
+                    this->weights.data()),
+            kernelY(kernel.constData(), radius, height,
+                    this->weights.data() + FixedKernel::weightsSize(radius)),
+            simd(simdLevel()),
+            window(2 * radius + 1)
+        {
+        }
+
+        int lineSize() const
+        {
+            return this->width * int(sizeof(qint16));
+        }
+
+        qint64 bufferSize() const
+        {
+            return this->weights.size() * qint64(sizeof(qint16))
+                 + this->window.size() * qint64(sizeof(const qint16 *));
+        }
+
+        void prepareLine(const quint8 *in, int y, quint8 *line)
+        {
+            Q_UNUSED(y)
+            fixedLineH(in, reinterpret_cast<qint16 *>(line), this->width,
+                       this->kernelX, this->simd);
+        }
+
+        void filterLine(const quint8 *const *lines, int y, bool first,
+                        quint8 *out)
+        {
+            Q_UNUSED(first)
+            int kh = qMin(y + this->radius, this->height - 1)
+                     - qMax(y - this->radius, 0) + 1;
+
+            for (int j = 0; j < kh; j++)
+                this->window[j] = reinterpret_cast<const qint16 *>(lines[j]);
+
+            fixedLineV(this->window.constData(), out, this->width, y,
+                       this->kernelY, this->simd);
+        }
+
+    private:
+        QVector<qint16> weights;
+        FixedKernel kernelX;
+        FixedKernel kernelY;
+        SimdLevel simd;
+        QVector<const qint16 *> window;
+};
+
+GaussFilter::GaussFilter(TileScheduler *scheduler):
+    DenoiseFilter(scheduler),
+    radius(3),
+    sigma(1000),
+    method(GaussMethodSeparable),
+    tunedMethod(GaussMethodSeparable),
+    errorRadius(-1),
+    errorSigma(0),
+    lastRecursiveError(0)
+{
+}
+
+qreal GaussFilter::recursiveError() const
+{
+    QVector<qreal> kernel(2 * this->radius + 1);
+    gaussKernel(this->radius, this->sigma, kernel.data());
+
+    return recursiveGaussError(kernel.constData(), this->radius, this->sigma);
+}
+
+qreal GaussFilter::boxError() const
+{
+    QVector<qreal> kernel(2 * this->radius + 1);
+    gaussKernel(this->radius, this->sigma, kernel.data());
+
+    return boxGaussError(kernel.constData(), this->radius);
+}
+
+bool GaussFilter::supportsInPlace() const
+{
+    // Each pass reads the whole channel before writing it.
+    return true;
+}
+
+qint64 GaussFilter::bufferSize() const
+{
+    return DenoiseFilter::bufferSize()
+         + this->transposed.size() * qint64(sizeof(qreal))
+         + this->blurred.size() * qint64(sizeof(qint16));
+}
+
+GaussMethod GaussFilter::currentMethod() const
+{
+    return this->tuner? this->tunedMethod: this->method;
+}
+
+int GaussFilter::borderSize() const
+{
+    // The response of the recursive filter is infinite, but it's negligible
+    // after 3 sigmas.
+    if (this->currentMethod() == GaussMethodRecursive)
+        return qCeil(3 * this->sigma);
+
+    return this->radius;
+}
+
+void GaussFilter::tune(const DenoiseTuner &tuner, const DenoiseImage &image)
+{
+    QSize size(image.width, image.height);
+    int radius = this->radius;
+    this->tunedMethod = this->method;
+    qreal best = tuner.cost("gauss/separable", radius, size);
+
+    if (best < 0)
+        return;
+
+    this->tunedMethod = GaussMethodSeparable;
+
+    // The fixed point method is 8 bits only, and its error is 1 at most.
+    qreal cost = tuner.cost("gauss/fixedpoint", radius, size);
+
+    if (image.sample() == DenoiseSampleUInt8
+        && tuner.maxError >= 1
+        && cost >= 0
+        && cost < best) {
+        best = cost;
+        this->tunedMethod = GaussMethodFixedPoint;
+    }
+
+    // The errors of the approximations are only calculated if they are
+    // faster.
+    cost = tuner.cost("gauss/box", radius, size);
+
+    if (cost >= 0 && cost < best && this->boxError() <= tuner.maxError) {
+        best = cost;
+        this->tunedMethod = GaussMethodBox;
+    }
+
+    cost = tuner.cost("gauss/recursive", radius, size);
+
+    if (cost < 0 || cost >= best)
+        return;
+
+    if (this->errorRadius != radius || this->errorSigma != this->sigma) {
+        this->errorRadius = radius;
+        this->errorSigma = this->sigma;
+        this->lastRecursiveError = this->recursiveError();
+    }
+
+    if (this->lastRecursiveError <= tuner.maxError)
+        this->tunedMethod = GaussMethodRecursive;
+}
+
+void GaussFilter::filter(const DenoiseChannel &in, const DenoiseChannel &out)
+{
+    if (this->currentMethod() != GaussMethodFixedPoint) {
+        this->filterTyped(in, out);
+
+        return;
+    }
+
+    // Create gaussian denoise kernel.
+    ScratchArena &shared = this->sharedScratch();
+    qreal *kernel = shared.allocate<qreal>(2 * this->radius + 1);
+    gaussKernel(this->radius, this->sigma, kernel);
+    DenoiseTraceScope stage("gauss/fixedpoint");
+    gaussFixedPoint(in, out, kernel, this->radius, simdLevel(),
+                    this->blurred,
+                    shared,
+                    this->workerScratch(),
+                    *this->scheduler);
+}
+
+void GaussFilter::filter(const DenoiseChannel16 &in,
+                         const DenoiseChannel16 &out)
+{
+    this->filterTyped(in, out);
+}
+
+void GaussFilter::filter(const DenoiseChannelFloat &in,
+                         const DenoiseChannelFloat &out)
+{
+    this->filterTyped(in, out);
+}
+
+template <typename T>
+void GaussFilter::filterTyped(const DenoiseTypedChannel<T> &in,
+                              const DenoiseTypedChannel<T> &out)
+{
+    GaussMethod method = this->currentMethod();
+
+    // Create gaussian denoise kernel.
+    ScratchArena &shared = this->sharedScratch();
+    qreal *kernel = shared.allocate<qreal>(2 * this->radius + 1);
+    gaussKernel(this->radius, this->sigma, kernel);
+    DenoiseTraceScope stage(method == GaussMethodRecursive?
+                                "gauss/recursive":
+                            method == GaussMethodBox?
+                                "gauss/box": "gauss/separable");
+
+    if (method == GaussMethodRecursive)
+        gaussRecursive(in, out, this->sigma,
+                       this->transposed,
+                       this->workerScratch(),
+                       *this->scheduler);
+    else if (method == GaussMethodBox && sizeof(T) == 1
+             && this->radius <= gaussBoxMaxRadius32)
+        gaussBox<T, qint32>(in, out, this->radius,
+                            shared,
+                            this->workerScratch(),
+                            *this->scheduler);
+    else if (method == GaussMethodBox)
+        gaussBox<T, typename BoxSum<T>::Type>(in, out, this->radius,
+                                              shared,
+                                              this->workerScratch(),
+                                              *this->scheduler);
+    else
+        gaussSeparable(in, out, kernel, this->radius,
+                       this->transposed,
+                       shared,
+                       *this->scheduler);
+}
+
+DenoiseLineFilter *GaussFilter::createLineFilter(const QSize &size) const
+{
+    QVector<qreal> kernel(2 * this->radius + 1);
+    gaussKernel(this->radius, this->sigma, kernel.data());
+
+    switch (this->method) {
+    case GaussMethodRecursive:
+        // Each output pixel depends on the whole column.
+        return 0;
+    case GaussMethodFixedPoint:
+        return new GaussFixedPointLines(size.width(), size.height(),
+                                        kernel, this->radius);
+    default:
+        return new GaussSeparableLines(size.width(), size.height(),
+                                       kernel, this->radius);
+    }
+}
+
+quint64 GaussFilter::lineFilterKey() const
+{
+    return DenoiseKey() << this->radius << this->sigma << this->method;
+}
@@ -0,0 +1,96 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#ifndef GAUSSFILTER_H
+#define GAUSSFILTER_H
+
+#include <QVector>
+
+#include "denoisefilter.h"
+
+enum GaussMethod
+{
+    GaussMethodSeparable,
+    GaussMethodRecursive,
+    GaussMethodFixedPoint,
+    GaussMethodBox
+};
+
+// Gaussian blur of radius pixels around each pixel.
+//
+// The recursive method cost doesn't depends on the radius, but it only
+// approximates the kernel, and the border modes pad the image with 3 * sigma
+// pixels instead of radius pixels. The fixed point method gives the same result as
+// the separable one with a difference of 1 at most, it only works with 8 bits
+// samples, the 16 bits and floating point samples use the separable method
+// instead. The box method is the average of the window, the limit of the
+// kernel when sigma is much bigger than the radius, and its cost doesn't
+// depends on the radius either. Line by line, it uses the separable method.
+class GaussFilter: public DenoiseFilter
+{
+    public:
+        explicit GaussFilter(TileScheduler *scheduler = 0);
+
+        int radius;
+        qreal sigma;
+        GaussMethod method;
+
+        // Method used to filter the images, the one picked by the tuner if
+        // it's set, otherwise method.
+        GaussMethod currentMethod() const;
+
+        // Maximum difference between the recursive method and the exact
+        // kernel, in 8 bits levels.
+        qreal recursiveError() const;
+
+        // Maximum difference between the box method and the exact kernel,
+        // in 8 bits levels.
+        qreal boxError() const;
+
+        bool supportsInPlace() const;
+        qint64 bufferSize() const;
+        int borderSize() const;
+        DenoiseLineFilter *createLineFilter(const QSize &size) const;
+        quint64 lineFilterKey() const;
+
+    protected:
+        void tune(const DenoiseTuner &tuner, const DenoiseImage &image);
+        void filter(const DenoiseChannel &in, const DenoiseChannel &out);
+        void filter(const DenoiseChannel16 &in, const DenoiseChannel16 &out);
+        void filter(const DenoiseChannelFloat &in,
+                    const DenoiseChannelFloat &out);
+
+    private:
+        GaussMethod tunedMethod;
+        QVector<qreal> transposed;
+        QVector<qint16> blurred;
+
+        // Error of the recursive method for the last radius and sigma
+        // tuned, it's slow to calculate for big sigmas.
+        int errorRadius;
+        qreal errorSigma;
+        qreal lastRecursiveError;
+
+        template <typename T>
+        void filterTyped(const DenoiseTypedChannel<T> &in,
+                         const DenoiseTypedChannel<T> &out);
+};
+
+#endif // GAUSSFILTER_H
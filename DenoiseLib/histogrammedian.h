@@ -0,0 +1,246 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#ifndef HISTOGRAMMEDIAN_H
+#define HISTOGRAMMEDIAN_H
+
+#include <cstring>
+#include <QRect>
+#include <QVector>
+
+#include "denoiseimage.h"
+
+// Median filter with sliding histograms, as described in:
+//
+// S. Perreault, P. Hebert, "Median Filtering in Constant Time",
+// IEEE Transactions on Image Processing 16 (2007) 2389-2394.
+//
+// Each column keeps a histogram of the pixels in the vertical range of the
+// window, and the window histogram is updated adding and removing columns
+// as it slides. The histograms are split in 16 coarse bins and 256 fine
+// bins, the coarse bins are always up to date, while the fine bins are
+// only updated when the median falls in them.
+class HistogramMedian
+{
+    public:
+        explicit HistogramMedian(int radius = 0):
+            radius(radius),
+            width(0),
+            columns(0),
+            xOffset(0)
+        {
+        }
+
+        inline void setRadius(int radius)
+        {
+            this->radius = radius;
+        }
+
+        inline qint64 size() const
+        {
+            return (this->columnsCoarse.size() + this->columnsFine.size())
+                   * qint64(sizeof(quint16))
+                   + qint64(sizeof(*this));
+        }
+
+        // Filter the pixels of the channel inside rect. The column
+        // histograms only cover the columns of the tile and its halo.
+        void filter(const DenoiseChannel &in, const DenoiseChannel &out,
+                    const QRect &rect)
+        {
+            int width = in.width;
+            int height = in.height;
+            this->setColumns(width, rect.left(), rect.right());
+
+            // Fill the columns with the lines of the first window.
+            int top = rect.top();
+
+            for (int y = qMax(top - this->radius, 0);
+                 y <= qMin(top + this->radius, height - 1);
+                 y++)
+                this->addLine(in.line(y), in.pixelStride, 1);
+
+            for (int y = top; y <= rect.bottom(); y++) {
+                // Move the columns down.
+                if (y > top) {
+                    if (y + this->radius < height)
+                        this->addLine(in.line(y + this->radius),
+                                      in.pixelStride, 1);
+
+                    if (y - this->radius > 0)
+                        this->addLine(in.line(y - this->radius - 1),
+                                      in.pixelStride, -1);
+                }
+
+                int yp = qMax(y - this->radius, 0);
+                int kh = qMin(y + this->radius, height - 1) - yp + 1;
+                this->filterLine(out.line(y), out.pixelStride,
+                                 rect.left(), rect.right(), kh);
+            }
+        }
+
+        // Make room for the column histograms of a tile with the given
+        // number of columns, including the halo, so filter() doesn't
+        // allocate with any tile.
+        void reserveColumns(int columns)
+        {
+            this->columnsCoarse.reserve(16 * columns);
+            this->columnsFine.reserve(256 * columns);
+        }
+
+        // Empty the column histograms, and make them cover the columns from
+        // left to right of a line of the given width, plus the halo.
+        void setColumns(int width, int left, int right)
+        {
+            this->width = width;
+            this->xOffset = qMax(left - this->radius, 0);
+            this->columns = qMin(right + this->radius, width - 1)
+                            - this->xOffset + 1;
+            this->columnsCoarse.resize(16 * this->columns);
+            this->columnsFine.resize(256 * this->columns);
+            this->columnsCoarse.fill(0);
+            this->columnsFine.fill(0);
+        }
+
+        // Add (sign = 1) or remove (sign = -1) a line to the columns.
+        inline void addLine(const quint8 *line, int pixelStride, int sign)
+        {
+            line += this->xOffset * pixelStride;
+
+            for (int x = 0; x < this->columns; x++) {
+                quint8 value = line[x * pixelStride];
+                this->columnsCoarse[16 * x + (value >> 4)] += sign;
+                this->columnsFine[this->fineIndex(x, value >> 4) + (value & 0xf)] += sign;
+            }
+        }
+
+        // Filter the pixels from left to right of a line, the columns must
+        // have the kh lines of its window.
+        inline void filterLine(quint8 *dst, int pixelStride,
+                               int left, int right, int kh)
+        {
+            memset(this->coarse, 0, 16 * sizeof(quint32));
+
+            for (int i = 0; i < 16; i++) {
+                this->fineFirst[i] = 0;
+                this->fineLast[i] = -1;
+            }
+
+            for (int x = qMax(left - this->radius, 0);
+                 x <= qMin(left + this->radius, this->width - 1);
+                 x++)
+                this->addColumn(x, 1);
+
+            for (int x = left; x <= right; x++) {
+                int xp = qMax(x - this->radius, 0);
+                int xq = qMin(x + this->radius, this->width - 1);
+
+                // Same as selecting the pixel in the middle of the sorted
+                // window.
+                quint32 rank = quint32((xq - xp + 1) * kh / 2);
+                quint32 count = 0;
+                int bin = 0;
+
+                while (count + this->coarse[bin] <= rank)
+                    count += this->coarse[bin++];
+
+                this->updateFine(bin, xp, xq);
+                const quint32 *fine = this->fine + 16 * bin;
+                int i = 0;
+
+                while (count + fine[i] <= rank)
+                    count += fine[i++];
+
+                dst[x * pixelStride] = quint8(16 * bin + i);
+
+                // Slide the window.
+                if (x < right) {
+                    if (x + this->radius + 1 < this->width)
+                        this->addColumn(x + this->radius + 1, 1);
+
+                    if (x - this->radius >= 0)
+                        this->addColumn(x - this->radius, -1);
+                }
+            }
+        }
+
+    private:
+        int radius;
+        int width;
+        int columns;
+        int xOffset;
+        QVector<quint16> columnsCoarse;
+        QVector<quint16> columnsFine;
+        quint32 coarse[16];
+        quint32 fine[256];
+
+        // Range of columns accumulated in each fine bin of the window.
+        int fineFirst[16];
+        int fineLast[16];
+
+        // The fine bins are stored by coarse bin first, that way updating a
+        // coarse bin of the window reads consecutive memory.
+        inline int fineIndex(int x, int bin) const
+        {
+            return 16 * (x + bin * this->columns);
+        }
+
+        // The columns are indexed from the first column of the halo.
+        inline void addColumn(int x, int sign)
+        {
+            const quint16 *column = this->columnsCoarse.constData()
+                                    + 16 * (x - this->xOffset);
+
+            for (int i = 0; i < 16; i++)
+                this->coarse[i] += sign * column[i];
+        }
+
+        inline void addFineColumns(int bin, int first, int last, int sign)
+        {
+            quint32 *fine = this->fine + 16 * bin;
+
+            for (int x = first; x <= last; x++) {
+                const quint16 *column = this->columnsFine.constData()
+                                        + this->fineIndex(x - this->xOffset,
+                                                          bin);
+
+                for (int i = 0; i < 16; i++)
+                    fine[i] += sign * column[i];
+            }
+        }
+
+        // Make the fine bin cover the columns in [first, last].
+        inline void updateFine(int bin, int first, int last)
+        {
+            if (this->fineLast[bin] < first) {
+                // No column in common, start from scratch.
+                memset(this->fine + 16 * bin, 0, 16 * sizeof(quint32));
+                this->addFineColumns(bin, first, last, 1);
+            } else {
+                this->addFineColumns(bin, this->fineFirst[bin], first - 1, -1);
+                this->addFineColumns(bin, this->fineLast[bin] + 1, last, 1);
+            }
+
+            this->fineFirst[bin] = first;
+            this->fineLast[bin] = last;
+        }
+};
+
+#endif // HISTOGRAMMEDIAN_H
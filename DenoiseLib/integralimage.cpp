@@ -0,0 +1,153 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#include "integralimage.h"
+
+IntegralImage::IntegralImage():
+    lineWidth(0)
+{
+}
+
+void IntegralImage::update(const DenoiseChannel &channel)
+{
+    int oWidth = channel.width + 1;
+    int oHeight = channel.height + 1;
+    this->lineWidth = oWidth;
+    this->integral.resize(oWidth * oHeight);
+    this->integral2.resize(oWidth * oHeight);
+    quint32 *integral = this->integral.data();
+    quint64 *integral2 = this->integral2.data();
+
+    // The first line and the first column are always 0.
+    for (int x = 0; x < oWidth; x++) {
+        integral[x] = 0;
+        integral2[x] = 0;
+    }
+
+    for (int y = 1; y < oHeight; y++) {
+        const quint8 *line = channel.line(y - 1);
+
+        // Reset current line summation.
+        quint32 sum = 0;
+        quint64 sum2 = 0;
+
+        integral[y * oWidth] = 0;
+        integral2[y * oWidth] = 0;
+
+        for (int x = 1; x < oWidth; x++) {
+            quint32 pixel = line[(x - 1) * channel.pixelStride];
+
+            // Accumulate pixels in current line.
+            sum += pixel;
+            sum2 += pixel * pixel;
+
+            // Offset to the current line.
+            int offset = x + y * oWidth;
+
+            // Offset to the previous line.
+            // equivalent to x + (y - 1) * oWidth;
+            int offsetPrevious = offset - oWidth;
+
+            // Accumulate current line and previous line.
+            integral[offset] = sum + integral[offsetPrevious];
+            integral2[offset] = sum2 + integral2[offsetPrevious];
+        }
+    }
+}
+
+qint64 IntegralImage::size() const
+{
+    return this->integral.size() * qint64(sizeof(quint32))
+         + this->integral2.size() * qint64(sizeof(quint64));
+}
+
+TiledIntegralImage::TiledIntegralImage():
+    tilesX(0),
+    tilesY(0)
+{
+}
+
+void TiledIntegralImage::update(const DenoiseChannel &channel)
+{
+    int width = channel.width;
+    int height = channel.height;
+    this->tilesX = (width + integralTileSize - 1) / integralTileSize;
+    this->tilesY = (height + integralTileSize - 1) / integralTileSize;
+    int tileArea = integralTileSize * integralTileSize;
+    int cornersWidth = this->tilesX + 1;
+    this->tiles.resize(this->tilesX * this->tilesY * tileArea);
+    this->tiles2.resize(this->tilesX * this->tilesY * tileArea);
+    this->corners.fill(0, cornersWidth * (this->tilesY + 1));
+    this->corners2.fill(0, cornersWidth * (this->tilesY + 1));
+    quint64 *corners = this->corners.data();
+    quint64 *corners2 = this->corners2.data();
+
+    for (int ty = 0; ty < this->tilesY; ty++)
+        for (int tx = 0; tx < this->tilesX; tx++) {
+            int xs = tx * integralTileSize;
+            int ys = ty * integralTileSize;
+            int tw = qMin(integralTileSize, width - xs);
+            int th = qMin(integralTileSize, height - ys);
+            int offset = (tx + ty * this->tilesX) * tileArea;
+            quint16 *tile = this->tiles.data() + offset;
+            quint32 *tile2 = this->tiles2.data() + offset;
+
+            // The tiles in the right and bottom borders are not filled
+            // beyond the image, the windows never reach it.
+            for (int y = 0; y < th; y++) {
+                const quint8 *line = channel.line(ys + y)
+                                   + xs * channel.pixelStride;
+
+                // Reset current line summation.
+                quint16 sum = 0;
+                quint32 sum2 = 0;
+
+                for (int x = 0; x < tw; x++) {
+                    quint32 pixel = line[x * channel.pixelStride];
+                    sum += pixel;
+                    sum2 += pixel * pixel;
+
+                    int i = x + y * integralTileSize;
+                    tile[i] = y? sum + tile[i - integralTileSize]: sum;
+                    tile2[i] = y? sum2 + tile2[i - integralTileSize]: sum2;
+                }
+            }
+
+            // Accumulate the whole tile in the corners table.
+            int last = (tw - 1) + (th - 1) * integralTileSize;
+            int corner = (tx + 1) + (ty + 1) * cornersWidth;
+            corners[corner] = corners[corner - 1]
+                            + corners[corner - cornersWidth]
+                            - corners[corner - cornersWidth - 1]
+                            + tile[last];
+            corners2[corner] = corners2[corner - 1]
+                             + corners2[corner - cornersWidth]
+                             - corners2[corner - cornersWidth - 1]
+                             + tile2[last];
+        }
+}
+
+qint64 TiledIntegralImage::size() const
+{
+    return this->tiles.size() * qint64(sizeof(quint16))
+         + this->tiles2.size() * qint64(sizeof(quint32))
+         + this->corners.size() * qint64(sizeof(quint64))
+         + this->corners2.size() * qint64(sizeof(quint64));
+}
@@ -0,0 +1,267 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#ifndef INTEGRALIMAGE_H
+#define INTEGRALIMAGE_H
+
+#include <QVector>
+
+#include "denoiseimage.h"
+
+// Full frame integral images of a channel.
+class IntegralImage
+{
+    public:
+        IntegralImage();
+
+        void update(const DenoiseChannel &channel);
+
+        inline quint32 sum(int x, int y, int kw, int kh) const
+        {
+            return this->integralSum(this->integral.constData(),
+                                     x, y, kw, kh);
+        }
+
+        inline quint64 sum2(int x, int y, int kw, int kh) const
+        {
+            return this->integralSum(this->integral2.constData(),
+                                     x, y, kw, kh);
+        }
+
+        qint64 size() const;
+
+    private:
+        int lineWidth;
+        QVector<quint32> integral;
+        QVector<quint64> integral2;
+
+        template <typename T>
+        inline T integralSum(const T *integral,
+                             int x, int y, int kw, int kh) const
+        {
+            const T *p0 = integral + x + y * this->lineWidth;
+            const T *p1 = p0 + kw;
+            const T *p2 = p0 + kh * this->lineWidth;
+            const T *p3 = p2 + kw;
+
+            return *p0 + *p3 - *p1 - *p2;
+        }
+};
+
+// Full frame integral images of a channel with 16 bits or floating point
+// samples, the sums are stored as Sum.
+template <typename Sum>
+class WideIntegralImage
+{
+    public:
+        WideIntegralImage():
+            lineWidth(0)
+        {
+        }
+
+        template <typename T>
+        void update(const DenoiseTypedChannel<T> &channel)
+        {
+            int oWidth = channel.width + 1;
+            int oHeight = channel.height + 1;
+            this->lineWidth = oWidth;
+            this->integral.resize(oWidth * oHeight);
+            this->integral2.resize(oWidth * oHeight);
+            Sum *integral = this->integral.data();
+            Sum *integral2 = this->integral2.data();
+
+            for (int x = 0; x < oWidth; x++) {
+                integral[x] = 0;
+                integral2[x] = 0;
+            }
+
+            for (int y = 1; y < oHeight; y++) {
+                const T *line = channel.line(y - 1);
+                Sum sum = 0;
+                Sum sum2 = 0;
+                integral[y * oWidth] = 0;
+                integral2[y * oWidth] = 0;
+
+                for (int x = 1; x < oWidth; x++) {
+                    Sum pixel = line[(x - 1) * channel.pixelStride];
+                    sum += pixel;
+                    sum2 += pixel * pixel;
+                    int offset = x + y * oWidth;
+                    integral[offset] = sum + integral[offset - oWidth];
+                    integral2[offset] = sum2 + integral2[offset - oWidth];
+                }
+            }
+        }
+
+        inline Sum sum(int x, int y, int kw, int kh) const
+        {
+            return this->integralSum(this->integral.constData(),
+                                     x, y, kw, kh);
+        }
+
+        inline Sum sum2(int x, int y, int kw, int kh) const
+        {
+            return this->integralSum(this->integral2.constData(),
+                                     x, y, kw, kh);
+        }
+
+        qint64 size() const
+        {
+            return (this->integral.size() + this->integral2.size())
+                   * qint64(sizeof(Sum));
+        }
+
+    private:
+        int lineWidth;
+        QVector<Sum> integral;
+        QVector<Sum> integral2;
+
+        inline Sum integralSum(const Sum *integral,
+                               int x, int y, int kw, int kh) const
+        {
+            const Sum *p0 = integral + x + y * this->lineWidth;
+            const Sum *p1 = p0 + kw;
+            const Sum *p2 = p0 + kh * this->lineWidth;
+            const Sum *p3 = p2 + kw;
+
+            return *p0 + *p3 - *p1 - *p2;
+        }
+};
+
+// Size of the tiles of the tiled integral images.
+static const int integralTileSize = 16;
+
+// Integral images split in square tiles of integralTileSize pixels.
+//
+// Each tile stores the integral of its own pixels only, relative to the
+// top-left corner of the tile, so the summation fits in 16 bits and the
+// cuadratic summation in 32 bits, half the memory of the full frame
+// integral images. The integral of the whole tiles is kept in a small table
+// with one entry per tile corner. The pixels of a tile are contiguous in
+// memory, so small windows are answered from one to four tiles.
+class TiledIntegralImage
+{
+    public:
+        TiledIntegralImage();
+
+        void update(const DenoiseChannel &channel);
+
+        inline quint32 sum(int x, int y, int kw, int kh) const
+        {
+            return quint32(this->windowSum(this->tiles.constData(),
+                                           this->corners.constData(),
+                                           x, y, kw, kh));
+        }
+
+        inline quint64 sum2(int x, int y, int kw, int kh) const
+        {
+            return this->windowSum(this->tiles2.constData(),
+                                   this->corners2.constData(),
+                                   x, y, kw, kh);
+        }
+
+        qint64 size() const;
+
+    private:
+        int tilesX;
+        int tilesY;
+        QVector<quint16> tiles;
+        QVector<quint32> tiles2;
+        QVector<quint64> corners;
+        QVector<quint64> corners2;
+
+        // Sum the window (x, y, kw, kh). The tiles fully inside the window
+        // are read from the corners table, and the tiles partially covered
+        // from the tile integrals.
+        //
+        // Inlining this into the weighted average loop makes the whole
+        // filter about a 40% slower, keep it out of line.
+        template <typename T>
+        Q_NEVER_INLINE quint64 windowSum(const T *tiles,
+                                         const quint64 *corners,
+                                         int x, int y, int kw, int kh) const
+        {
+            int cornersWidth = this->tilesX + 1;
+            int x1 = x + kw - 1;
+            int y1 = y + kh - 1;
+
+            // Tiles covered by the window.
+            int tx0 = x / integralTileSize;
+            int tx1 = x1 / integralTileSize;
+            int ty0 = y / integralTileSize;
+            int ty1 = y1 / integralTileSize;
+
+            // Tiles fully inside the window, [fx0, fx1) x [fy0, fy1).
+            int fx0 = (x + integralTileSize - 1) / integralTileSize;
+            int fx1 = (x1 + 1) / integralTileSize;
+            int fy0 = (y + integralTileSize - 1) / integralTileSize;
+            int fy1 = (y1 + 1) / integralTileSize;
+            bool inner = fx0 < fx1 && fy0 < fy1;
+
+            quint64 sum = 0;
+
+            if (inner) {
+                sum += corners[fx1 + fy1 * cornersWidth];
+                sum += corners[fx0 + fy0 * cornersWidth];
+                sum -= corners[fx0 + fy1 * cornersWidth];
+                sum -= corners[fx1 + fy0 * cornersWidth];
+            }
+
+            for (int ty = ty0; ty <= ty1; ty++) {
+                int ys = ty * integralTileSize;
+
+                // Last line before the window and last line of the window,
+                // inside the tile.
+                int c = qMax(y - ys, 0) - 1;
+                int d = qMin(y1 - ys, integralTileSize - 1);
+
+                for (int tx = tx0; tx <= tx1; tx++) {
+                    if (inner && tx == fx0 && ty >= fy0 && ty < fy1) {
+                        tx = fx1 - 1;
+
+                        continue;
+                    }
+
+                    int xs = tx * integralTileSize;
+                    int a = qMax(x - xs, 0) - 1;
+                    int b = qMin(x1 - xs, integralTileSize - 1);
+                    const T *tile = tiles
+                                  + (tx + ty * this->tilesX)
+                                  * integralTileSize * integralTileSize;
+
+                    sum += tile[b + d * integralTileSize];
+
+                    if (a >= 0)
+                        sum -= tile[a + d * integralTileSize];
+
+                    if (c >= 0) {
+                        sum -= tile[b + c * integralTileSize];
+
+                        if (a >= 0)
+                            sum += tile[a + c * integralTileSize];
+                    }
+                }
+            }
+
+            return sum;
+        }
+};
+
+#endif // INTEGRALIMAGE_H
@@ -0,0 +1,788 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#include <cmath>
+#include <cstring>
+#include <new>
+#include <QVector>
+
+#if defined(Q_PROCESSOR_X86) && defined(Q_CC_GNU)
+#include <immintrin.h>
+#define MEAN_SIMD
+#endif
+
+#include "denoisetrace.h"
+#include "denoisetuner.h"
+#include "meanfilter.h"
+#include "tilescheduler.h"
+
+enum MeanSimd
+{
+    MeanSimdNone,
+    MeanSimdSSE2,
+    MeanSimdAVX2
+};
+
+// exp(x) is approximated as in the Cephes library, x = n ln(2) + r, and
+// exp(r) is a polynomial in [-ln(2) / 2, ln(2) / 2]. The relative error is
+// below 1e-7 in [meanExpMin, 0], and the weights are never 0, so the
+// average of a window is always defined.
+static const float meanExpMin = -87.f;
+static const float meanLog2e = 1.44269504088896341f;
+static const float meanLn2Hi = 0.693359375f;
+static const float meanLn2Lo = -2.12194440e-4f;
+static const float meanExpP0 = 1.9875691500e-4f;
+static const float meanExpP1 = 1.3981999507e-3f;
+static const float meanExpP2 = 8.3334519073e-3f;
+static const float meanExpP3 = 4.1665795894e-2f;
+static const float meanExpP4 = 1.6666665459e-1f;
+static const float meanExpP5 = 5.0000001201e-1f;
+
+// Calculate mean and standard deviation of the window from the summation
+// and cuadratic summation of its ks pixels.
+inline void windowStats(quint32 sum, quint64 sum2, quint32 ks,
+                        int mu, qreal sigma,
+                        qreal *mean, qreal *dev)
+{
+    // The variance is calculated in 64 bits, it doesn't fit in 32 bits for
+    // radius bigger than 10.
+    *mean = sum / qreal(ks);
+    *dev = quint32(std::sqrt(quint64(ks) * sum2 - quint64(sum) * sum))
+           / qreal(ks);
+
+    *mean = qBound(0., *mean + mu, 255.);
+    *dev = qBound(0., sigma * *dev, 127.);
+}
+
+// Same as windowStats() for the 16 bits and floating point samples, mu and
+// the limit of the deviation are scaled from 8 bits levels to the range of
+// the samples. The floating point samples are not bounded.
+template <typename T>
+inline void wideWindowStats(qreal sum, qreal sum2, int ks,
+                            int mu, qreal sigma,
+                            qreal *mean, qreal *dev)
+{
+    qreal scale = DenoiseSampleTraits<T>::maximum() / 255;
+    *mean = sum / ks;
+    *dev = std::sqrt(qMax(sum2 / ks - *mean * *mean, 0.));
+    *mean += mu * scale;
+    *dev = qMax(sigma * *dev, 0.);
+
+    if (DenoiseSampleTraits<T>::isInteger) {
+        *mean = qBound(0., *mean, DenoiseSampleTraits<T>::maximum());
+        *dev = qMin(*dev, 127 * scale);
+    }
+}
+
+// Histogram of the pixels inside the window.
+//
+// The weight of a pixel only depends on its value, so the weighted average
+// can be calculated from the histogram, evaluating the weight once for each
+// value present in the window, instead of once for each pixel.
+class WindowHistogram
+{
+    public:
+        WindowHistogram()
+        {
+            this->clear();
+        }
+
+        inline void clear()
+        {
+            memset(this->bins, 0, sizeof(this->bins));
+            memset(this->coarse, 0, sizeof(this->coarse));
+        }
+
+        // Add or remove a column of the window, offset is the position of
+        // the column in the lines.
+        inline void addColumn(const quint8 *const *lines, int offset,
+                              int kh, int count)
+        {
+            for (int j = 0; j < kh; j++) {
+                quint8 pixel = lines[j][offset];
+                this->bins[pixel] += count;
+                this->coarse[pixel >> 4] += count;
+            }
+        }
+
+        inline qreal average(qreal mean, qreal dev) const
+        {
+            // All the pixels of the window are the same.
+            if (dev <= 0)
+                return mean;
+
+            qreal h = -2. * (dev * dev);
+            qreal sumP = 0;
+            qreal sumW = 0;
+
+            // Skip the groups of 16 bins without pixels.
+            for (int i = 0; i < 16; i++) {
+                if (!this->coarse[i])
+                    continue;
+
+                for (int pixel = 16 * i; pixel < 16 * i + 16; pixel++) {
+                    quint32 count = this->bins[pixel];
+
+                    if (!count)
+                        continue;
+
+                    qreal d = mean - pixel;
+                    qreal weight = std::exp(d * d / h);
+                    sumP += count * (weight * pixel);
+                    sumW += count * weight;
+                }
+            }
+
+            return sumP / sumW;
+        }
+
+    private:
+        quint32 bins[256];
+        quint32 coarse[16];
+};
+
+// Weighted average of the window (xp, kw, kh), window are its lines.
+template <typename T>
+inline qreal directAverage(const T *const *window, int pixelStride,
+                           int xp, int kw, int kh,
+                           qreal mean, qreal dev)
+{
+    // Without deviation only the pixels equal to the mean would have
+    // weight, and the window is flat.
+    if (dev <= 0)
+        return mean;
+
+    qreal h = -2. * (dev * dev);
+    qreal sumP = 0;
+    qreal sumW = 0;
+
+    for (int j = 0; j < kh; j++) {
+        const T *line = window[j] + xp * pixelStride;
+
+        for (int i = 0; i < kw; i++) {
+            // Calculate weighted avverage.
+            T pixel = line[i * pixelStride];
+            qreal d = mean - pixel;
+            qreal weight = std::exp(d * d / h);
+            sumP += weight * pixel;
+            sumW += weight;
+        }
+    }
+
+    // Normalize result.
+    return sumP / sumW;
+}
+
+inline float fastExp(float x)
+{
+    x = qMax(x, meanExpMin);
+    float n = std::nearbyint(x * meanLog2e);
+    float r = x - n * meanLn2Hi;
+    r = r - n * meanLn2Lo;
+    float p = meanExpP0;
+    p = p * r + meanExpP1;
+    p = p * r + meanExpP2;
+    p = p * r + meanExpP3;
+    p = p * r + meanExpP4;
+    p = p * r + meanExpP5;
+    p = p * (r * r) + r + 1.f;
+
+    // Build 2^n from its exponent bits.
+    qint32 bits = (qint32(n) + 127) << 23;
+    float scale;
+    memcpy(&scale, &bits, sizeof(scale));
+
+    return p * scale;
+}
+
+// Single precision version of directAverage(), gain is -1 / (2 dev^2).
+inline float floatAverage(const quint8 *const *window, int pixelStride,
+                          int xp, int kw, int kh,
+                          float mean, float gain)
+{
+    float sumP = 0;
+    float sumW = 0;
+
+    for (int j = 0; j < kh; j++) {
+        const quint8 *line = window[j] + xp * pixelStride;
+
+        for (int i = 0; i < kw; i++) {
+            float pixel = line[i * pixelStride];
+            float d = mean - pixel;
+            float weight = fastExp(d * d * gain);
+            sumP += weight * pixel;
+            sumW += weight;
+        }
+    }
+
+    return sumP / sumW;
+}
+
+#ifdef MEAN_SIMD
+// The SIMD versions average the windows of consecutive pixels at once, one
+// per lane, the windows must be fully inside of the line. The operations
+// are the same of floatAverage(), in the same order, so all the versions
+// give the same result. Return the first pixel not averaged.
+
+__attribute__((target("avx2")))
+inline __m256 fastExpAVX2(__m256 x)
+{
+    x = _mm256_max_ps(x, _mm256_set1_ps(meanExpMin));
+    __m256 n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(meanLog2e)),
+                               _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_sub_ps(x, _mm256_mul_ps(n, _mm256_set1_ps(meanLn2Hi)));
+    r = _mm256_sub_ps(r, _mm256_mul_ps(n, _mm256_set1_ps(meanLn2Lo)));
+    __m256 p = _mm256_set1_ps(meanExpP0);
+    p = _mm256_add_ps(_mm256_mul_ps(p, r), _mm256_set1_ps(meanExpP1));
+    p = _mm256_add_ps(_mm256_mul_ps(p, r), _mm256_set1_ps(meanExpP2));
+    p = _mm256_add_ps(_mm256_mul_ps(p, r), _mm256_set1_ps(meanExpP3));
+    p = _mm256_add_ps(_mm256_mul_ps(p, r), _mm256_set1_ps(meanExpP4));
+    p = _mm256_add_ps(_mm256_mul_ps(p, r), _mm256_set1_ps(meanExpP5));
+    p = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(p, _mm256_mul_ps(r, r)), r),
+                      _mm256_set1_ps(1.f));
+    __m256i bits = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n),
+                                                      _mm256_set1_epi32(127)),
+                                     23);
+
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(bits));
+}
+
+__attribute__((target("avx2")))
+int floatMeanAVX2(const quint8 *const *window, int kh, int radius,
+                  int xMin, int xMax,
+                  const float *means, const float *gains,
+                  float *averages)
+{
+    int kw = 2 * radius + 1;
+    int x = xMin;
+
+    for (; x + 8 <= xMax; x += 8) {
+        __m256 mean = _mm256_loadu_ps(means + x);
+        __m256 gain = _mm256_loadu_ps(gains + x);
+        __m256 sumP = _mm256_setzero_ps();
+        __m256 sumW = _mm256_setzero_ps();
+
+        for (int j = 0; j < kh; j++) {
+            const quint8 *line = window[j] + x - radius;
+
+            for (int i = 0; i < kw; i++) {
+                __m128i bytes = _mm_loadl_epi64((const __m128i *) (line + i));
+                __m256 pixel = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+                __m256 d = _mm256_sub_ps(mean, pixel);
+                __m256 weight = fastExpAVX2(_mm256_mul_ps(_mm256_mul_ps(d, d),
+                                                          gain));
+                sumP = _mm256_add_ps(sumP, _mm256_mul_ps(weight, pixel));
+                sumW = _mm256_add_ps(sumW, weight);
+            }
+        }
+
+        _mm256_storeu_ps(averages + x, _mm256_div_ps(sumP, sumW));
+    }
+
+    return x;
+}
+
+__attribute__((target("sse2")))
+inline __m128 fastExpSSE2(__m128 x)
+{
+    x = _mm_max_ps(x, _mm_set1_ps(meanExpMin));
+
+    // cvtps rounds to the nearest integer, as nearbyint().
+    __m128i n = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(meanLog2e)));
+    __m128 nf = _mm_cvtepi32_ps(n);
+    __m128 r = _mm_sub_ps(x, _mm_mul_ps(nf, _mm_set1_ps(meanLn2Hi)));
+    r = _mm_sub_ps(r, _mm_mul_ps(nf, _mm_set1_ps(meanLn2Lo)));
+    __m128 p = _mm_set1_ps(meanExpP0);
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(meanExpP1));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(meanExpP2));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(meanExpP3));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(meanExpP4));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(meanExpP5));
+    p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p, _mm_mul_ps(r, r)), r),
+                   _mm_set1_ps(1.f));
+    __m128i bits = _mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23);
+
+    return _mm_mul_ps(p, _mm_castsi128_ps(bits));
+}
+
+__attribute__((target("sse2")))
+int floatMeanSSE2(const quint8 *const *window, int kh, int radius,
+                  int xMin, int xMax,
+                  const float *means, const float *gains,
+                  float *averages)
+{
+    int kw = 2 * radius + 1;
+    int x = xMin;
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; x + 4 <= xMax; x += 4) {
+        __m128 mean = _mm_loadu_ps(means + x);
+        __m128 gain = _mm_loadu_ps(gains + x);
+        __m128 sumP = _mm_setzero_ps();
+        __m128 sumW = _mm_setzero_ps();
+
+        for (int j = 0; j < kh; j++) {
+            const quint8 *line = window[j] + x - radius;
+
+            for (int i = 0; i < kw; i++) {
+                qint32 packed;
+                memcpy(&packed, line + i, sizeof(packed));
+                __m128i bytes = _mm_cvtsi32_si128(packed);
+                bytes = _mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero);
+                __m128 pixel = _mm_cvtepi32_ps(bytes);
+                __m128 d = _mm_sub_ps(mean, pixel);
+                __m128 weight = fastExpSSE2(_mm_mul_ps(_mm_mul_ps(d, d), gain));
+                sumP = _mm_add_ps(sumP, _mm_mul_ps(weight, pixel));
+                sumW = _mm_add_ps(sumW, weight);
+            }
+        }
+
+        _mm_storeu_ps(averages + x, _mm_div_ps(sumP, sumW));
+    }
+
+    return x;
+}
+#endif
+
+inline MeanSimd meanSimd()
+{
+#ifdef MEAN_SIMD
+    if (__builtin_cpu_supports("avx2"))
+        return MeanSimdAVX2;
+
+    if (__builtin_cpu_supports("sse2"))
+        return MeanSimdSSE2;
+#endif
+
+    return MeanSimdNone;
+}
+
+// Filter a line with the single precision method, scratch has room for 3
+// lines of floats.
+template <typename Stats>
+inline void floatMeanLine(const quint8 *const *window, int pixelStride,
+                          int kh, int width, int radius,
+                          const Stats &stats,
+                          MeanSimd simd, float *scratch,
+                          quint8 *out, int outStride)
+{
+    float *means = scratch;
+    float *gains = means + width;
+    float *averages = gains + width;
+
+    // A gain of 0 marks the flat windows, their output is the mean.
+    for (int x = 0; x < width; x++) {
+        int xp = qMax(x - radius, 0);
+        int kw = qMin(x + radius, width - 1) - xp + 1;
+        qreal mean;
+        qreal dev;
+        stats(xp, kw, &mean, &dev);
+        means[x] = float(mean);
+        gains[x] = dev > 0? float(-0.5 / (dev * dev)): 0.f;
+    }
+
+    // The SIMD versions average the pixels in [start, end).
+    int start = qMin(radius, width);
+    int end = start;
+
+#ifdef MEAN_SIMD
+    if (pixelStride == 1) {
+        if (simd == MeanSimdAVX2)
+            end = floatMeanAVX2(window, kh, radius, start, width - radius,
+                                means, gains, averages);
+        else if (simd == MeanSimdSSE2)
+            end = floatMeanSSE2(window, kh, radius, start, width - radius,
+                                means, gains, averages);
+    }
+#else
+    Q_UNUSED(simd)
+#endif
+
+    auto average = [&] (int x) {
+        int xp = qMax(x - radius, 0);
+        int kw = qMin(x + radius, width - 1) - xp + 1;
+        averages[x] = floatAverage(window, pixelStride, xp, kw, kh,
+                                   means[x], gains[x]);
+    };
+
+    for (int x = 0; x < start; x++)
+        average(x);
+
+    for (int x = end; x < width; x++)
+        average(x);
+
+    for (int x = 0; x < width; x++)
+        out[x * outStride] = quint8(gains[x] < 0? averages[x]: means[x]);
+}
+
+// Filter a line. window are the lines of the window clipped to the image,
+// and stats(xp, kw, &mean, &dev) gives the statistics of the window of
+// each pixel. scratch is only used by the single precision method.
+template <typename Stats>
+inline void meanLine(const quint8 *const *window, int pixelStride, int kh,
+                     int width, int radius, MeanMethod method,
+                     WindowHistogram &histogram,
+                     MeanSimd simd, float *scratch,
+                     const Stats &stats,
+                     quint8 *out, int outStride)
+{
+    if (method == MeanMethodFloat) {
+        floatMeanLine(window, pixelStride, kh, width, radius, stats,
+                      simd, scratch, out, outStride);
+
+        return;
+    }
+
+    if (method == MeanMethodHistogram) {
+        histogram.clear();
+
+        for (int x = 0; x <= qMin(radius, width - 1); x++)
+            histogram.addColumn(window, x * pixelStride, kh, 1);
+    }
+
+    for (int x = 0; x < width; x++) {
+        int xp = qMax(x - radius, 0);
+        int kw = qMin(x + radius, width - 1) - xp + 1;
+
+        qreal mean;
+        qreal dev;
+        stats(xp, kw, &mean, &dev);
+
+        qreal sumP = 0;
+
+        if (method == MeanMethodHistogram) {
+            sumP = histogram.average(mean, dev);
+
+            // Slide the window.
+            if (x + radius + 1 < width)
+                histogram.addColumn(window, (x + radius + 1) * pixelStride,
+                                    kh, 1);
+
+            if (x - radius >= 0)
+                histogram.addColumn(window, (x - radius) * pixelStride,
+                                    kh, -1);
+        } else {
+            sumP = directAverage(window, pixelStride, xp, kw, kh, mean, dev);
+        }
+
+        out[x * outStride] = quint8(sumP);
+    }
+}
+
+// Line by line version, the sums of the window are calculated from the sums
+// of its columns instead of an integral image.
+class MeanLines: public DenoiseLineFilter
+{
+    public:
+        MeanLines(int width, int height,
+                  int radius, int mu, qreal sigma, MeanMethod method):
+            DenoiseLineFilter(width, height, radius),
+            mu(mu),
+            sigma(sigma),
+            method(method),
+            simd(meanSimd()),
+            sums(width),
+            sums2(width),
+            scratch(method == MeanMethodFloat? 3 * width: 0)
+        {
+        }
+
+        qint64 bufferSize() const
+        {
+            return (this->sums.size() + this->sums2.size())
+                   * qint64(sizeof(quint32))
+                 + this->scratch.size() * qint64(sizeof(float))
+                 + qint64(sizeof(WindowHistogram));
+        }
+
+        void filterLine(const quint8 *const *lines, int y, bool first,
+                        quint8 *out)
+        {
+            Q_UNUSED(first)
+            int width = this->width;
+            int kh = qMin(y + this->radius, this->height - 1)
+                     - qMax(y - this->radius, 0) + 1;
+            quint32 *sums = this->sums.data();
+            quint32 *sums2 = this->sums2.data();
+
+            for (int x = 0; x < width; x++) {
+                sums[x] = 0;
+                sums2[x] = 0;
+            }
+
+            for (int j = 0; j < kh; j++)
+                for (int x = 0; x < width; x++) {
+                    quint32 pixel = lines[j][x];
+                    sums[x] += pixel;
+                    sums2[x] += pixel * pixel;
+                }
+
+            // The windows are visited from left to right, each one adds the
+            // column entering the window and removes the one leaving it.
+            int mu = this->mu;
+            qreal sigma = this->sigma;
+            int left = 0;
+            int right = -1;
+            quint32 sum = 0;
+            quint64 sum2 = 0;
+
+            auto stats = [&] (int xp, int kw, qreal *mean, qreal *dev) {
+                for (; right < xp + kw - 1; right++) {
+                    sum += sums[right + 1];
+                    sum2 += sums2[right + 1];
+                }
+
+                for (; left < xp; left++) {
+                    sum -= sums[left];
+                    sum2 -= sums2[left];
+                }
+
+                windowStats(sum, sum2, quint32(kw * kh), mu, sigma, mean, dev);
+            };
+
+            meanLine(lines, 1, kh, width, this->radius, this->method,
+                     this->histogram, this->simd, this->scratch.data(),
+                     stats, out, 1);
+        }
+
+    private:
+        int mu;
+        qreal sigma;
+        MeanMethod method;
+        MeanSimd simd;
+        QVector<quint32> sums;
+        QVector<quint32> sums2;
+        QVector<float> scratch;
+        WindowHistogram histogram;
+};
+
+MeanFilter::MeanFilter(TileScheduler *scheduler):
+    DenoiseFilter(scheduler),
+    radius(3),
+    mu(0),
+    sigma(1),
+    method(MeanMethodDirect),
+    tiledIntegral(true),
+    tunedMethod(MeanMethodDirect),
+    integralSample(DenoiseSampleUInt8)
+{
+}
+
+MeanMethod MeanFilter::currentMethod() const
+{
+    return this->tuner? this->tunedMethod: this->method;
+}
+
+qint64 MeanFilter::integralSize() const
+{
+    switch (this->integralSample) {
+    case DenoiseSampleUInt16:
+        return this->integral16.size();
+    case DenoiseSampleFloat:
+        return this->integralFloat.size();
+    default:
+        return this->tiledIntegral?
+                    this->tiles.size(): this->integral.size();
+    }
+}
+
+qint64 MeanFilter::bufferSize() const
+{
+    return DenoiseFilter::bufferSize()
+         + this->tiles.size()
+         + this->integral.size()
+         + this->integral16.size()
+         + this->integralFloat.size();
+}
+
+int MeanFilter::borderSize() const
+{
+    return this->radius;
+}
+
+void MeanFilter::tune(const DenoiseTuner &tuner, const DenoiseImage &image)
+{
+    this->tunedMethod = this->method;
+
+    // Only the 8 bits samples have the histogram and the float methods.
+    if (image.sample() != DenoiseSampleUInt8)
+        return;
+
+    QSize size(image.width, image.height);
+    qreal direct = tuner.cost("mean/direct", this->radius, size);
+    qreal histogram = tuner.cost("mean/histogram", this->radius, size);
+
+    if (direct < 0 || histogram < 0)
+        return;
+
+    // The histogram and the float methods change some pixels by 1 level.
+    this->tunedMethod = histogram < direct && tuner.maxError >= 1?
+                            MeanMethodHistogram: MeanMethodDirect;
+
+    qreal cost = tuner.cost("mean/float", this->radius, size);
+
+    if (tuner.maxError >= 1 && cost >= 0 && cost < qMin(direct, histogram))
+        this->tunedMethod = MeanMethodFloat;
+}
+
+void MeanFilter::filter(const DenoiseChannel &in, const DenoiseChannel &out)
+{
+    this->integralSample = DenoiseSampleUInt8;
+    DenoiseTraceScope stage("mean/integral");
+
+    if (this->tiledIntegral) {
+        this->tiles.update(in);
+        stage.next("mean/average");
+        this->adaptiveMean(in, out, this->tiles);
+    } else {
+        this->integral.update(in);
+        stage.next("mean/average");
+        this->adaptiveMean(in, out, this->integral);
+    }
+}
+
+template <typename Integral>
+void MeanFilter::adaptiveMean(const DenoiseChannel &in,
+                              const DenoiseChannel &out,
+                              const Integral &integral)
+{
+    int width = in.width;
+    int height = in.height;
+    int radius = this->radius;
+    int mu = this->mu;
+    qreal sigma = this->sigma;
+    MeanMethod method = this->currentMethod();
+    MeanSimd simd = meanSimd();
+    ScratchArena *arenas = this->workerScratch();
+
+    this->scheduler->runLines(QSize(width, height), radius,
+                              [&] (const Tile &tile, int worker) {
+        // Each worker slides its own histogram.
+        ScratchArena &arena = arenas[worker];
+        arena.reset();
+        WindowHistogram *histogram =
+                new (arena.allocate<WindowHistogram>(1)) WindowHistogram;
+        const quint8 **window = arena.allocate<const quint8 *>(2 * radius + 1);
+        float *scratch = method == MeanMethodFloat?
+                             arena.allocate<float>(3 * width): 0;
+
+        for (int y = tile.rect.top(); y <= tile.rect.bottom(); y++) {
+            int yp = qMax(y - radius, 0);
+            int kh = qMin(y + radius, height - 1) - yp + 1;
+
+            for (int j = 0; j < kh; j++)
+                window[j] = in.line(yp + j);
+
+            auto stats = [&] (int xp, int kw, qreal *mean, qreal *dev) {
+                windowStats(integral.sum(xp, yp, kw, kh),
+                            integral.sum2(xp, yp, kw, kh),
+                            quint32(kw * kh),
+                            mu, sigma,
+                            mean, dev);
+            };
+
+            meanLine(window, in.pixelStride, kh,
+                     width, radius, method,
+                     *histogram, simd, scratch, stats,
+                     out.line(y), out.pixelStride);
+        }
+    });
+}
+
+void MeanFilter::filter(const DenoiseChannel16 &in,
+                        const DenoiseChannel16 &out)
+{
+    // The sums of the 16 bits samples doesn't fit in the tiles.
+    this->integralSample = DenoiseSampleUInt16;
+    DenoiseTraceScope stage("mean/integral");
+    this->integral16.update(in);
+    stage.next("mean/average");
+    this->wideMean(in, out, this->integral16);
+}
+
+void MeanFilter::filter(const DenoiseChannelFloat &in,
+                        const DenoiseChannelFloat &out)
+{
+    this->integralSample = DenoiseSampleFloat;
+    DenoiseTraceScope stage("mean/integral");
+    this->integralFloat.update(in);
+    stage.next("mean/average");
+    this->wideMean(in, out, this->integralFloat);
+}
+
+template <typename T, typename Sum>
+void MeanFilter::wideMean(const DenoiseTypedChannel<T> &in,
+                          const DenoiseTypedChannel<T> &out,
+                          const WideIntegralImage<Sum> &integral)
+{
+    int width = in.width;
+    int height = in.height;
+    int radius = this->radius;
+    int mu = this->mu;
+    qreal sigma = this->sigma;
+    ScratchArena *arenas = this->workerScratch();
+
+    // There are too many values for a histogram, the weights are always
+    // evaluated once for each pixel.
+    this->scheduler->runLines(QSize(width, height), radius,
+                              [&] (const Tile &tile, int worker) {
+        ScratchArena &arena = arenas[worker];
+        arena.reset();
+        const T **window = arena.allocate<const T *>(2 * radius + 1);
+
+        for (int y = tile.rect.top(); y <= tile.rect.bottom(); y++) {
+            int yp = qMax(y - radius, 0);
+            int kh = qMin(y + radius, height - 1) - yp + 1;
+            T *oLine = out.line(y);
+
+            for (int j = 0; j < kh; j++)
+                window[j] = in.line(yp + j);
+
+            for (int x = 0; x < width; x++) {
+                int xp = qMax(x - radius, 0);
+                int kw = qMin(x + radius, width - 1) - xp + 1;
+                qreal mean;
+                qreal dev;
+                wideWindowStats<T>(integral.sum(xp, yp, kw, kh),
+                                   integral.sum2(xp, yp, kw, kh),
+                                   kw * kh,
+                                   mu, sigma,
+                                   &mean, &dev);
+                qreal average = directAverage(window, in.pixelStride,
+                                              xp, kw, kh,
+                                              mean, dev);
+                oLine[x * out.pixelStride] =
+                        DenoiseSampleTraits<T>::fromReal(average);
+            }
+        }
+    });
+}
+
+DenoiseLineFilter *MeanFilter::createLineFilter(const QSize &size) const
+{
+    return new MeanLines(size.width(), size.height(),
+                         this->radius, this->mu, this->sigma, this->method);
+}
+
+quint64 MeanFilter::lineFilterKey() const
+{
+    return DenoiseKey()
+           << this->radius << this->mu << this->sigma << this->method;
+}
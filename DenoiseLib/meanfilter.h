@@ -0,0 +1,101 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#ifndef MEANFILTER_H
+#define MEANFILTER_H
+
+#include "denoisefilter.h"
+#include "integralimage.h"
+
+enum MeanMethod
+{
+    MeanMethodDirect,
+    MeanMethodHistogram,
+    MeanMethodFloat
+};
+
+// Adaptive mean, each pixel is replaced by the average of the window
+// weighted by the distance to the mean of the window.
+//
+// mu is given in 8 bits levels for all the sample types, and it's scaled to
+// the range of the samples.
+class MeanFilter: public DenoiseFilter
+{
+    public:
+        explicit MeanFilter(TileScheduler *scheduler = 0);
+
+        int radius;
+        int mu;
+        qreal sigma;
+
+        // The histogram method evaluates the weights once for each value
+        // in the window instead of once for each pixel, it's faster for
+        // big radius. It adds the weighted pixels in another order than the
+        // direct method, and after the truncation some pixels change by 1
+        // level, mostly in smooth images. The float method is the direct method in single
+        // precision, with an approximated exp(), averaging 8 (AVX2) or 4
+        // (SSE2) windows at once, and it changes some pixels by 1 level.
+        // The 16 bits and floating point samples always use the direct
+        // method.
+        MeanMethod method;
+
+        // Method used to filter the images, the one picked by the tuner if
+        // it's set, otherwise method.
+        MeanMethod currentMethod() const;
+
+        // The tiled integral images use half the memory of the full frame
+        // ones. Only used with 8 bits samples.
+        bool tiledIntegral;
+
+        // Memory used by the integral images of the last channel filtered.
+        qint64 integralSize() const;
+
+        qint64 bufferSize() const;
+        int borderSize() const;
+        DenoiseLineFilter *createLineFilter(const QSize &size) const;
+        quint64 lineFilterKey() const;
+
+    protected:
+        void tune(const DenoiseTuner &tuner, const DenoiseImage &image);
+        void filter(const DenoiseChannel &in, const DenoiseChannel &out);
+        void filter(const DenoiseChannel16 &in, const DenoiseChannel16 &out);
+        void filter(const DenoiseChannelFloat &in,
+                    const DenoiseChannelFloat &out);
+
+    private:
+        MeanMethod tunedMethod;
+        IntegralImage integral;
+        TiledIntegralImage tiles;
+        WideIntegralImage<quint64> integral16;
+        WideIntegralImage<double> integralFloat;
+        DenoiseSample integralSample;
+
+        template <typename Integral>
+        void adaptiveMean(const DenoiseChannel &in,
+                          const DenoiseChannel &out,
+                          const Integral &integral);
+
+        template <typename T, typename Sum>
+        void wideMean(const DenoiseTypedChannel<T> &in,
+                      const DenoiseTypedChannel<T> &out,
+                      const WideIntegralImage<Sum> &integral);
+};
+
+#endif // MEANFILTER_H
@@ -0,0 +1,1108 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <QtAlgorithms>
+
+#include "denoisetrace.h"
+#include "denoisetuner.h"
+#include "medianfilter.h"
+#include "tilescheduler.h"
+
+#if defined(Q_PROCESSOR_X86) && defined(__SSE2__)
+#include <emmintrin.h>
+#define MEDIAN_SIMD
+#endif
+
+// Filter a channel in tiles, each worker with its own histograms.
+void medianHistogram(const DenoiseChannel &in, const DenoiseChannel &out,
+                     int radius,
+                     QVector<HistogramMedian> &histograms,
+                     TileScheduler &scheduler)
+{
+    histograms.resize(scheduler.threadCount());
+    HistogramMedian *workerHistograms = histograms.data();
+
+    // Wide tiles, so the halo columns are a small part of the tile.
+    QSize tileSize(qMax(512, 16 * radius),
+                   qMax(16, in.height / (4 * scheduler.threadCount())));
+
+    // Any worker can get any tile.
+    int columns = qMin(tileSize.width() + 2 * radius, in.width);
+
+    for (int i = 0; i < histograms.size(); i++) {
+        workerHistograms[i].setRadius(radius);
+        workerHistograms[i].reserveColumns(columns);
+    }
+
+    scheduler.run(QSize(in.width, in.height), tileSize, radius,
+                  [&] (const Tile &tile, int worker) {
+        workerHistograms[worker].filter(in, out, tile.rect);
+    });
+}
+
+// Branchless sort of two values, used as the building block of the sorting
+// networks. The SIMD versions sort 16, 8 or 4 pairs of adjacent pixels at
+// once, depending on the size of the samples.
+template <typename T>
+inline void sort2(T &a, T &b)
+{
+    T min = qMin(a, b);
+    b = qMax(a, b);
+    a = min;
+}
+
+template <typename T, int Size> struct Lanes
+{
+    typedef T Type;
+
+    static inline T load(const T *pixel)
+    {
+        return *pixel;
+    }
+
+    static inline void store(T *pixel, T value)
+    {
+        *pixel = value;
+    }
+};
+
+#ifdef MEDIAN_SIMD
+// Number of samples in a SSE2 register.
+template <typename T> struct SimdLanes
+{
+    static const int size = 16 / int(sizeof(T));
+};
+
+inline void sort2(__m128i &a, __m128i &b)
+{
+    __m128i min = _mm_min_epu8(a, b);
+    b = _mm_max_epu8(a, b);
+    a = min;
+}
+
+// SSE2 only has the minimum and maximum of signed 16 bits words, the words
+// are loaded with the sign bit flipped so the signed order is the same as
+// the unsigned one.
+struct BiasedWords
+{
+    __m128i words;
+};
+
+inline void sort2(BiasedWords &a, BiasedWords &b)
+{
+    __m128i min = _mm_min_epi16(a.words, b.words);
+    b.words = _mm_max_epi16(a.words, b.words);
+    a.words = min;
+}
+
+inline void sort2(__m128 &a, __m128 &b)
+{
+    __m128 min = _mm_min_ps(a, b);
+    b = _mm_max_ps(a, b);
+    a = min;
+}
+
+template <> struct Lanes<quint8, 16>
+{
+    typedef __m128i Type;
+
+    static inline __m128i load(const quint8 *pixel)
+    {
+        return _mm_loadu_si128((const __m128i *) pixel);
+    }
+
+    static inline void store(quint8 *pixel, __m128i value)
+    {
+        _mm_storeu_si128((__m128i *) pixel, value);
+    }
+};
+
+template <> struct Lanes<quint16, 8>
+{
+    typedef BiasedWords Type;
+
+    static inline BiasedWords load(const quint16 *pixel)
+    {
+        BiasedWords value = {
+            _mm_xor_si128(_mm_loadu_si128((const __m128i *) pixel),
+                          _mm_set1_epi16(qint16(0x8000)))
+        };
+
+        return value;
+    }
+
+    static inline void store(quint16 *pixel, const BiasedWords &value)
+    {
+        _mm_storeu_si128((__m128i *) pixel,
+                         _mm_xor_si128(value.words,
+                                       _mm_set1_epi16(qint16(0x8000))));
+    }
+};
+
+template <> struct Lanes<float, 4>
+{
+    typedef __m128 Type;
+
+    static inline __m128 load(const float *pixel)
+    {
+        return _mm_loadu_ps(pixel);
+    }
+
+    static inline void store(float *pixel, __m128 value)
+    {
+        _mm_storeu_ps(pixel, value);
+    }
+};
+#endif
+
+// Sorting networks that selects the median of a (2 * Radius + 1) ^ 2 window.
+// The window is given column by column, if sortedColumns is true, each
+// column must be sorted with sortColumn() first, since adjacent windows
+// shares the columns, they are sorted only once.
+//
+// The networks for 3x3 and 5x5 windows are taken from:
+//
+// N. Devillard, "Fast median search: an ANSI C implementation", 1998.
+template <int Radius> struct MedianNetwork;
+
+template <> struct MedianNetwork<1>
+{
+    static const bool sortedColumns = false;
+
+    template <typename T> static inline void sortColumn(T *p)
+    {
+        Q_UNUSED(p)
+    }
+
+    template <typename T> static inline T median(T *p)
+    {
+        sort2(p[1], p[2]); sort2(p[4], p[5]); sort2(p[7], p[8]);
+        sort2(p[0], p[1]); sort2(p[3], p[4]); sort2(p[6], p[7]);
+        sort2(p[1], p[2]); sort2(p[4], p[5]); sort2(p[7], p[8]);
+        sort2(p[0], p[3]); sort2(p[5], p[8]); sort2(p[4], p[7]);
+        sort2(p[3], p[6]); sort2(p[1], p[4]); sort2(p[2], p[5]);
+        sort2(p[4], p[7]); sort2(p[4], p[2]); sort2(p[6], p[4]);
+        sort2(p[4], p[2]);
+
+        return p[4];
+    }
+};
+
+template <> struct MedianNetwork<2>
+{
+    static const bool sortedColumns = false;
+
+    template <typename T> static inline void sortColumn(T *p)
+    {
+        Q_UNUSED(p)
+    }
+
+    template <typename T> static inline T median(T *p)
+    {
+        sort2(p[0], p[1]);   sort2(p[3], p[4]);   sort2(p[2], p[4]);
+        sort2(p[2], p[3]);   sort2(p[6], p[7]);   sort2(p[5], p[7]);
+        sort2(p[5], p[6]);   sort2(p[9], p[10]);  sort2(p[8], p[10]);
+        sort2(p[8], p[9]);   sort2(p[12], p[13]); sort2(p[11], p[13]);
+        sort2(p[11], p[12]); sort2(p[15], p[16]); sort2(p[14], p[16]);
+        sort2(p[14], p[15]); sort2(p[18], p[19]); sort2(p[17], p[19]);
+        sort2(p[17], p[18]); sort2(p[21], p[22]); sort2(p[20], p[22]);
+        sort2(p[20], p[21]); sort2(p[23], p[24]); sort2(p[2], p[5]);
+        sort2(p[3], p[6]);   sort2(p[0], p[6]);   sort2(p[0], p[3]);
+        sort2(p[4], p[7]);   sort2(p[1], p[7]);   sort2(p[1], p[4]);
+        sort2(p[11], p[14]); sort2(p[8], p[14]);  sort2(p[8], p[11]);
+        sort2(p[12], p[15]); sort2(p[9], p[15]);  sort2(p[9], p[12]);
+        sort2(p[13], p[16]); sort2(p[10], p[16]); sort2(p[10], p[13]);
+        sort2(p[20], p[23]); sort2(p[17], p[23]); sort2(p[17], p[20]);
+        sort2(p[21], p[24]); sort2(p[18], p[24]); sort2(p[18], p[21]);
+        sort2(p[19], p[22]); sort2(p[8], p[17]);  sort2(p[9], p[18]);
+        sort2(p[0], p[18]);  sort2(p[0], p[9]);   sort2(p[10], p[19]);
+        sort2(p[1], p[19]);  sort2(p[1], p[10]);  sort2(p[11], p[20]);
+        sort2(p[2], p[20]);  sort2(p[2], p[11]);  sort2(p[12], p[21]);
+        sort2(p[3], p[21]);  sort2(p[3], p[12]);  sort2(p[13], p[22]);
+        sort2(p[4], p[22]);  sort2(p[4], p[13]);  sort2(p[14], p[23]);
+        sort2(p[5], p[23]);  sort2(p[5], p[14]);  sort2(p[15], p[24]);
+        sort2(p[6], p[24]);  sort2(p[6], p[15]);  sort2(p[7], p[16]);
+        sort2(p[7], p[19]);  sort2(p[13], p[21]); sort2(p[15], p[23]);
+        sort2(p[7], p[13]);  sort2(p[7], p[15]);  sort2(p[1], p[9]);
+        sort2(p[3], p[11]);  sort2(p[5], p[17]);  sort2(p[11], p[17]);
+        sort2(p[9], p[17]);  sort2(p[4], p[10]);  sort2(p[6], p[12]);
+        sort2(p[7], p[14]);  sort2(p[4], p[6]);   sort2(p[4], p[7]);
+        sort2(p[12], p[14]); sort2(p[10], p[14]); sort2(p[6], p[7]);
+        sort2(p[10], p[12]); sort2(p[6], p[10]);  sort2(p[6], p[17]);
+        sort2(p[12], p[17]); sort2(p[7], p[17]);  sort2(p[7], p[10]);
+        sort2(p[12], p[18]); sort2(p[7], p[12]);  sort2(p[10], p[18]);
+        sort2(p[12], p[20]); sort2(p[10], p[20]); sort2(p[10], p[12]);
+
+        return p[12];
+    }
+};
+
+// The 7x7 network is Batcher's odd-even merge sort, with the comparators
+// that can't change the median, given that the columns are already sorted,
+// removed. The removed comparators were verified with the 0-1 principle
+// against all the inputs with sorted columns.
+template <> struct MedianNetwork<3>
+{
+    static const bool sortedColumns = true;
+
+    template <typename T> static inline void sortColumn(T *p)
+    {
+        sort2(p[0], p[6]); sort2(p[2], p[3]); sort2(p[4], p[5]);
+        sort2(p[0], p[2]); sort2(p[1], p[4]); sort2(p[3], p[6]);
+        sort2(p[0], p[1]); sort2(p[2], p[5]); sort2(p[3], p[4]);
+        sort2(p[1], p[2]); sort2(p[4], p[6]); sort2(p[2], p[3]);
+        sort2(p[4], p[5]); sort2(p[1], p[2]); sort2(p[3], p[4]);
+        sort2(p[5], p[6]);
+    }
+
+    template <typename T> static inline T median(T *p)
+    {
+        sort2(p[6], p[7]);    sort2(p[20], p[21]);  sort2(p[34], p[35]);
+        sort2(p[4], p[6]);    sort2(p[12], p[14]);  sort2(p[13], p[15]);
+        sort2(p[21], p[23]);  sort2(p[32], p[34]);  sort2(p[40], p[42]);
+        sort2(p[41], p[43]);  sort2(p[21], p[22]);  sort2(p[33], p[34]);
+        sort2(p[0], p[4]);    sort2(p[8], p[12]);   sort2(p[9], p[13]);
+        sort2(p[16], p[20]);  sort2(p[17], p[21]);  sort2(p[18], p[22]);
+        sort2(p[24], p[28]);  sort2(p[25], p[29]);  sort2(p[26], p[30]);
+        sort2(p[27], p[31]);  sort2(p[33], p[37]);  sort2(p[34], p[38]);
+        sort2(p[35], p[39]);  sort2(p[42], p[46]);  sort2(p[43], p[47]);
+        sort2(p[2], p[4]);    sort2(p[10], p[12]);  sort2(p[11], p[13]);
+        sort2(p[18], p[20]);  sort2(p[19], p[21]);  sort2(p[26], p[28]);
+        sort2(p[27], p[29]);  sort2(p[34], p[36]);  sort2(p[35], p[37]);
+        sort2(p[42], p[44]);  sort2(p[43], p[45]);  sort2(p[1], p[2]);
+        sort2(p[3], p[4]);    sort2(p[5], p[6]);    sort2(p[9], p[10]);
+        sort2(p[11], p[12]);  sort2(p[13], p[14]);  sort2(p[17], p[18]);
+        sort2(p[19], p[20]);  sort2(p[21], p[22]);  sort2(p[25], p[26]);
+        sort2(p[27], p[28]);  sort2(p[29], p[30]);  sort2(p[33], p[34]);
+        sort2(p[35], p[36]);  sort2(p[37], p[38]);  sort2(p[41], p[42]);
+        sort2(p[43], p[44]);  sort2(p[45], p[46]);  sort2(p[0], p[8]);
+        sort2(p[1], p[9]);    sort2(p[2], p[10]);   sort2(p[3], p[11]);
+        sort2(p[4], p[12]);   sort2(p[5], p[13]);   sort2(p[6], p[14]);
+        sort2(p[7], p[15]);   sort2(p[16], p[24]);  sort2(p[17], p[25]);
+        sort2(p[18], p[26]);  sort2(p[19], p[27]);  sort2(p[20], p[28]);
+        sort2(p[21], p[29]);  sort2(p[22], p[30]);  sort2(p[23], p[31]);
+        sort2(p[32], p[40]);  sort2(p[33], p[41]);  sort2(p[34], p[42]);
+        sort2(p[35], p[43]);  sort2(p[36], p[44]);  sort2(p[37], p[45]);
+        sort2(p[38], p[46]);  sort2(p[39], p[47]);  sort2(p[4], p[8]);
+        sort2(p[5], p[9]);    sort2(p[6], p[10]);   sort2(p[7], p[11]);
+        sort2(p[20], p[24]);  sort2(p[21], p[25]);  sort2(p[22], p[26]);
+        sort2(p[23], p[27]);  sort2(p[36], p[40]);  sort2(p[37], p[41]);
+        sort2(p[38], p[42]);  sort2(p[39], p[43]);  sort2(p[2], p[4]);
+        sort2(p[3], p[5]);    sort2(p[6], p[8]);    sort2(p[7], p[9]);
+        sort2(p[10], p[12]);  sort2(p[11], p[13]);  sort2(p[18], p[20]);
+        sort2(p[19], p[21]);  sort2(p[22], p[24]);  sort2(p[23], p[25]);
+        sort2(p[26], p[28]);  sort2(p[27], p[29]);  sort2(p[34], p[36]);
+        sort2(p[35], p[37]);  sort2(p[38], p[40]);  sort2(p[39], p[41]);
+        sort2(p[42], p[44]);  sort2(p[43], p[45]);  sort2(p[1], p[2]);
+        sort2(p[3], p[4]);    sort2(p[5], p[6]);    sort2(p[7], p[8]);
+        sort2(p[9], p[10]);   sort2(p[11], p[12]);  sort2(p[13], p[14]);
+        sort2(p[17], p[18]);  sort2(p[19], p[20]);  sort2(p[21], p[22]);
+        sort2(p[23], p[24]);  sort2(p[25], p[26]);  sort2(p[27], p[28]);
+        sort2(p[29], p[30]);  sort2(p[43], p[44]);  sort2(p[45], p[46]);
+        sort2(p[0], p[16]);   sort2(p[1], p[17]);   sort2(p[2], p[18]);
+        sort2(p[3], p[19]);   sort2(p[4], p[20]);   sort2(p[5], p[21]);
+        sort2(p[6], p[22]);   sort2(p[7], p[23]);   sort2(p[8], p[24]);
+        sort2(p[9], p[25]);   sort2(p[10], p[26]);  sort2(p[11], p[27]);
+        sort2(p[12], p[28]);  sort2(p[13], p[29]);  sort2(p[14], p[30]);
+        sort2(p[15], p[31]);  sort2(p[8], p[16]);   sort2(p[9], p[17]);
+        sort2(p[10], p[18]);  sort2(p[11], p[19]);  sort2(p[12], p[20]);
+        sort2(p[13], p[21]);  sort2(p[14], p[22]);  sort2(p[15], p[23]);
+        sort2(p[40], p[48]);  sort2(p[4], p[8]);    sort2(p[5], p[9]);
+        sort2(p[6], p[10]);   sort2(p[7], p[11]);   sort2(p[12], p[16]);
+        sort2(p[13], p[17]);  sort2(p[14], p[18]);  sort2(p[15], p[19]);
+        sort2(p[20], p[24]);  sort2(p[21], p[25]);  sort2(p[22], p[26]);
+        sort2(p[23], p[27]);  sort2(p[44], p[48]);  sort2(p[6], p[8]);
+        sort2(p[7], p[9]);    sort2(p[10], p[12]);  sort2(p[11], p[13]);
+        sort2(p[14], p[16]);  sort2(p[15], p[17]);  sort2(p[18], p[20]);
+        sort2(p[19], p[21]);  sort2(p[22], p[24]);  sort2(p[23], p[25]);
+        sort2(p[38], p[40]);  sort2(p[42], p[44]);  sort2(p[46], p[48]);
+        sort2(p[7], p[8]);    sort2(p[9], p[10]);   sort2(p[11], p[12]);
+        sort2(p[13], p[14]);  sort2(p[15], p[16]);  sort2(p[17], p[18]);
+        sort2(p[19], p[20]);  sort2(p[21], p[22]);  sort2(p[23], p[24]);
+        sort2(p[33], p[34]);  sort2(p[35], p[36]);  sort2(p[37], p[38]);
+        sort2(p[39], p[40]);  sort2(p[41], p[42]);  sort2(p[43], p[44]);
+        sort2(p[45], p[46]);  sort2(p[47], p[48]);  sort2(p[7], p[39]);
+        sort2(p[8], p[40]);   sort2(p[9], p[41]);   sort2(p[10], p[42]);
+        sort2(p[11], p[43]);  sort2(p[12], p[44]);  sort2(p[13], p[45]);
+        sort2(p[14], p[46]);  sort2(p[15], p[47]);  sort2(p[16], p[48]);
+        sort2(p[16], p[32]);  sort2(p[17], p[33]);  sort2(p[18], p[34]);
+        sort2(p[19], p[35]);  sort2(p[20], p[36]);  sort2(p[21], p[37]);
+        sort2(p[22], p[38]);  sort2(p[23], p[39]);  sort2(p[24], p[40]);
+        sort2(p[25], p[41]);  sort2(p[26], p[42]);  sort2(p[27], p[43]);
+        sort2(p[12], p[20]);  sort2(p[13], p[21]);  sort2(p[14], p[22]);
+        sort2(p[15], p[23]);  sort2(p[24], p[32]);  sort2(p[25], p[33]);
+        sort2(p[26], p[34]);  sort2(p[27], p[35]);  sort2(p[20], p[24]);
+        sort2(p[21], p[25]);  sort2(p[22], p[26]);  sort2(p[23], p[27]);
+        sort2(p[22], p[24]);  sort2(p[23], p[25]);  sort2(p[23], p[24]);
+
+        return p[24];
+    }
+};
+
+// Median of the clipped window around x, used at the borders. lines are the
+// kh lines of the window clipped to the image.
+template <typename T>
+inline T clippedMedian(const T *const *lines, int pixelStride,
+                       int kh, int width,
+                       int x, int radius, T *window)
+{
+    int xp = qMax(x - radius, 0);
+    int kw = qMin(x + radius, width - 1) - xp + 1;
+
+    for (int j = 0; j < kh; j++) {
+        const T *line = lines[j] + xp * pixelStride;
+
+        for (int i = 0; i < kw; i++)
+            window[i + j * kw] = line[i * pixelStride];
+    }
+
+    qSort(window, window + kw * kh);
+
+    return window[kw * kh / 2];
+}
+
+// Sort the columns of the window lines, Size columns at once.
+template <int Radius, int Size, typename T>
+inline int sortColumns(const T *const *src, T *const *dst,
+                       int xMin, int xMax)
+{
+    const int kw = 2 * Radius + 1;
+    typename Lanes<T, Size>::Type column[kw];
+    int x = xMin;
+
+    for (; x + Size <= xMax; x += Size) {
+        for (int j = 0; j < kw; j++)
+            column[j] = Lanes<T, Size>::load(src[j] + x);
+
+        MedianNetwork<Radius>::sortColumn(column);
+
+        for (int j = 0; j < kw; j++)
+            Lanes<T, Size>::store(dst[j] + x, column[j]);
+    }
+
+    return x;
+}
+
+// Filter the pixels in [xMin, xMax) of a line in the interior of the image,
+// Size pixels at once. src are the window lines.
+template <int Radius, int Size, typename T>
+inline int networkLine(const T *const *src, T *dst,
+                       int xMin, int xMax)
+{
+    const int kw = 2 * Radius + 1;
+    typename Lanes<T, Size>::Type window[kw * kw];
+    int x = xMin;
+
+    for (; x + Size <= xMax; x += Size) {
+        for (int i = 0; i < kw; i++)
+            for (int j = 0; j < kw; j++)
+                window[j + i * kw] = Lanes<T, Size>::load(src[j] + x - Radius + i);
+
+        Lanes<T, Size>::store(dst + x, MedianNetwork<Radius>::median(window));
+    }
+
+    return x;
+}
+
+// Filter a line with the sorting network. lines are the kh lines of the
+// window clipped to the image, the lines of the interior windows must have
+// consecutive pixels. sortedLines is scratch space for the sorted columns.
+template <int Radius, typename T>
+inline void networkRow(const T *const *lines, int pixelStride,
+                       int kh, int width,
+                       T *oLine,
+                       T *const *sortedLines)
+{
+    const int kw = 2 * Radius + 1;
+    T window[kw * kw];
+
+    // Clipped windows at the top and bottom.
+    if (kh < kw) {
+        for (int x = 0; x < width; x++)
+            oLine[x] = clippedMedian(lines, pixelStride, kh, width,
+                                     x, Radius, window);
+
+        return;
+    }
+
+    int xMin = qMin(Radius, width);
+    int xMax = qMax(width - Radius, xMin);
+
+    // Clipped windows at the left and right.
+    for (int x = 0; x < xMin; x++)
+        oLine[x] = clippedMedian(lines, 1, kh, width, x, Radius, window);
+
+    for (int x = xMax; x < width; x++)
+        oLine[x] = clippedMedian(lines, 1, kh, width, x, Radius, window);
+
+    const T *const *src = lines;
+    int x = 0;
+
+    if (MedianNetwork<Radius>::sortedColumns) {
+#ifdef MEDIAN_SIMD
+        x = sortColumns<Radius, SimdLanes<T>::size>(src, sortedLines,
+                                                    0, width);
+#endif
+        sortColumns<Radius, 1>(src, sortedLines, x, width);
+        src = sortedLines;
+    }
+
+    x = xMin;
+
+#ifdef MEDIAN_SIMD
+    x = networkLine<Radius, SimdLanes<T>::size>(src, oLine, x, xMax);
+#endif
+
+    networkLine<Radius, 1>(src, oLine, x, xMax);
+}
+
+template <int Radius, typename T>
+void medianNetwork(const DenoiseTypedChannel<T> &in,
+                   const DenoiseTypedChannel<T> &out,
+                   ScratchArena *arenas,
+                   TileScheduler &scheduler)
+{
+    const int kw = 2 * Radius + 1;
+    int width = in.width;
+    int height = in.height;
+
+    scheduler.runLines(QSize(width, height), Radius,
+                       [&] (const Tile &tile, int worker) {
+        // Each worker has a ring with the last window lines of the channel,
+        // the sorted columns, and an output line. The ring is only used if
+        // the samples are not consecutive.
+        ScratchArena &arena = arenas[worker];
+        arena.reset();
+        T *ring = arena.allocate<T>((2 * kw + 1) * width);
+        T *sorted = ring + kw * width;
+        T *buffer = sorted + kw * width;
+        const T *windowLines[kw];
+        T *sortedLines[kw];
+        int lastLine = -1;
+
+        for (int j = 0; j < kw; j++)
+            sortedLines[j] = sorted + j * width;
+
+        for (int y = tile.rect.top(); y <= tile.rect.bottom(); y++) {
+            T *oLine = out.pixelStride == 1? out.line(y): buffer;
+            int yp = qMax(y - Radius, 0);
+            int kh = qMin(y + Radius, height - 1) - yp + 1;
+            int pixelStride = in.pixelStride;
+
+            for (int j = 0; j < kh; j++) {
+                int line = yp + j;
+                windowLines[j] = in.line(line);
+
+                if (in.pixelStride == 1 || kh < kw)
+                    continue;
+
+                // Only the line entering the window is copied.
+                T *ringLine = ring + (line % kw) * width;
+
+                if (line > lastLine) {
+                    const T *iLine = in.line(line);
+
+                    for (int x = 0; x < width; x++)
+                        ringLine[x] = iLine[x * in.pixelStride];
+
+                    lastLine = line;
+                }
+
+                windowLines[j] = ringLine;
+                pixelStride = 1;
+            }
+
+            networkRow<Radius>(windowLines, pixelStride, kh, width,
+                               oLine, sortedLines);
+
+            if (out.pixelStride != 1) {
+                T *dst = out.line(y);
+
+                for (int x = 0; x < width; x++)
+                    dst[x * out.pixelStride] = buffer[x];
+            }
+        }
+    });
+}
+
+// Sort the whole window of each pixel.
+template <typename T>
+void medianSort(const DenoiseTypedChannel<T> &in,
+                const DenoiseTypedChannel<T> &out,
+                int radius,
+                ScratchArena *arenas,
+                TileScheduler &scheduler)
+{
+    int kw = 2 * radius + 1;
+
+    scheduler.runLines(QSize(in.width, in.height), radius,
+                       [&] (const Tile &tile, int worker) {
+        // Each worker sorts in its own window.
+        ScratchArena &arena = arenas[worker];
+        arena.reset();
+        T *window = arena.allocate<T>(kw * kw);
+        const T **lines = arena.allocate<const T *>(kw);
+
+        for (int y = tile.rect.top(); y <= tile.rect.bottom(); y++) {
+            int yp = qMax(y - radius, 0);
+            int kh = qMin(y + radius, in.height - 1) - yp + 1;
+
+            for (int j = 0; j < kh; j++)
+                lines[j] = in.line(yp + j);
+
+            for (int x = 0; x < in.width; x++)
+                out.pixel(x, y) = clippedMedian(lines,
+                                                in.pixelStride,
+                                                kh, in.width,
+                                                x, radius, window);
+        }
+    });
+}
+
+// Switching median, only the impulses are replaced by the median of their
+// window, the other pixels are copied.
+//
+// The detector marks a pixel as an impulse if it's more than threshold
+// away from the median of its 3x3 window, calculated for all the pixels
+// with the sorting network. The median of an impulse is calculated with the
+// pixels of the window that are not impulses, or with the whole window if
+// all of them are. Returns the number of impulses.
+template <typename T>
+qint64 medianSwitching(const DenoiseTypedChannel<T> &in,
+                       const DenoiseTypedChannel<T> &out,
+                       int radius,
+                       T threshold,
+                       QVector<quint8> &impulses,
+                       ScratchArena &shared,
+                       ScratchArena *arenas,
+                       TileScheduler &scheduler)
+{
+    int width = in.width;
+    int height = in.height;
+    QSize size(width, height);
+    int workers = scheduler.threadCount();
+    impulses.resize(width * height);
+    quint8 *mask = impulses.data();
+    qint64 *counts = shared.allocate<qint64>(workers);
+
+    for (int i = 0; i < workers; i++)
+        counts[i] = 0;
+
+    // The estimation of the median is written to out, and replaced by the
+    // input for the pixels that are not impulses.
+    medianNetwork<1>(in, out, arenas, scheduler);
+
+    scheduler.runLines(size, 0, [&] (const Tile &tile, int worker) {
+        for (int y = tile.rect.top(); y <= tile.rect.bottom(); y++) {
+            const T *line = in.line(y);
+            T *oLine = out.line(y);
+            quint8 *mLine = mask + y * width;
+            qint64 count = 0;
+
+            for (int x = 0; x < width; x++) {
+                T pixel = line[x * in.pixelStride];
+                T &median = oLine[x * out.pixelStride];
+                bool impulse = pixel > median + threshold
+                               || pixel + threshold < median;
+                mLine[x] = impulse;
+                count += impulse;
+
+                if (!impulse)
+                    median = pixel;
+            }
+
+            counts[worker] += count;
+        }
+    });
+
+    // Filter the impulses, the lines are scanned for them with memchr().
+    int kw = 2 * radius + 1;
+
+    scheduler.runLines(size, radius, [&] (const Tile &tile, int worker) {
+        ScratchArena &arena = arenas[worker];
+        arena.reset();
+        T *window = arena.allocate<T>(kw * kw);
+
+        for (int y = tile.rect.top(); y <= tile.rect.bottom(); y++) {
+            const quint8 *mLine = mask + y * width;
+            const quint8 *impulse = mLine;
+            int yMin = qMax(y - radius, 0);
+            int yMax = qMin(y + radius, height - 1);
+
+            while ((impulse = static_cast<const quint8 *>(memchr(impulse, 1,
+                                                                 size_t(mLine + width - impulse))))) {
+                int x = int(impulse - mLine);
+                int xMin = qMax(x - radius, 0);
+                int xMax = qMin(x + radius, width - 1);
+                int n = 0;
+
+                for (int j = yMin; j <= yMax; j++) {
+                    const T *line = in.line(j);
+                    const quint8 *mWindow = mask + j * width;
+
+                    for (int i = xMin; i <= xMax; i++)
+                        if (!mWindow[i])
+                            window[n++] = line[i * in.pixelStride];
+                }
+
+                if (n < 1)
+                    for (int j = yMin; j <= yMax; j++) {
+                        const T *line = in.line(j);
+
+                        for (int i = xMin; i <= xMax; i++)
+                            window[n++] = line[i * in.pixelStride];
+                    }
+
+                std::nth_element(window, window + n / 2, window + n);
+                out.pixel(x, y) = window[n / 2];
+                impulse++;
+            }
+        }
+    });
+
+    qint64 detected = 0;
+
+    for (int i = 0; i < workers; i++)
+        detected += counts[i];
+
+    return detected;
+}
+
+// Histogram of the window for 16 bits samples, as described in:
+//
+// T. Huang, G. Yang, G. Tang, "A fast two-dimensional median filtering
+// algorithm", IEEE Transactions on Acoustics, Speech, and Signal Processing
+// 27 (1979) 13-18.
+//
+// The column histograms of HistogramMedian would need 65536 bins for each
+// column, so there is a single histogram for the window, updated with the
+// columns entering and leaving it. The bins are split in 256 coarse bins and
+// 65536 fine bins, the median is found in two short scans.
+class WindowHistogram16
+{
+    public:
+        WindowHistogram16()
+        {
+            memset(this->coarse, 0, sizeof(this->coarse));
+            memset(this->fine, 0, sizeof(this->fine));
+        }
+
+        // Add (sign = 1) or remove (sign = -1) a column of the window,
+        // offset is the position of the column in the lines.
+        inline void addColumn(const quint16 *const *lines, int offset,
+                              int kh, int sign)
+        {
+            for (int j = 0; j < kh; j++) {
+                quint16 pixel = lines[j][offset];
+                this->coarse[pixel >> 8] += sign;
+                this->fine[pixel] += sign;
+            }
+        }
+
+        // Value with the given rank in the sorted window.
+        inline quint16 select(quint32 rank) const
+        {
+            quint32 count = 0;
+            int bin = 0;
+
+            while (count + this->coarse[bin] <= rank)
+                count += this->coarse[bin++];
+
+            const quint32 *fine = this->fine + 256 * bin;
+            int i = 0;
+
+            while (count + fine[i] <= rank)
+                count += fine[i++];
+
+            return quint16(256 * bin + i);
+        }
+
+    private:
+        quint32 coarse[256];
+        quint32 fine[65536];
+};
+
+void medianHistogram16(const DenoiseChannel16 &in,
+                       const DenoiseChannel16 &out,
+                       int radius,
+                       ScratchArena *arenas,
+                       TileScheduler &scheduler)
+{
+    int width = in.width;
+    int height = in.height;
+
+    scheduler.runLines(QSize(width, height), radius,
+                       [&] (const Tile &tile, int worker) {
+        ScratchArena &arena = arenas[worker];
+        arena.reset();
+        WindowHistogram16 *histogram =
+                new (arena.allocate<WindowHistogram16>(1)) WindowHistogram16;
+        const quint16 **lines = arena.allocate<const quint16 *>(2 * radius + 1);
+
+        for (int y = tile.rect.top(); y <= tile.rect.bottom(); y++) {
+            int yp = qMax(y - radius, 0);
+            int kh = qMin(y + radius, height - 1) - yp + 1;
+            quint16 *oLine = out.line(y);
+
+            for (int j = 0; j < kh; j++)
+                lines[j] = in.line(yp + j);
+
+            for (int x = 0; x <= qMin(radius, width - 1); x++)
+                histogram->addColumn(lines, x * in.pixelStride, kh, 1);
+
+            for (int x = 0; x < width; x++) {
+                int xp = qMax(x - radius, 0);
+                int xq = qMin(x + radius, width - 1);
+                quint32 rank = quint32((xq - xp + 1) * kh / 2);
+                oLine[x * out.pixelStride] = histogram->select(rank);
+
+                // Slide the window.
+                if (x + radius + 1 < width)
+                    histogram->addColumn(lines,
+                                         (x + radius + 1) * in.pixelStride,
+                                         kh, 1);
+
+                if (x - radius >= 0)
+                    histogram->addColumn(lines,
+                                         (x - radius) * in.pixelStride,
+                                         kh, -1);
+            }
+
+            // Empty the histogram for the next line.
+            for (int x = qMax(width - radius, 0); x < width; x++)
+                histogram->addColumn(lines, x * in.pixelStride, kh, -1);
+        }
+    });
+}
+
+// Line by line versions of the three methods.
+template <int Radius>
+class MedianNetworkLines: public DenoiseLineFilter
+{
+    public:
+        MedianNetworkLines(int width, int height):
+            DenoiseLineFilter(width, height, Radius),
+            sorted((2 * Radius + 1) * width)
+        {
+            for (int j = 0; j < 2 * Radius + 1; j++)
+                this->sortedLines[j] = this->sorted.data() + j * width;
+        }
+
+        qint64 bufferSize() const
+        {
+            return this->sorted.size();
+        }
+
+        void filterLine(const quint8 *const *lines, int y, bool first,
+                        quint8 *out)
+        {
+            Q_UNUSED(first)
+            int kh = qMin(y + Radius, this->height - 1)
+                     - qMax(y - Radius, 0) + 1;
+            networkRow<Radius>(lines, 1, kh, this->width,
+                               out, this->sortedLines);
+        }
+
+    private:
+        QVector<quint8> sorted;
+        quint8 *sortedLines[2 * Radius + 1];
+};
+
+class MedianHistogramLines: public DenoiseLineFilter
+{
+    public:
+        MedianHistogramLines(int width, int height, int radius):
+            DenoiseLineFilter(width, height, radius),
+            histogram(radius)
+        {
+            // The histograms of all the columns are reserved here, so
+            // bufferSize() counts them.
+            this->histogram.setColumns(width, 0, width - 1);
+        }
+
+        qint64 bufferSize() const
+        {
+            return this->histogram.size();
+        }
+
+        void filterLine(const quint8 *const *lines, int y, bool first,
+                        quint8 *out)
+        {
+            int radius = this->radius;
+            int kh = qMin(y + radius, this->height - 1)
+                     - qMax(y - radius, 0) + 1;
+
+            // The columns move down one line at a time inside of the band.
+            if (first) {
+                this->histogram.setColumns(this->width, 0, this->width - 1);
+
+                for (int j = 0; j < kh; j++)
+                    this->histogram.addLine(lines[j], 1, 1);
+            } else if (y + radius < this->height) {
+                this->histogram.addLine(lines[kh - 1], 1, 1);
+            }
+
+            this->histogram.filterLine(out, 1, 0, this->width - 1, kh);
+
+            // The first line of the window leaves it in the next line, and
+            // it won't be in the ring any more.
+            if (y - radius >= 0)
+                this->histogram.addLine(lines[0], 1, -1);
+        }
+
+    private:
+        HistogramMedian histogram;
+};
+
+class MedianSortLines: public DenoiseLineFilter
+{
+    public:
+        MedianSortLines(int width, int height, int radius):
+            DenoiseLineFilter(width, height, radius),
+            window((2 * radius + 1) * (2 * radius + 1))
+        {
+        }
+
+        qint64 bufferSize() const
+        {
+            return this->window.size();
+        }
+
+        void filterLine(const quint8 *const *lines, int y, bool first,
+                        quint8 *out)
+        {
+            Q_UNUSED(first)
+            int kh = qMin(y + this->radius, this->height - 1)
+                     - qMax(y - this->radius, 0) + 1;
+
+            for (int x = 0; x < this->width; x++)
+                out[x] = clippedMedian(lines, 1, kh, this->width,
+                                       x, this->radius, this->window.data());
+        }
+
+    private:
+        QVector<quint8> window;
+};
+
+MedianFilter::MedianFilter(TileScheduler *scheduler):
+    DenoiseFilter(scheduler),
+    radius(3),
+    method(MedianMethodNetwork),
+    switching(false),
+    impulseThreshold(40),
+    tunedMethod(MedianMethodNetwork),
+    detectedImpulses(0),
+    filteredPixels(0)
+{
+}
+
+MedianMethod MedianFilter::currentMethod() const
+{
+    return this->tuner? this->tunedMethod: this->method;
+}
+
+qreal MedianFilter::impulseFraction() const
+{
+    if (this->filteredPixels < 1)
+        return 0;
+
+    return qreal(this->detectedImpulses) / this->filteredPixels;
+}
+
+qint64 MedianFilter::bufferSize() const
+{
+    qint64 size = DenoiseFilter::bufferSize();
+
+    for (const HistogramMedian &histogram: this->histograms)
+        size += histogram.size();
+
+    return size + this->impulses.size();
+}
+
+int MedianFilter::borderSize() const
+{
+    // The impulses of the window depend on the 3x3 medians around them.
+    if (this->switching)
+        return this->radius + 1;
+
+    return this->radius;
+}
+
+void MedianFilter::tune(const DenoiseTuner &tuner, const DenoiseImage &image)
+{
+    QSize size(image.width, image.height);
+    int radius = this->radius;
+    this->tunedMethod = this->method;
+    qreal best = tuner.cost("median/histogram", radius, size);
+
+    if (best < 0)
+        return;
+
+    this->tunedMethod = MedianMethodHistogram;
+    qreal cost = tuner.cost("median/sort", radius, size);
+
+    if (cost >= 0 && cost < best) {
+        best = cost;
+        this->tunedMethod = MedianMethodSort;
+    }
+
+    cost = tuner.cost("median/network", radius, size);
+
+    if (radius >= 1 && radius <= 3 && cost >= 0 && cost < best)
+        this->tunedMethod = MedianMethodNetwork;
+}
+
+void MedianFilter::begin(const DenoiseImage &image)
+{
+    Q_UNUSED(image)
+    this->detectedImpulses = 0;
+    this->filteredPixels = 0;
+}
+
+void MedianFilter::filter(const DenoiseChannel &in, const DenoiseChannel &out)
+{
+    this->filterTyped(in, out);
+}
+
+void MedianFilter::filter(const DenoiseChannel16 &in,
+                          const DenoiseChannel16 &out)
+{
+    this->filterTyped(in, out);
+}
+
+void MedianFilter::filter(const DenoiseChannelFloat &in,
+                          const DenoiseChannelFloat &out)
+{
+    this->filterTyped(in, out);
+}
+
+template <typename T>
+void MedianFilter::filterTyped(const DenoiseTypedChannel<T> &in,
+                               const DenoiseTypedChannel<T> &out)
+{
+    if (this->switching) {
+        T threshold =
+                DenoiseSampleTraits<T>::bound(this->impulseThreshold
+                                              * DenoiseSampleTraits<T>::maximum()
+                                              / 255);
+        DenoiseTraceScope stage("median/switching");
+        this->detectedImpulses += medianSwitching(in, out,
+                                                  this->radius, threshold,
+                                                  this->impulses,
+                                                  this->sharedScratch(),
+                                                  this->workerScratch(),
+                                                  *this->scheduler);
+        this->filteredPixels += qint64(in.width) * in.height;
+
+        return;
+    }
+
+    MedianMethod method = this->currentMethod();
+
+    // There are sorting networks for radius 1, 2 and 3 only.
+    if (method == MedianMethodNetwork
+        && (this->radius < 1 || this->radius > 3))
+        method = MedianMethodHistogram;
+
+    DenoiseTraceScope stage(method == MedianMethodNetwork?
+                                "median/network":
+                            method == MedianMethodHistogram?
+                                "median/histogram": "median/sort");
+
+    switch (method) {
+    case MedianMethodNetwork:
+        if (this->radius == 1)
+            medianNetwork<1>(in, out, this->workerScratch(), *this->scheduler);
+        else if (this->radius == 2)
+            medianNetwork<2>(in, out, this->workerScratch(), *this->scheduler);
+        else
+            medianNetwork<3>(in, out, this->workerScratch(), *this->scheduler);
+
+        break;
+    case MedianMethodHistogram:
+        this->filterHistogram(in, out);
+
+        break;
+    default:
+        medianSort(in, out, this->radius,
+                   this->workerScratch(),
+                   *this->scheduler);
+        break;
+    }
+}
+
+void MedianFilter::filterHistogram(const DenoiseChannel &in,
+                                   const DenoiseChannel &out)
+{
+    medianHistogram(in, out, this->radius,
+                    this->histograms,
+                    *this->scheduler);
+}
+
+void MedianFilter::filterHistogram(const DenoiseChannel16 &in,
+                                   const DenoiseChannel16 &out)
+{
+    medianHistogram16(in, out, this->radius,
+                      this->workerScratch(),
+                      *this->scheduler);
+}
+
+void MedianFilter::filterHistogram(const DenoiseChannelFloat &in,
+                                   const DenoiseChannelFloat &out)
+{
+    // The floating point samples can't be counted in bins.
+    medianSort(in, out, this->radius,
+               this->workerScratch(),
+               *this->scheduler);
+}
+
+DenoiseLineFilter *MedianFilter::createLineFilter(const QSize &size) const
+{
+    int width = size.width();
+    int height = size.height();
+
+    // The detector needs the whole channel.
+    if (this->switching)
+        return 0;
+
+    switch (this->method) {
+    case MedianMethodNetwork:
+        if (this->radius == 1)
+            return new MedianNetworkLines<1>(width, height);
+        else if (this->radius == 2)
+            return new MedianNetworkLines<2>(width, height);
+        else if (this->radius == 3)
+            return new MedianNetworkLines<3>(width, height);
+
+        return new MedianHistogramLines(width, height, this->radius);
+    case MedianMethodHistogram:
+        return new MedianHistogramLines(width, height, this->radius);
+    default:
+        return new MedianSortLines(width, height, this->radius);
+    }
+}
+
+quint64 MedianFilter::lineFilterKey() const
+{
+    return DenoiseKey() << this->radius << this->method << this->switching;
+}
@@ -0,0 +1,102 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#ifndef MEDIANFILTER_H
+#define MEDIANFILTER_H
+
+#include <QVector>
+
+#include "denoisefilter.h"
+#include "histogrammedian.h"
+
+enum MedianMethod
+{
+    MedianMethodSort,
+    MedianMethodHistogram,
+    MedianMethodNetwork
+};
+
+// Median of the window of radius pixels around each pixel.
+class MedianFilter: public DenoiseFilter
+{
+    public:
+        explicit MedianFilter(TileScheduler *scheduler = 0);
+
+        int radius;
+
+        // The cost of the histogram method doesn't depends on the radius,
+        // but the sorting networks are faster for the radius they support
+        // (1, 2 and 3), for any other radius the histogram method is used
+        // instead. The 16 bits samples use a single histogram for the
+        // window, and the floating point samples are sorted instead.
+        MedianMethod method;
+
+        // Method used to filter the images, the one picked by the tuner if
+        // it's set, otherwise method.
+        MedianMethod currentMethod() const;
+
+        // Switching median, only the pixels detected as impulses are
+        // replaced by the median of their window, the rest are copied. A
+        // pixel is an impulse if it's more than impulseThreshold levels away
+        // from the median of its 3x3 window, and the other impulses are left
+        // out of its median. It's much faster than filtering every pixel
+        // for sparse impulse noise, and it keeps the details. The method is
+        // not used in this mode.
+        bool switching;
+
+        // In 8 bits levels, scaled to the range of the samples.
+        int impulseThreshold;
+
+        // Fraction of the pixels detected as impulses in all the channels
+        // filtered by the last call to process() in the switching mode.
+        qreal impulseFraction() const;
+
+        qint64 bufferSize() const;
+        int borderSize() const;
+        DenoiseLineFilter *createLineFilter(const QSize &size) const;
+        quint64 lineFilterKey() const;
+
+    protected:
+        void tune(const DenoiseTuner &tuner, const DenoiseImage &image);
+        void begin(const DenoiseImage &image);
+        void filter(const DenoiseChannel &in, const DenoiseChannel &out);
+        void filter(const DenoiseChannel16 &in, const DenoiseChannel16 &out);
+        void filter(const DenoiseChannelFloat &in,
+                    const DenoiseChannelFloat &out);
+
+    private:
+        MedianMethod tunedMethod;
+        QVector<HistogramMedian> histograms;
+        QVector<quint8> impulses;
+        qint64 detectedImpulses;
+        qint64 filteredPixels;
+
+        template <typename T>
+        void filterTyped(const DenoiseTypedChannel<T> &in,
+                         const DenoiseTypedChannel<T> &out);
+        void filterHistogram(const DenoiseChannel &in,
+                             const DenoiseChannel &out);
+        void filterHistogram(const DenoiseChannel16 &in,
+                             const DenoiseChannel16 &out);
+        void filterHistogram(const DenoiseChannelFloat &in,
+                             const DenoiseChannelFloat &out);
+};
+
+#endif // MEDIANFILTER_H
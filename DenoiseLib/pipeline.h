@@ -0,0 +1,82 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <functional>
+#include <QMutex>
+#include <QRunnable>
+#include <QVector>
+#include <QWaitCondition>
+
+// Queue of items waiting for the next stage of a pipeline. pop() waits
+// until there is an item, the stages push a null item to mark the end.
+template <typename T>
+class PipelineQueue
+{
+    public:
+        explicit PipelineQueue(int size = 0)
+        {
+            this->items.reserve(size + 1);
+        }
+
+        void push(T *item)
+        {
+            QMutexLocker locker(&this->mutex);
+            this->items << item;
+            this->condition.wakeOne();
+        }
+
+        T *pop()
+        {
+            QMutexLocker locker(&this->mutex);
+
+            while (this->items.isEmpty())
+                this->condition.wait(&this->mutex);
+
+            return this->items.takeFirst();
+        }
+
+    private:
+        QMutex mutex;
+        QWaitCondition condition;
+        QVector<T *> items;
+};
+
+// Runs a stage of a pipeline in a QThreadPool.
+class PipelineStage: public QRunnable
+{
+    public:
+        explicit PipelineStage(const std::function<void ()> &function):
+            function(function)
+        {
+        }
+
+        void run()
+        {
+            this->function();
+        }
+
+    private:
+        std::function<void ()> function;
+};
+
+#endif // PIPELINE_H
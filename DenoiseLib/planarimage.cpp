@@ -0,0 +1,504 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#include "planarimage.h"
+#include "denoisetrace.h"
+#include "tilescheduler.h"
+
+#if defined(Q_PROCESSOR_X86) && defined(Q_CC_GNU)
+#include <immintrin.h>
+#define PLANAR_SIMD
+#endif
+
+static const int planarAlignment = 64;
+
+// Coefficients of the YCbCr transform, multiplied by 1 << ycbcrBits.
+static const int ycbcrBits = 16;
+static const int ycbcrHalf = 1 << (ycbcrBits - 1);
+static const int ycbcrChromaOffset = 128 << ycbcrBits;
+
+enum PlanarSimd
+{
+    PlanarSimdNone,
+    PlanarSimdSSSE3,
+    PlanarSimdAVX2
+};
+
+inline PlanarSimd planarSimd()
+{
+#ifdef PLANAR_SIMD
+    if (__builtin_cpu_supports("avx2"))
+        return PlanarSimdAVX2;
+
+    if (__builtin_cpu_supports("ssse3"))
+        return PlanarSimdSSSE3;
+#endif
+
+    return PlanarSimdNone;
+}
+
+#ifdef PLANAR_SIMD
+// The SIMD functions process the line in blocks, and return the first pixel
+// that was not processed. The planes are always aligned, the interleaved
+// image may not be.
+//
+// In the 32 bits formats the bytes of a pixel are B, G, R, A in memory,
+// x86 is little endian, and the planes are R, G, B.
+
+__attribute__((target("avx2")))
+int deinterleaveRGB32AVX2(const quint8 *src, quint8 *const *dst, int width)
+{
+    // Gather the R, G, B and A bytes of each 4 pixels in a 32 bits lane.
+    const __m256i gather =
+            _mm256_setr_epi8(2, 6, 10, 14, 1, 5, 9, 13,
+                             0, 4, 8, 12, 3, 7, 11, 15,
+                             2, 6, 10, 14, 1, 5, 9, 13,
+                             0, 4, 8, 12, 3, 7, 11, 15);
+
+    // The unpacks work inside of each 128 bits half, this puts the lanes
+    // back in order.
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    int x = 0;
+
+    for (; x + 32 <= width; x += 32) {
+        const __m256i *pixels = (const __m256i *) (src + 4 * x);
+        __m256i a = _mm256_shuffle_epi8(_mm256_loadu_si256(pixels), gather);
+        __m256i b = _mm256_shuffle_epi8(_mm256_loadu_si256(pixels + 1), gather);
+        __m256i c = _mm256_shuffle_epi8(_mm256_loadu_si256(pixels + 2), gather);
+        __m256i d = _mm256_shuffle_epi8(_mm256_loadu_si256(pixels + 3), gather);
+        __m256i rg0 = _mm256_unpacklo_epi32(a, b);
+        __m256i rg1 = _mm256_unpacklo_epi32(c, d);
+        __m256i ba0 = _mm256_unpackhi_epi32(a, b);
+        __m256i ba1 = _mm256_unpackhi_epi32(c, d);
+        __m256i r = _mm256_unpacklo_epi64(rg0, rg1);
+        __m256i g = _mm256_unpackhi_epi64(rg0, rg1);
+        __m256i bl = _mm256_unpacklo_epi64(ba0, ba1);
+        _mm256_store_si256((__m256i *) (dst[0] + x),
+                           _mm256_permutevar8x32_epi32(r, order));
+        _mm256_store_si256((__m256i *) (dst[1] + x),
+                           _mm256_permutevar8x32_epi32(g, order));
+        _mm256_store_si256((__m256i *) (dst[2] + x),
+                           _mm256_permutevar8x32_epi32(bl, order));
+    }
+
+    return x;
+}
+
+__attribute__((target("ssse3")))
+int deinterleaveRGB32SSSE3(const quint8 *src, quint8 *const *dst, int width)
+{
+    const __m128i gather = _mm_setr_epi8(2, 6, 10, 14, 1, 5, 9, 13,
+                                         0, 4, 8, 12, 3, 7, 11, 15);
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        const __m128i *pixels = (const __m128i *) (src + 4 * x);
+        __m128i a = _mm_shuffle_epi8(_mm_loadu_si128(pixels), gather);
+        __m128i b = _mm_shuffle_epi8(_mm_loadu_si128(pixels + 1), gather);
+        __m128i c = _mm_shuffle_epi8(_mm_loadu_si128(pixels + 2), gather);
+        __m128i d = _mm_shuffle_epi8(_mm_loadu_si128(pixels + 3), gather);
+        __m128i rg0 = _mm_unpacklo_epi32(a, b);
+        __m128i rg1 = _mm_unpacklo_epi32(c, d);
+        __m128i ba0 = _mm_unpackhi_epi32(a, b);
+        __m128i ba1 = _mm_unpackhi_epi32(c, d);
+        _mm_store_si128((__m128i *) (dst[0] + x), _mm_unpacklo_epi64(rg0, rg1));
+        _mm_store_si128((__m128i *) (dst[1] + x), _mm_unpackhi_epi64(rg0, rg1));
+        _mm_store_si128((__m128i *) (dst[2] + x), _mm_unpacklo_epi64(ba0, ba1));
+    }
+
+    return x;
+}
+
+// The alpha byte of the destination is kept.
+__attribute__((target("avx2")))
+int interleaveRGB32AVX2(quint8 *const *src, quint8 *dst, int width)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alpha = _mm256_set1_epi32(int(0xff000000));
+    int x = 0;
+
+    for (; x + 32 <= width; x += 32) {
+        // Swap the middle quarters, so the unpacks of each half take
+        // consecutive pixels.
+        __m256i r = _mm256_permute4x64_epi64(
+                        _mm256_load_si256((const __m256i *) (src[0] + x)),
+                        0xd8);
+        __m256i g = _mm256_permute4x64_epi64(
+                        _mm256_load_si256((const __m256i *) (src[1] + x)),
+                        0xd8);
+        __m256i b = _mm256_permute4x64_epi64(
+                        _mm256_load_si256((const __m256i *) (src[2] + x)),
+                        0xd8);
+        __m256i bg[2] = {_mm256_unpacklo_epi8(b, g),
+                         _mm256_unpackhi_epi8(b, g)};
+        __m256i r0[2] = {_mm256_unpacklo_epi8(r, zero),
+                         _mm256_unpackhi_epi8(r, zero)};
+
+        for (int i = 0; i < 2; i++) {
+            __m256i lo = _mm256_unpacklo_epi16(bg[i], r0[i]);
+            __m256i hi = _mm256_unpackhi_epi16(bg[i], r0[i]);
+            __m256i p[2] = {_mm256_permute2x128_si256(lo, hi, 0x20),
+                            _mm256_permute2x128_si256(lo, hi, 0x31)};
+
+            for (int j = 0; j < 2; j++) {
+                __m256i *pixels = (__m256i *) (dst + 4 * (x + 16 * i + 8 * j));
+                __m256i a = _mm256_and_si256(_mm256_loadu_si256(pixels),
+                                             alpha);
+                _mm256_storeu_si256(pixels, _mm256_or_si256(p[j], a));
+            }
+        }
+    }
+
+    return x;
+}
+
+// Only needs SSE2, but it's used along with the other SSSE3 functions.
+__attribute__((target("ssse3")))
+int interleaveRGB32SSSE3(quint8 *const *src, quint8 *dst, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi32(int(0xff000000));
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        __m128i r = _mm_load_si128((const __m128i *) (src[0] + x));
+        __m128i g = _mm_load_si128((const __m128i *) (src[1] + x));
+        __m128i b = _mm_load_si128((const __m128i *) (src[2] + x));
+        __m128i bg[2] = {_mm_unpacklo_epi8(b, g), _mm_unpackhi_epi8(b, g)};
+        __m128i r0[2] = {_mm_unpacklo_epi8(r, zero), _mm_unpackhi_epi8(r, zero)};
+
+        for (int i = 0; i < 2; i++) {
+            __m128i p[2] = {_mm_unpacklo_epi16(bg[i], r0[i]),
+                            _mm_unpackhi_epi16(bg[i], r0[i])};
+
+            for (int j = 0; j < 2; j++) {
+                __m128i *pixels = (__m128i *) (dst + 4 * (x + 8 * i + 4 * j));
+                __m128i a = _mm_and_si128(_mm_loadu_si128(pixels), alpha);
+                _mm_storeu_si128(pixels, _mm_or_si128(p[j], a));
+            }
+        }
+    }
+
+    return x;
+}
+
+// pshufb masks for 24 bits pixels. Byte i of block k of the interleaved
+// line is channel (16 * k + i) % 3 of pixel (16 * k + i) / 3, the masks
+// select, for each block, the bytes that belong to a channel.
+__attribute__((target("ssse3")))
+inline __m128i rgb888Mask(int channel, int block, bool deinterleave)
+{
+    Q_DECL_ALIGN(16) qint8 mask[16];
+
+    for (int i = 0; i < 16; i++) {
+        int byte = deinterleave? 3 * i + channel - 16 * block:
+                                 16 * block + i;
+        bool inside = deinterleave? byte >= 0 && byte < 16:
+                                    byte % 3 == channel;
+        mask[i] = !inside? -1: deinterleave? qint8(byte): qint8(byte / 3);
+    }
+
+    return _mm_load_si128((const __m128i *) mask);
+}
+
+__attribute__((target("ssse3")))
+int deinterleaveRGB888SSSE3(const quint8 *src, quint8 *const *dst, int width)
+{
+    __m128i masks[3][3];
+
+    for (int c = 0; c < 3; c++)
+        for (int k = 0; k < 3; k++)
+            masks[c][k] = rgb888Mask(c, k, true);
+
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        const __m128i *pixels = (const __m128i *) (src + 3 * x);
+        __m128i blocks[3] = {_mm_loadu_si128(pixels),
+                             _mm_loadu_si128(pixels + 1),
+                             _mm_loadu_si128(pixels + 2)};
+
+        for (int c = 0; c < 3; c++) {
+            __m128i plane =
+                    _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(blocks[0],
+                                                               masks[c][0]),
+                                              _mm_shuffle_epi8(blocks[1],
+                                                               masks[c][1])),
+                                 _mm_shuffle_epi8(blocks[2], masks[c][2]));
+            _mm_store_si128((__m128i *) (dst[c] + x), plane);
+        }
+    }
+
+    return x;
+}
+
+__attribute__((target("ssse3")))
+int interleaveRGB888SSSE3(quint8 *const *src, quint8 *dst, int width)
+{
+    __m128i masks[3][3];
+
+    for (int c = 0; c < 3; c++)
+        for (int k = 0; k < 3; k++)
+            masks[c][k] = rgb888Mask(c, k, false);
+
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        __m128i planes[3] = {
+            _mm_load_si128((const __m128i *) (src[0] + x)),
+            _mm_load_si128((const __m128i *) (src[1] + x)),
+            _mm_load_si128((const __m128i *) (src[2] + x))
+        };
+
+        for (int k = 0; k < 3; k++) {
+            __m128i block =
+                    _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(planes[0],
+                                                               masks[0][k]),
+                                              _mm_shuffle_epi8(planes[1],
+                                                               masks[1][k])),
+                                 _mm_shuffle_epi8(planes[2], masks[2][k]));
+            _mm_storeu_si128((__m128i *) (dst + 3 * x) + k, block);
+        }
+    }
+
+    return x;
+}
+#endif
+
+PlanarImage::PlanarImage():
+    data(0),
+    allocated(0),
+    imageWidth(0),
+    imageHeight(0),
+    planeCount(0),
+    stride(0)
+{
+}
+
+PlanarImage::~PlanarImage()
+{
+    qFreeAligned(this->data);
+}
+
+int PlanarImage::width() const
+{
+    return this->imageWidth;
+}
+
+int PlanarImage::height() const
+{
+    return this->imageHeight;
+}
+
+int PlanarImage::planes() const
+{
+    return this->planeCount;
+}
+
+int PlanarImage::lineStride() const
+{
+    return this->stride;
+}
+
+qint64 PlanarImage::size() const
+{
+    return this->allocated;
+}
+
+void PlanarImage::resize(int width, int height, int planes)
+{
+    this->imageWidth = width;
+    this->imageHeight = height;
+    this->planeCount = planes;
+    this->stride = (width + planarAlignment - 1) & ~(planarAlignment - 1);
+    qint64 size = qint64(this->stride) * height * planes;
+
+    if (size <= this->allocated)
+        return;
+
+    qFreeAligned(this->data);
+    this->data = (quint8 *) qMallocAligned(size_t(size), planarAlignment);
+    this->allocated = this->data? size: 0;
+}
+
+DenoiseChannel PlanarImage::plane(int plane) const
+{
+    return DenoiseChannel(this->data
+                          + qptrdiff(plane) * this->stride * this->imageHeight,
+                          this->imageWidth, this->imageHeight,
+                          1, this->stride);
+}
+
+void PlanarImage::deinterleave(const DenoiseImage &image,
+                               TileScheduler &scheduler)
+{
+    DenoiseTraceScope stage("planar/deinterleave");
+    this->resize(image.width, image.height, image.channels());
+    int width = this->imageWidth;
+    int planes = this->planeCount;
+#ifdef PLANAR_SIMD
+    PlanarSimd simd = planarSimd();
+#endif
+
+    scheduler.runLines(QSize(width, this->imageHeight),
+                       0,
+                       [&] (const Tile &tile, int) {
+        for (int y = tile.rect.top(); y <= tile.rect.bottom(); y++) {
+            quint8 *dst[3];
+
+            for (int c = 0; c < planes; c++)
+                dst[c] = this->plane(c).line(y);
+
+            int x = 0;
+
+#ifdef PLANAR_SIMD
+            const quint8 *src = image.data + qptrdiff(y) * image.stride;
+
+            if (image.format == DenoiseFormatRGB32
+                || image.format == DenoiseFormatARGB32) {
+                if (simd == PlanarSimdAVX2)
+                    x = deinterleaveRGB32AVX2(src, dst, width);
+                else if (simd == PlanarSimdSSSE3)
+                    x = deinterleaveRGB32SSSE3(src, dst, width);
+            } else if (image.format == DenoiseFormatRGB888
+                       && simd != PlanarSimdNone) {
+                x = deinterleaveRGB888SSSE3(src, dst, width);
+            }
+#endif
+
+            // Remaining pixels.
+            for (int c = 0; c < planes; c++) {
+                DenoiseChannel channel = image.channel(c);
+                const quint8 *line = channel.line(y);
+
+                for (int i = x; i < width; i++)
+                    dst[c][i] = line[i * channel.pixelStride];
+            }
+        }
+    });
+}
+
+void PlanarImage::interleave(const DenoiseImage &image,
+                             TileScheduler &scheduler) const
+{
+    DenoiseTraceScope stage("planar/interleave");
+    int width = this->imageWidth;
+    int planes = this->planeCount;
+#ifdef PLANAR_SIMD
+    PlanarSimd simd = planarSimd();
+#endif
+
+    scheduler.runLines(QSize(width, this->imageHeight),
+                       0,
+                       [&] (const Tile &tile, int) {
+        for (int y = tile.rect.top(); y <= tile.rect.bottom(); y++) {
+            quint8 *src[3];
+
+            for (int c = 0; c < planes; c++)
+                src[c] = this->plane(c).line(y);
+
+            int x = 0;
+
+#ifdef PLANAR_SIMD
+            quint8 *dst = image.data + qptrdiff(y) * image.stride;
+
+            if (image.format == DenoiseFormatRGB32
+                || image.format == DenoiseFormatARGB32) {
+                if (simd == PlanarSimdAVX2)
+                    x = interleaveRGB32AVX2(src, dst, width);
+                else if (simd == PlanarSimdSSSE3)
+                    x = interleaveRGB32SSSE3(src, dst, width);
+            } else if (image.format == DenoiseFormatRGB888
+                       && simd != PlanarSimdNone) {
+                x = interleaveRGB888SSSE3(src, dst, width);
+            }
+#endif
+
+            for (int c = 0; c < planes; c++) {
+                DenoiseChannel channel = image.channel(c);
+                quint8 *line = channel.line(y);
+
+                for (int i = x; i < width; i++)
+                    line[i * channel.pixelStride] = src[c][i];
+            }
+        }
+    });
+}
+
+void PlanarImage::rgbToYCbCr(TileScheduler &scheduler)
+{
+    DenoiseTraceScope stage("planar/rgbToYCbCr");
+    int width = this->imageWidth;
+
+    scheduler.runLines(QSize(width, this->imageHeight),
+                       0,
+                       [&] (const Tile &tile, int) {
+        for (int y = tile.rect.top(); y <= tile.rect.bottom(); y++) {
+            quint8 *p0 = this->plane(0).line(y);
+            quint8 *p1 = this->plane(1).line(y);
+            quint8 *p2 = this->plane(2).line(y);
+
+            for (int x = 0; x < width; x++) {
+                int r = p0[x];
+                int g = p1[x];
+                int b = p2[x];
+
+                // The Cb and Cr sums are always in range, the weights of
+                // each one sums 0.
+                p0[x] = quint8((19595 * r + 38470 * g + 7471 * b
+                                + ycbcrHalf) >> ycbcrBits);
+                p1[x] = quint8((-11059 * r - 21709 * g + 32768 * b
+                                + ycbcrChromaOffset + ycbcrHalf - 1)
+                               >> ycbcrBits);
+                p2[x] = quint8((32768 * r - 27439 * g - 5329 * b
+                                + ycbcrChromaOffset + ycbcrHalf - 1)
+                               >> ycbcrBits);
+            }
+        }
+    });
+}
+
+void PlanarImage::yCbCrToRgb(TileScheduler &scheduler)
+{
+    DenoiseTraceScope stage("planar/yCbCrToRgb");
+    int width = this->imageWidth;
+
+    scheduler.runLines(QSize(width, this->imageHeight),
+                       0,
+                       [&] (const Tile &tile, int) {
+        for (int y = tile.rect.top(); y <= tile.rect.bottom(); y++) {
+            quint8 *p0 = this->plane(0).line(y);
+            quint8 *p1 = this->plane(1).line(y);
+            quint8 *p2 = this->plane(2).line(y);
+
+            for (int x = 0; x < width; x++) {
+                int luma = (p0[x] << ycbcrBits) + ycbcrHalf;
+                int cb = p1[x] - 128;
+                int cr = p2[x] - 128;
+                int r = (luma + 91881 * cr) >> ycbcrBits;
+                int g = (luma - 22554 * cb - 46802 * cr) >> ycbcrBits;
+                int b = (luma + 116130 * cb) >> ycbcrBits;
+                p0[x] = quint8(qBound(0, r, 255));
+                p1[x] = quint8(qBound(0, g, 255));
+                p2[x] = quint8(qBound(0, b, 255));
+            }
+        }
+    });
+}
@@ -0,0 +1,80 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#ifndef PLANARIMAGE_H
+#define PLANARIMAGE_H
+
+#include "denoiseimage.h"
+
+class TileScheduler;
+
+// An image with each color channel in its own plane.
+//
+// The lines start at 64 bytes boundaries and are padded to a multiple of 64
+// bytes, so the SIMD code can read and write whole vectors without
+// touching the next line. The filters are faster with consecutive pixels
+// than with interleaved channels.
+class PlanarImage
+{
+    public:
+        PlanarImage();
+        ~PlanarImage();
+
+        int width() const;
+        int height() const;
+        int planes() const;
+        int lineStride() const;
+
+        // Allocated memory, in bytes.
+        qint64 size() const;
+
+        // Set the size of the image, the memory is only allocated again if
+        // it grows.
+        void resize(int width, int height, int planes);
+
+        DenoiseChannel plane(int plane) const;
+
+        // Resize the planes to the size of image and copy its color
+        // channels to them.
+        void deinterleave(const DenoiseImage &image, TileScheduler &scheduler);
+
+        // Copy the planes to the color channels of image, the other bytes of
+        // image are not modified. image must have the same size.
+        void interleave(const DenoiseImage &image,
+                        TileScheduler &scheduler) const;
+
+        // Convert the R, G and B planes to Y, Cb and Cr in place, and back.
+        // The transform is the full range one of JPEG, in 16 bits fixed
+        // point, a round trip changes the samples by 1 at most.
+        void rgbToYCbCr(TileScheduler &scheduler);
+        void yCbCrToRgb(TileScheduler &scheduler);
+
+    private:
+        quint8 *data;
+        qint64 allocated;
+        int imageWidth;
+        int imageHeight;
+        int planeCount;
+        int stride;
+
+        Q_DISABLE_COPY(PlanarImage)
+};
+
+#endif // PLANARIMAGE_H
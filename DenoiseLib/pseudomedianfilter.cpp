@@ -0,0 +1,399 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#include <cstring>
+#include <QSize>
+
+#include "denoisetrace.h"
+#include "pseudomedianfilter.h"
+#include "tilescheduler.h"
+
+enum BlockSpan
+{
+    // The window starts at the beginning of a block, g[end] has the result.
+    SpanEnd,
+    // The window ends at the end of the image, in the same block where it
+    // starts, h[start] has the result.
+    SpanStart,
+    // The window covers two blocks.
+    SpanBoth
+};
+
+inline BlockSpan blockSpan(int start, int end, int kw)
+{
+    if (start % kw == 0)
+        return SpanEnd;
+
+    if (start / kw == end / kw)
+        return SpanStart;
+
+    return SpanBoth;
+}
+
+// Minimum and maximum of the window of each pixel of a line, line points to
+// 4 lines of scratch for g and h.
+template <typename T>
+void horizontalMinMax(const T *src, int pixelStride, int width,
+                      int radius,
+                      T *min, T *max,
+                      T *line)
+{
+    int kw = 2 * radius + 1;
+    T *gMin = line;
+    T *gMax = gMin + width;
+    T *hMin = gMax + width;
+    T *hMax = hMin + width;
+
+    for (int x = 0; x < width; x++) {
+        T pixel = src[x * pixelStride];
+
+        if (x % kw == 0) {
+            gMin[x] = pixel;
+            gMax[x] = pixel;
+        } else {
+            gMin[x] = qMin(gMin[x - 1], pixel);
+            gMax[x] = qMax(gMax[x - 1], pixel);
+        }
+    }
+
+    for (int x = width - 1; x >= 0; x--) {
+        T pixel = src[x * pixelStride];
+
+        if (x == width - 1 || (x + 1) % kw == 0) {
+            hMin[x] = pixel;
+            hMax[x] = pixel;
+        } else {
+            hMin[x] = qMin(hMin[x + 1], pixel);
+            hMax[x] = qMax(hMax[x + 1], pixel);
+        }
+    }
+
+    for (int x = 0; x < width; x++) {
+        int start = qMax(x - radius, 0);
+        int end = qMin(x + radius, width - 1);
+
+        switch (blockSpan(start, end, kw)) {
+        case SpanEnd:
+            min[x] = gMin[end];
+            max[x] = gMax[end];
+            break;
+        case SpanStart:
+            min[x] = hMin[start];
+            max[x] = hMax[start];
+            break;
+        default:
+            min[x] = qMin(hMin[start], gMin[end]);
+            max[x] = qMax(hMax[start], gMax[end]);
+            break;
+        }
+    }
+}
+
+// Value between the minimum and the maximum.
+template <typename T>
+inline T midValue(T min, T max)
+{
+    return T((min + max) / 2);
+}
+
+template <>
+inline float midValue(float min, float max)
+{
+    return 0.5f * (min + max);
+}
+
+// Line by line version, the prepared lines have the minimum and the maximum
+// of the horizontal windows, and the vertical pass reads all the lines of
+// the window.
+class PseudoMedianLines: public DenoiseLineFilter
+{
+    public:
+        PseudoMedianLines(int width, int height,
+                          int radius, PseudoMedianOutput output):
+            DenoiseLineFilter(width, height, radius),
+            output(output),
+            scratch(4 * width)
+        {
+        }
+
+        int lineSize() const
+        {
+            return 2 * this->width;
+        }
+
+        qint64 bufferSize() const
+        {
+            return this->scratch.size();
+        }
+
+        void prepareLine(const quint8 *in, int y, quint8 *line)
+        {
+            Q_UNUSED(y)
+            horizontalMinMax(in, 1, this->width, this->radius,
+                             line, line + this->width,
+                             this->scratch.data());
+        }
+
+        void filterLine(const quint8 *const *lines, int y, bool first,
+                        quint8 *out)
+        {
+            Q_UNUSED(first)
+            int width = this->width;
+            int kh = qMin(y + this->radius, this->height - 1)
+                     - qMax(y - this->radius, 0) + 1;
+            quint8 *oMin = this->scratch.data();
+            quint8 *oMax = oMin + width;
+            memcpy(oMin, lines[0], size_t(width));
+            memcpy(oMax, lines[0] + width, size_t(width));
+
+            for (int j = 1; j < kh; j++) {
+                const quint8 *lineMin = lines[j];
+                const quint8 *lineMax = lines[j] + width;
+
+                for (int x = 0; x < width; x++) {
+                    oMin[x] = qMin(oMin[x], lineMin[x]);
+                    oMax[x] = qMax(oMax[x], lineMax[x]);
+                }
+            }
+
+            switch (this->output) {
+            case PseudoMedianOutputErosion:
+                memcpy(out, oMin, size_t(width));
+
+                break;
+            case PseudoMedianOutputDilation:
+                memcpy(out, oMax, size_t(width));
+
+                break;
+            default:
+                for (int x = 0; x < width; x++)
+                    out[x] = midValue(oMin[x], oMax[x]);
+
+                break;
+            }
+        }
+
+    private:
+        PseudoMedianOutput output;
+        QVector<quint8> scratch;
+};
+
+PseudoMedianFilter::PseudoMedianFilter(TileScheduler *scheduler):
+    DenoiseFilter(scheduler),
+    radius(3),
+    output(PseudoMedianOutputMedian)
+{
+}
+
+bool PseudoMedianFilter::supportsInPlace() const
+{
+    // The input is only read in the horizontal pass, before writing the
+    // output.
+    return true;
+}
+
+qint64 PseudoMedianFilter::bufferSize() const
+{
+    return DenoiseFilter::bufferSize() + this->lines.size();
+}
+
+int PseudoMedianFilter::borderSize() const
+{
+    return this->radius;
+}
+
+void PseudoMedianFilter::filter(const DenoiseChannel &in,
+                                const DenoiseChannel &out)
+{
+    this->filterTyped(in, out);
+}
+
+void PseudoMedianFilter::filter(const DenoiseChannel16 &in,
+                                const DenoiseChannel16 &out)
+{
+    this->filterTyped(in, out);
+}
+
+void PseudoMedianFilter::filter(const DenoiseChannelFloat &in,
+                                const DenoiseChannelFloat &out)
+{
+    this->filterTyped(in, out);
+}
+
+template <typename T>
+void PseudoMedianFilter::filterTyped(const DenoiseTypedChannel<T> &in,
+                                     const DenoiseTypedChannel<T> &out)
+{
+    int width = in.width;
+    int height = in.height;
+    QSize size(width, height);
+    int radius = this->radius;
+    int kw = 2 * radius + 1;
+    PseudoMedianOutput output = this->output;
+    TileScheduler &scheduler = *this->scheduler;
+    ScratchArena *arenas = this->workerScratch();
+
+    // The minimum and the maximum of the horizontal windows of each line, in
+    // two planes.
+    this->lines.resize(int(sizeof(T)) * width, height, 2);
+    DenoiseTypedChannel<T> linesMin(reinterpret_cast<T *>(this->lines.plane(0).data),
+                                    width, height,
+                                    1, this->lines.lineStride());
+    DenoiseTypedChannel<T> linesMax(reinterpret_cast<T *>(this->lines.plane(1).data),
+                                    width, height,
+                                    1, this->lines.lineStride());
+    DenoiseTraceScope stage("pseudomedian/vanherk");
+
+    // Horizontal pass, each worker needs its own g and h lines.
+    scheduler.runLines(size, 0, [&] (const Tile &tile, int worker) {
+        ScratchArena &arena = arenas[worker];
+        arena.reset();
+        T *line = arena.allocate<T>(4 * width);
+
+        for (int y = tile.rect.top(); y <= tile.rect.bottom(); y++)
+            horizontalMinMax(in.line(y), in.pixelStride, width, radius,
+                             linesMin.line(y), linesMax.line(y),
+                             line);
+    });
+
+    // Vertical pass on bands of lines. The windows of consecutive lines
+    // move down, so g is only kept for the last line, from the start of its
+    // block, and h for the lines of a block, from the start of the first
+    // window in it.
+    scheduler.runLines(size, radius, [&] (const Tile &tile, int worker) {
+        ScratchArena &arena = arenas[worker];
+        arena.reset();
+
+        // Line y of the block of h is in the slot y % kw.
+        T *hMin = arena.allocate<T>(2 * kw * width);
+        T *hMax = hMin + kw * width;
+        T *gMin = arena.allocate<T>(4 * width);
+        T *gMax = gMin + width;
+        T *oMin = gMax + width;
+        T *oMax = oMin + width;
+        size_t lineSize = size_t(width) * sizeof(T);
+
+        // Last line added to g, and block of h.
+        int gEnd = qMin(tile.rect.top() + radius, height - 1) / kw * kw - 1;
+        int hBlock = -1;
+
+        for (int y = tile.rect.top(); y <= tile.rect.bottom(); y++) {
+            int start = qMax(y - radius, 0);
+            int end = qMin(y + radius, height - 1);
+            BlockSpan span = blockSpan(start, end, kw);
+
+            while (gEnd < end) {
+                gEnd++;
+                const T *lineMin = linesMin.line(gEnd);
+                const T *lineMax = linesMax.line(gEnd);
+
+                if (gEnd % kw == 0) {
+                    memcpy(gMin, lineMin, lineSize);
+                    memcpy(gMax, lineMax, lineSize);
+                } else {
+                    for (int x = 0; x < width; x++) {
+                        gMin[x] = qMin(gMin[x], lineMin[x]);
+                        gMax[x] = qMax(gMax[x], lineMax[x]);
+                    }
+                }
+            }
+
+            if (span != SpanEnd && start / kw != hBlock) {
+                hBlock = start / kw;
+                int last = qMin(hBlock * kw + kw - 1, height - 1);
+
+                for (int j = last; j >= start; j--) {
+                    const T *lineMin = linesMin.line(j);
+                    const T *lineMax = linesMax.line(j);
+                    T *hLineMin = hMin + (j % kw) * width;
+                    T *hLineMax = hMax + (j % kw) * width;
+
+                    if (j == last) {
+                        memcpy(hLineMin, lineMin, lineSize);
+                        memcpy(hLineMax, lineMax, lineSize);
+                    } else {
+                        const T *nextMin = hMin + ((j + 1) % kw) * width;
+                        const T *nextMax = hMax + ((j + 1) % kw) * width;
+
+                        for (int x = 0; x < width; x++) {
+                            hLineMin[x] = qMin(nextMin[x], lineMin[x]);
+                            hLineMax[x] = qMax(nextMax[x], lineMax[x]);
+                        }
+                    }
+                }
+            }
+
+            const T *windowMin = oMin;
+            const T *windowMax = oMax;
+            const T *hLineMin = hMin + (start % kw) * width;
+            const T *hLineMax = hMax + (start % kw) * width;
+
+            switch (span) {
+            case SpanEnd:
+                windowMin = gMin;
+                windowMax = gMax;
+                break;
+            case SpanStart:
+                windowMin = hLineMin;
+                windowMax = hLineMax;
+                break;
+            default:
+                for (int x = 0; x < width; x++) {
+                    oMin[x] = qMin(hLineMin[x], gMin[x]);
+                    oMax[x] = qMax(hLineMax[x], gMax[x]);
+                }
+
+                break;
+            }
+
+            T *oLine = out.line(y);
+
+            switch (output) {
+            case PseudoMedianOutputErosion:
+                for (int x = 0; x < width; x++)
+                    oLine[x * out.pixelStride] = windowMin[x];
+
+                break;
+            case PseudoMedianOutputDilation:
+                for (int x = 0; x < width; x++)
+                    oLine[x * out.pixelStride] = windowMax[x];
+
+                break;
+            default:
+                for (int x = 0; x < width; x++)
+                    oLine[x * out.pixelStride] = midValue(windowMin[x],
+                                                          windowMax[x]);
+
+                break;
+            }
+        }
+    });
+}
+
+DenoiseLineFilter *PseudoMedianFilter::createLineFilter(const QSize &size) const
+{
+    return new PseudoMedianLines(size.width(), size.height(),
+                                 this->radius, this->output);
+}
+
+quint64 PseudoMedianFilter::lineFilterKey() const
+{
+    return DenoiseKey() << this->radius << this->output;
+}
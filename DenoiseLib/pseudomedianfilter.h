@@ -0,0 +1,81 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#ifndef PSEUDOMEDIANFILTER_H
+#define PSEUDOMEDIANFILTER_H
+
+#include "denoisefilter.h"
+#include "planarimage.h"
+
+enum PseudoMedianOutput
+{
+    // (min + max) / 2 of the window.
+    PseudoMedianOutputMedian,
+    // The minimum of the window, same as the erosion of the image.
+    PseudoMedianOutputErosion,
+    // The maximum of the window, same as the dilation of the image.
+    PseudoMedianOutputDilation
+};
+
+// Minimum and maximum of the window with the algorithm described in:
+//
+// M. van Herk, "A fast algorithm for local minimum and maximum filters on
+// rectangular and octagonal kernels", Pattern Recognition Letters 13 (1992)
+// 517-521.
+//
+// J. Gil, M. Werman, "Computing 2-D min, median, and max filters", IEEE
+// Transactions on Pattern Analysis and Machine Intelligence 15 (1993)
+// 504-507.
+//
+// The line is split in blocks of the window size, and for each pixel we
+// keep the minimum (and maximum) from the start of its block up to it (g),
+// and from it up to the end of its block (h). Any window spans at most two
+// blocks, so its minimum is min(h[start], g[end]). The filter is separable,
+// the horizontal pass works on pixels, and the vertical pass works on whole
+// lines.
+class PseudoMedianFilter: public DenoiseFilter
+{
+    public:
+        explicit PseudoMedianFilter(TileScheduler *scheduler = 0);
+
+        int radius;
+        PseudoMedianOutput output;
+
+        bool supportsInPlace() const;
+        qint64 bufferSize() const;
+        int borderSize() const;
+        DenoiseLineFilter *createLineFilter(const QSize &size) const;
+        quint64 lineFilterKey() const;
+
+    protected:
+        void filter(const DenoiseChannel &in, const DenoiseChannel &out);
+        void filter(const DenoiseChannel16 &in, const DenoiseChannel16 &out);
+        void filter(const DenoiseChannelFloat &in,
+                    const DenoiseChannelFloat &out);
+
+    private:
+        PlanarImage lines;
+
+        template <typename T>
+        void filterTyped(const DenoiseTypedChannel<T> &in,
+                         const DenoiseTypedChannel<T> &out);
+};
+
+#endif // PSEUDOMEDIANFILTER_H
@@ -0,0 +1,95 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#include "scratcharena.h"
+
+static const size_t scratchAlignment = 64;
+
+ScratchArena::ScratchArena():
+    block(0),
+    capacity(0),
+    used(0),
+    peak(0),
+    overflowSize(0)
+{
+}
+
+ScratchArena::~ScratchArena()
+{
+    this->reset();
+    qFreeAligned(this->block);
+}
+
+void *ScratchArena::allocateBytes(size_t size)
+{
+    size = (size + scratchAlignment - 1) & ~(scratchAlignment - 1);
+    size_t offset = this->used;
+    this->used += size;
+    this->peak = qMax(this->peak, this->used);
+
+    if (this->used <= this->capacity)
+        return this->block + offset;
+
+    void *memory = qMallocAligned(size, scratchAlignment);
+    this->overflow << memory;
+    this->overflowSize += size;
+
+    return memory;
+}
+
+void ScratchArena::reset()
+{
+    if (!this->overflow.isEmpty()) {
+        for (void *memory: this->overflow)
+            qFreeAligned(memory);
+
+        this->overflow.clear();
+        this->overflowSize = 0;
+
+        qFreeAligned(this->block);
+        this->block = (quint8 *) qMallocAligned(this->peak, scratchAlignment);
+        this->capacity = this->block? this->peak: 0;
+    }
+
+    this->used = 0;
+}
+
+void ScratchArena::reserve(size_t size)
+{
+    this->reset();
+    this->peak = qMax(this->peak, size);
+
+    if (size <= this->capacity)
+        return;
+
+    qFreeAligned(this->block);
+    this->block = (quint8 *) qMallocAligned(size, scratchAlignment);
+    this->capacity = this->block? size: 0;
+}
+
+size_t ScratchArena::peakSize() const
+{
+    return this->peak;
+}
+
+qint64 ScratchArena::size() const
+{
+    return qint64(this->capacity + this->overflowSize);
+}
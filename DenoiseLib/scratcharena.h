@@ -0,0 +1,73 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#ifndef SCRATCHARENA_H
+#define SCRATCHARENA_H
+
+#include <QVector>
+
+// Scratch memory of a worker.
+//
+// The memory is taken from a single block and released all at once with
+// reset(). If the block runs out, the memory is taken from new blocks, and
+// the next reset() replaces all of them with a single block big enough for
+// the most memory allocated between two reset(). After the first image,
+// the filters don't allocate memory any more.
+class ScratchArena
+{
+    public:
+        ScratchArena();
+        ~ScratchArena();
+
+        // Memory for count elements of T, aligned to 64 bytes. The memory is
+        // not initialized, and it's valid until the next reset().
+        template <typename T>
+        inline T *allocate(int count)
+        {
+            return static_cast<T *>(this->allocateBytes(size_t(count)
+                                                        * sizeof(T)));
+        }
+
+        void *allocateBytes(size_t size);
+
+        // Release all the memory allocated since the last reset().
+        void reset();
+
+        // Release the memory and make the block big enough for size bytes.
+        void reserve(size_t size);
+
+        // Most memory allocated between two reset(), in bytes.
+        size_t peakSize() const;
+
+        // Memory reserved by the arena, in bytes.
+        qint64 size() const;
+
+    private:
+        quint8 *block;
+        size_t capacity;
+        size_t used;
+        size_t peak;
+        QVector<void *> overflow;
+        size_t overflowSize;
+
+        Q_DISABLE_COPY(ScratchArena)
+};
+
+#endif // SCRATCHARENA_H
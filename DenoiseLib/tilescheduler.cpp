@@ -0,0 +1,383 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#include <QThread>
+#include <QMutexLocker>
+#include <QtAlgorithms>
+#include <QVarLengthArray>
+
+#include "denoisetrace.h"
+#include "tilescheduler.h"
+
+// Each worker gets about this number of tiles, so there is something left
+// to steal when the tiles don't take the same time.
+static const int tilesPerThread = 4;
+
+// Bands smaller than this are not worth the scheduling.
+static const int minBandSize = 16;
+
+static const int cacheLineSize = 64;
+
+// Workers with their range of tiles in the stack, the rest allocate it.
+static const int stackRanges = 64;
+
+// Range of tiles [first, last) still not processed by a worker.
+class TileRange
+{
+    public:
+        TileRange():
+            first(0),
+            last(0)
+        {
+        }
+
+        inline bool takeFirst(int *tile)
+        {
+            QMutexLocker locker(&this->mutex);
+
+            if (this->first >= this->last)
+                return false;
+
+            *tile = this->first++;
+
+            return true;
+        }
+
+        inline bool takeLast(int *tile)
+        {
+            QMutexLocker locker(&this->mutex);
+
+            if (this->first >= this->last)
+                return false;
+
+            *tile = --this->last;
+
+            return true;
+        }
+
+        inline int size()
+        {
+            QMutexLocker locker(&this->mutex);
+
+            return this->last - this->first;
+        }
+
+        QMutex mutex;
+        int first;
+        int last;
+};
+
+class TileJob
+{
+    public:
+        TileJob(const QSize &size, const QSize &tileSize, int halo,
+                int workers, const TileFunction &function):
+            stage(DenoiseTrace::currentStage()),
+            next(0),
+            joined(1),
+            running(0),
+            workers(workers),
+            size(size),
+            tileSize(tileSize),
+            halo(halo),
+            function(function),
+            ranges(workers)
+        {
+            this->tilesX = (size.width() + tileSize.width() - 1)
+                           / tileSize.width();
+            int tiles = TileJob::tiles(size, tileSize);
+
+            for (int i = 0; i < workers; i++) {
+                this->ranges[i].first = i * tiles / workers;
+                this->ranges[i].last = (i + 1) * tiles / workers;
+            }
+        }
+
+        static int tiles(const QSize &size, const QSize &tileSize)
+        {
+            return ((size.width() + tileSize.width() - 1) / tileSize.width())
+                   * ((size.height() + tileSize.height() - 1)
+                      / tileSize.height());
+        }
+
+        Tile tile(int index) const
+        {
+            Tile tile;
+            tile.index = index;
+            tile.rect = QRect(index % this->tilesX * this->tileSize.width(),
+                              index / this->tilesX * this->tileSize.height(),
+                              this->tileSize.width(),
+                              this->tileSize.height())
+                        .intersected(QRect(QPoint(0, 0), this->size));
+            tile.source = tile.rect.adjusted(-this->halo, -this->halo,
+                                             this->halo, this->halo)
+                          .intersected(QRect(QPoint(0, 0), this->size));
+
+            return tile;
+        }
+
+        void work(int worker)
+        {
+            int tile;
+
+            while (this->ranges[worker].takeFirst(&tile)
+                   || this->steal(worker, &tile))
+                this->function(this->tile(tile), worker);
+        }
+
+        // Stage that started the job, the workers trace their work with it.
+        const char *stage;
+
+        // Next job in the queue of the scheduler.
+        TileJob *next;
+
+        // Worker number of the next thread joining the job, and the threads
+        // still working on it. Both are guarded by the scheduler mutex.
+        int joined;
+        int running;
+
+        int workers;
+
+    private:
+        QSize size;
+        QSize tileSize;
+        int halo;
+        int tilesX;
+        const TileFunction &function;
+        QVarLengthArray<TileRange, stackRanges> ranges;
+
+        bool steal(int worker, int *tile)
+        {
+            forever {
+                int victim = -1;
+                int victimSize = 0;
+
+                for (int i = 0; i < this->workers; i++) {
+                    if (i == worker)
+                        continue;
+
+                    int size = this->ranges[i].size();
+
+                    if (size > victimSize) {
+                        victim = i;
+                        victimSize = size;
+                    }
+                }
+
+                if (victim < 0)
+                    return false;
+
+                // Another worker may have taken it in the meantime.
+                if (this->ranges[victim].takeLast(tile))
+                    return true;
+            }
+        }
+};
+
+// A thread of the scheduler, it helps with the queued jobs until the
+// scheduler stops it.
+class TileThread: public QThread
+{
+    public:
+        explicit TileThread(TileScheduler *scheduler):
+            scheduler(scheduler)
+        {
+        }
+
+    protected:
+        void run()
+        {
+            this->scheduler->help();
+        }
+
+    private:
+        TileScheduler *scheduler;
+};
+
+TileScheduler::TileScheduler(int threads):
+    threads(0),
+    queue(0),
+    quit(false)
+{
+    this->setThreadCount(threads);
+}
+
+TileScheduler::~TileScheduler()
+{
+    this->stopThreads();
+}
+
+TileScheduler *TileScheduler::globalInstance()
+{
+    static TileScheduler scheduler;
+
+    return &scheduler;
+}
+
+int TileScheduler::threadCount() const
+{
+    return this->threads;
+}
+
+void TileScheduler::setThreadCount(int threads)
+{
+    threads = threads > 0? threads: qMax(QThread::idealThreadCount(), 1);
+
+    if (threads == this->threads)
+        return;
+
+    this->stopThreads();
+    this->threads = threads;
+
+    // The calling thread works too.
+    for (int i = 1; i < threads; i++) {
+        TileThread *thread = new TileThread(this);
+        this->pool << thread;
+        thread->start();
+    }
+}
+
+void TileScheduler::run(const QSize &size, const QSize &tileSize, int halo,
+                        const TileFunction &function)
+{
+    if (size.isEmpty() || tileSize.isEmpty())
+        return;
+
+    int workers = qMin(this->threads, TileJob::tiles(size, tileSize));
+    TileJob job(size, tileSize, halo, workers, function);
+
+    if (workers > 1) {
+        QMutexLocker locker(&this->mutex);
+        TileJob **last = &this->queue;
+
+        while (*last)
+            last = &(*last)->next;
+
+        *last = &job;
+
+        for (int i = 1; i < workers; i++)
+            this->jobQueued.wakeOne();
+    }
+
+    // The calling thread steals the tiles of the workers that didn't join,
+    // when the threads are busy with other jobs, or when this job was
+    // started from a tile of another one. Once there are no tiles left the
+    // job leaves the queue, and only the threads already working on it are
+    // waited for, so the jobs sharing the threads never wait for each
+    // other.
+    job.work(0);
+
+    if (workers > 1) {
+        QMutexLocker locker(&this->mutex);
+        this->dequeue(&job);
+
+        while (job.running > 0)
+            this->jobFinished.wait(&this->mutex);
+    }
+}
+
+void TileScheduler::runLines(const QSize &size, int halo,
+                             const TileFunction &function)
+{
+    this->run(size,
+              QSize(size.width(), this->bandSize(size.height())),
+              halo,
+              function);
+}
+
+void TileScheduler::runColumns(const QSize &size, int halo,
+                               const TileFunction &function)
+{
+    // Round the bands to whole cache lines, so the workers don't write the
+    // same lines.
+    int band = (this->bandSize(size.width()) + cacheLineSize - 1)
+               / cacheLineSize * cacheLineSize;
+
+    this->run(size, QSize(band, size.height()), halo, function);
+}
+
+int TileScheduler::bandSize(int length) const
+{
+    int bands = tilesPerThread * this->threads;
+
+    return qMax((length + bands - 1) / bands, minBandSize);
+}
+
+void TileScheduler::help()
+{
+    QMutexLocker locker(&this->mutex);
+
+    forever {
+        while (!this->queue && !this->quit)
+            this->jobQueued.wait(&this->mutex);
+
+        if (this->quit)
+            return;
+
+        TileJob *job = this->queue;
+        int worker = job->joined++;
+        job->running++;
+
+        // The next threads help the next job.
+        if (job->joined >= job->workers)
+            this->dequeue(job);
+
+        locker.unlock();
+
+        {
+            DenoiseTraceScope stage(job->stage? job->stage: "tiles");
+            job->work(worker);
+        }
+
+        // The job may be destroyed after this.
+        locker.relock();
+        job->running--;
+
+        if (job->running < 1)
+            this->jobFinished.wakeAll();
+    }
+}
+
+void TileScheduler::dequeue(TileJob *job)
+{
+    for (TileJob **it = &this->queue; *it; it = &(*it)->next)
+        if (*it == job) {
+            *it = job->next;
+            job->next = 0;
+
+            break;
+        }
+}
+
+void TileScheduler::stopThreads()
+{
+    {
+        QMutexLocker locker(&this->mutex);
+        this->quit = true;
+        this->jobQueued.wakeAll();
+    }
+
+    for (TileThread *thread: this->pool)
+        thread->wait();
+
+    qDeleteAll(this->pool);
+    this->pool.clear();
+    this->quit = false;
+}
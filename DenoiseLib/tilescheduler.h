@@ -0,0 +1,143 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#ifndef TILESCHEDULER_H
+#define TILESCHEDULER_H
+
+#include <QMutex>
+#include <QRect>
+#include <QSize>
+#include <QVector>
+#include <QWaitCondition>
+
+class TileJob;
+class TileThread;
+
+// A piece of the output image.
+struct Tile
+{
+    // Tiles are numbered in row-major order.
+    int index;
+
+    // Pixels written by the tile.
+    QRect rect;
+
+    // Pixels read by the tile, rect grown by the halo and clipped to the
+    // image.
+    QRect source;
+};
+
+// Function called for each tile. worker is in [0, threadCount()), and can
+// be used to select per worker scratch buffers.
+//
+// It only keeps a reference to the function, so unlike std::function it
+// never allocates memory. The function must outlive the TileFunction, as
+// the lambdas passed directly to run() do.
+class TileFunction
+{
+    public:
+        template <typename Function>
+        TileFunction(const Function &function):
+            function(&function),
+            call(&TileFunction::callFunction<Function>)
+        {
+        }
+
+        inline void operator ()(const Tile &tile, int worker) const
+        {
+            this->call(this->function, tile, worker);
+        }
+
+    private:
+        const void *function;
+        void (*call)(const void *function, const Tile &tile, int worker);
+
+        template <typename Function>
+        static void callFunction(const void *function,
+                                 const Tile &tile, int worker)
+        {
+            (*static_cast<const Function *>(function))(tile, worker);
+        }
+};
+
+// Runs a function over the tiles of an image in parallel.
+//
+// The tiles are split in one contiguous range per worker. Each worker
+// processes its own range in order, and when it runs out of tiles it
+// steals from the end of the range of the worker with more tiles left.
+// Each tile is processed exactly once, so as long as the function only
+// writes the pixels in tile.rect, the result doesn't depends on the
+// scheduling nor in the number of threads.
+//
+// Several threads can share a scheduler, and a tile function can start
+// another job, each call only waits for the workers of its own job.
+//
+// The scheduler keeps threadCount() - 1 threads waiting for jobs, the
+// calling thread is the first worker of its job. Starting a job doesn't
+// allocate memory.
+class TileScheduler
+{
+    public:
+        // 0 threads means one thread per core.
+        explicit TileScheduler(int threads = 0);
+        ~TileScheduler();
+
+        // Scheduler shared by the filters that don't have their own.
+        static TileScheduler *globalInstance();
+
+        int threadCount() const;
+
+        // Must not be called while a job is running.
+        void setThreadCount(int threads);
+
+        // Split the image in tiles of tileSize and call function for each
+        // one. halo is the number of pixels around the tile that the
+        // function reads.
+        void run(const QSize &size, const QSize &tileSize, int halo,
+                 const TileFunction &function);
+
+        // Split the image in bands of lines.
+        void runLines(const QSize &size, int halo,
+                      const TileFunction &function);
+
+        // Split the image in bands of columns.
+        void runColumns(const QSize &size, int halo,
+                        const TileFunction &function);
+
+    private:
+        int threads;
+        QVector<TileThread *> pool;
+        QMutex mutex;
+        QWaitCondition jobQueued;
+        QWaitCondition jobFinished;
+
+        // Jobs waiting for more workers, in the order they were started.
+        TileJob *queue;
+        bool quit;
+
+        int bandSize(int length) const;
+        void help();
+        void dequeue(TileJob *job);
+        void stopThreads();
+
+        friend class TileThread;
+};
+
+#endif // TILESCHEDULER_H
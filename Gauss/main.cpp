@@ -18,124 +18,127 @@
  * Web-Site: http://github.com/hipersayanX/DenoiseFilters
  */
 
-#include <iostream>
-#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <QCoreApplication>
 #include <QImage>
 #include <QTime>
 #include <QElapsedTimer>
 #include <QDebug>
 
-template<typename T> class Pixel
+#include "denoisebatch.h"
+#include "denoisestream.h"
+#include "denoisestrips.h"
+#include "denoisetrace.h"
+#include "denoisetuner.h"
+#include "gaussfilter.h"
+#include "tilescheduler.h"
+
+int main(int argc, char *argv[])
 {
-    public:
-        explicit Pixel():
-            r(0), g(0), b(0)
-        {
-        }
+    QCoreApplication a(argc, argv);
 
-        Pixel(T r, T g, T b):
-            r(r), g(g), b(b)
-        {
-        }
+    // Tracing, "--trace FILE" saves the time spent in each stage, by
+    // thread, while the program runs, as CSV if FILE ends in ".csv" or as a
+    // Chrome trace otherwise. "--trace-counters" adds the cycles,
+    // instructions and cache misses of each stage, on Linux.
+    DenoiseTrace *trace = DenoiseTrace::globalInstance();
 
-        Pixel(QRgb pixel):
-            r(qRed(pixel)), g(qGreen(pixel)), b(qBlue(pixel))
-        {
-        }
+    if (trace->parseArguments(a.arguments()))
+        trace->start();
 
-        template <typename R> Pixel &operator +=(const Pixel<R> &other)
-        {
-            this->r += other.r;
-            this->g += other.g;
-            this->b += other.b;
+    // Number of threads used by the filter, 0 uses one thread per core.
+    int threads = 0;
+    TileScheduler scheduler(threads);
 
-            return *this;
+    // Here we configure the denoise parameters.
+    GaussFilter filter(&scheduler);
+    filter.radius = 3;
+    filter.sigma = 1000;
+    filter.method = GaussMethodSeparable;
+    filter.border = DenoiseBorderClipped;
+
+    // DenoiseColorsLuma only filters the brightness, with radius 3 it's
+    // less than 2 times faster, the YCbCr conversion costs almost as much as
+    // filtering a channel.
+    filter.colors = DenoiseColorsRGB;
+
+    // Tuning, "--tune FILE" replaces the method above with the fastest
+    // one for each image, with an error of 1 level at most. The methods are
+    // measured in the first run, and the costs are cached in FILE.
+    DenoiseTuner tuner(&scheduler);
+    tuner.maxError = 1;
+
+    if (tuner.parseArguments(a.arguments()) && tuner.calibrate())
+        filter.tuner = &tuner;
+
+    // Streaming mode, "--stream" filters the frames read from the standard
+    // input and writes them to the standard output, "--incremental" only
+    // filters the parts of the frames that changed.
+    DenoiseStream stream(&filter);
+
+    if (stream.parseArguments(a.arguments())) {
+        if (!stream.run(stdin, stdout)) {
+            qCritical() << qPrintable(stream.errorString());
+
+            return EXIT_FAILURE;
         }
 
-        Pixel &operator /=(qreal c)
-        {
-            this->r /= c;
-            this->g /= c;
-            this->b /= c;
+        qDebug() << "Frames:" << stream.frames()
+                 << "FPS:" << stream.framesPerSecond()
+                 << "Latency:" << stream.averageLatency()
+                 << "ms, max:" << stream.maxLatency() << "ms"
+                 << "Dirty:" << stream.dirtyRatio();
 
-            return *this;
-        }
+        return EXIT_SUCCESS;
+    }
 
-        T r;
-        T g;
-        T b;
-};
+    // Batch mode, "--batch INPUT OUTPUT" filters all the images of the
+    // INPUT directory, or list of files, and saves them in OUTPUT.
+    DenoiseBatch batch(&filter);
 
-typedef Pixel<qint8> PixelI8;
-typedef Pixel<quint8> PixelU8;
-typedef Pixel<qreal> PixelReal;
+    if (batch.parseArguments(a.arguments())) {
+        bool ok = batch.run();
 
-template <typename T> inline Pixel<qreal> operator *(qreal c, const Pixel<T> &pixel)
-{
-    return Pixel<qreal>(c * pixel.r,
-                        c * pixel.g,
-                        c * pixel.b);
-}
+        if (!ok)
+            qCritical() << qPrintable(batch.errorString());
 
-inline QVector<qreal> gaussKernel(int radius, qreal sigma, int *kl)
-{
-    int kw = 2 * radius + 1;
-    QVector<qreal> kernel(kw * kw);
-    qreal sum = 0;
-
-    /* Create convolution matrix according to the formula:
-     *
-     *                    1             (-((i - radius) ^ 2 + (y - radius) ^ 2))
-     * weight = -------------------- exp(--------------------------------------)
-     *          2 * M_PI * sigma ^ 2    (             2 * sigma ^ 2            )
-     *
-     * Since the weights are normalized, the term:
-     *
-     *
-     *                    1
-     * weight = --------------------
-     *          2 * M_PI * sigma ^ 2
-     *
-     * is not required here.
-     */
-    for (int j = 0; j < kw; j++)
-        for (int i = 0; i < kw; i++) {
-            int x = i - radius;
-            int y = j - radius;
-            qreal sigma2 = -2 * sigma * sigma;
-            qreal weight = exp((x * x + y * y) / sigma2);
-            kernel[i + j * kw] = weight;
-            sum += weight;
-        }
+        qDebug() << "Images:" << batch.images()
+                 << "Failed:" << batch.failedImages()
+                 << "Images/s:" << batch.imagesPerSecond()
+                 << "MP/s:" << batch.megapixelsPerSecond()
+                 << "Peak memory:" << (batch.peakMemory() >> 20) << "MB";
 
-    // Normalize weights.
-    for (int i = 0; i < kernel.size(); i++)
-        kernel[i] /= sum;
+        return ok? EXIT_SUCCESS: EXIT_FAILURE;
+    }
 
-    *kl = kw;
+    // Strips mode, "--strips INPUT OUTPUT" filters a binary PGM or PPM image
+    // of any size a few lines at a time, "--strip-height N" sets the lines
+    // of each strip.
+    DenoiseStrips strips(&filter);
 
-    return kernel;
-}
+    if (strips.parseArguments(a.arguments())) {
+        bool ok = strips.run();
 
-int main(int argc, char *argv[])
-{
-    QCoreApplication a(argc, argv);
-    Q_UNUSED(a)
+        if (!ok)
+            qCritical() << qPrintable(strips.errorString());
+
+        qDebug() << "Size:" << strips.imageSize().width()
+                 << "x" << strips.imageSize().height()
+                 << "MP/s:" << strips.megapixelsPerSecond()
+                 << "Peak memory:" << (strips.peakMemory() >> 20) << "MB";
 
+        return ok? EXIT_SUCCESS: EXIT_FAILURE;
+    }
+
+    DenoiseTraceScope stage("load");
     QImage inImage("lena.png");
+    stage.next("convert");
     inImage = inImage.convertToFormat(QImage::Format_RGB32);
     QImage outImage(inImage.size(), inImage.format());
 
-    // Here we configure the denoise parameters.
-    int radius = 3;
-    qreal sigma = 1000;
-
-    // Create gaussian denoise kernel.
-    int kw;
-    QVector<qreal> kernel = gaussKernel(radius, sigma, &kw);
-
     // Add noise to the image
+    stage.next("noise");
     qsrand(QTime::currentTime().msec());
 
     for (int i = 0; i < 100000; i++) {
@@ -146,46 +149,31 @@ int main(int argc, char *argv[])
                               qrand() % 256));
     }
 
-    QElapsedTimer timer;
-    timer.start();
-
-    for (int y = 0; y < inImage.height(); y++) {
-        const QRgb *iLine = (const QRgb *) inImage.constScanLine(y);
-        QRgb *oLine = (QRgb *) outImage.scanLine(y);
-
-        for (int x = 0; x < inImage.width(); x++) {
-            PixelReal sum;
-            qreal sumW = 0;
+    stage.next(0);
 
-            // Apply kernel.
-            for (int j = 0, pos = 0; j < kw; j++) {
-                const QRgb *line = (const QRgb *) inImage.constScanLine(y + j - radius);
+    // The filter works directly over the pixels of the images.
+    DenoiseImage in(inImage.constBits(),
+                    inImage.width(),
+                    inImage.height(),
+                    inImage.bytesPerLine(),
+                    DenoiseFormatRGB32);
+    DenoiseImage out(outImage.bits(),
+                     outImage.width(),
+                     outImage.height(),
+                     outImage.bytesPerLine(),
+                     DenoiseFormatRGB32);
 
-                if (y + j < radius
-                    || y + j >= radius + inImage.height())
-                    continue;
-
-                for (int i = 0; i < kw; i++, pos++) {
-                    if (x + i < radius
-                        || x + i >= radius + inImage.width())
-                        continue;
-
-                    PixelU8 pixel(line[x + i - radius]);
-                    qreal weight = kernel[pos];
-                    sum += weight * pixel;
-                    sumW += weight;
-                }
-            }
-
-            // We normallize the kernel because the size of the kernel is not
-            // fixed.
-            sum /= sumW;
+    QElapsedTimer timer;
+    timer.start();
+    filter.process(in, out);
+    qDebug() << timer.elapsed();
 
-            oLine[x] = qRgba(sum.r, sum.g, sum.b, qAlpha(iLine[x]));
-        }
-    }
+    if (filter.currentMethod() == GaussMethodRecursive)
+        qDebug() << "Max error:" << filter.recursiveError();
+    else if (filter.currentMethod() == GaussMethodBox)
+        qDebug() << "Max error:" << filter.boxError();
 
-    qDebug() << timer.elapsed();
+    stage.next("save");
     outImage.save("gauss.png");
 
     return EXIT_SUCCESS;
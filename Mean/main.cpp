@@ -18,252 +18,132 @@
  * Web-Site: http://github.com/hipersayanX/DenoiseFilters
  */
 
-#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <QCoreApplication>
 #include <QImage>
 #include <QTime>
 #include <QElapsedTimer>
 #include <QDebug>
 
-template<typename T> class Pixel
-{
-    public:
-        explicit Pixel():
-            r(0), g(0), b(0)
-        {
-        }
-        Pixel(T r, T g, T b):
-            r(r), g(g), b(b)
-        {
-        }
-
-        Pixel &operator =(QRgb pixel)
-        {
-            this->r = qRed(pixel);
-            this->g = qGreen(pixel);
-            this->b = qBlue(pixel);
-
-            return *this;
-        }
-
-        Pixel operator +(const Pixel &other) const
-        {
-            return Pixel(this->r + other.r,
-                         this->g + other.g,
-                         this->b + other.b);
-        }
-
-        Pixel operator +(int c) const
-        {
-            return Pixel(this->r + c,
-                         this->g + c,
-                         this->b + c);
-        }
+#include "denoisebatch.h"
+#include "denoisestream.h"
+#include "denoisestrips.h"
+#include "denoisetrace.h"
+#include "denoisetuner.h"
+#include "meanfilter.h"
+#include "tilescheduler.h"
 
-        template <typename R> Pixel operator -(const Pixel<R> &other) const
-        {
-            return Pixel(this->r - other.r,
-                         this->g - other.g,
-                         this->b - other.b);
-        }
-
-        template <typename R> Pixel operator *(const Pixel<R> &other) const
-        {
-            return Pixel(this->r * other.r,
-                         this->g * other.g,
-                         this->b * other.b);
-        }
-
-        template <typename R> Pixel<R> operator /(R c) const
-        {
-            return Pixel<R>(this->r / c,
-                            this->g / c,
-                            this->b / c);
-        }
-
-        template <typename R> Pixel operator /(const Pixel<R> &pixel) const
-        {
-            return Pixel(this->r / pixel.r,
-                         this->g / pixel.g,
-                         this->b / pixel.b);
-        }
-
-        Pixel operator <<(int bits) const
-        {
-            return Pixel(this->r << bits,
-                         this->g << bits,
-                         this->b << bits);
-        }
-
-        template <typename R> Pixel operator |(const Pixel<R> &other) const
-        {
-            return Pixel(this->r | other.r,
-                         this->g | other.g,
-                         this->b | other.b);
-        }
-
-        template <typename R> Pixel &operator +=(const Pixel<R> &other)
-        {
-            this->r += other.r;
-            this->g += other.g;
-            this->b += other.b;
-
-            return *this;
-        }
-
-        template <typename R> Pixel &operator /=(const Pixel<R> &other)
-        {
-            this->r /= other.r;
-            this->g /= other.g;
-            this->b /= other.b;
-
-            return *this;
-        }
-
-        Pixel &operator +=(QRgb pixel)
-        {
-            this->r += qRed(pixel);
-            this->g += qGreen(pixel);
-            this->b += qBlue(pixel);
-
-            return *this;
-        }
-
-        T r;
-        T g;
-        T b;
-};
-
-typedef Pixel<qint8> PixelI8;
-typedef Pixel<quint8> PixelU8;
-typedef Pixel<qint32> PixelI32;
-typedef Pixel<quint32> PixelU32;
-typedef Pixel<qint64> PixelI64;
-typedef Pixel<quint64> PixelU64;
-typedef Pixel<qreal> PixelReal;
-
-template<typename T> Pixel<T> exp(const Pixel<T> &pixel)
-{
-    return Pixel<T>(std::exp(pixel.r),
-                    std::exp(pixel.g),
-                    std::exp(pixel.b));
-}
-
-template <typename R, typename S> inline Pixel<R> mult(R c, const Pixel<S> &pixel)
-{
-    return Pixel<R>(c * pixel.r,
-                    c * pixel.g,
-                    c * pixel.b);
-}
-
-inline PixelU64 pow2(QRgb pixel)
-{
-    quint8 r = qRed(pixel);
-    quint8 g = qGreen(pixel);
-    quint8 b = qBlue(pixel);
-
-    return PixelU64(r * r, g * g, b * b);
-}
-
-template<typename T> inline Pixel<T> pow2(const Pixel<T> &pixel)
-{
-    return Pixel<T>(pixel.r * pixel.r,
-                    pixel.g * pixel.g,
-                    pixel.b * pixel.b);
-}
-
-template<typename T> inline Pixel<T> sqrt(const Pixel<T> &pixel)
+int main(int argc, char *argv[])
 {
-    return Pixel<T>(std::sqrt(pixel.r),
-                    std::sqrt(pixel.g),
-                    std::sqrt(pixel.b));
-}
+    QCoreApplication a(argc, argv);
 
-template<typename T> Pixel<T> bound(T min, const Pixel<T> &pixel, T max)
-{
-    return Pixel<T>(qBound(min, pixel.r, max),
-                    qBound(min, pixel.g, max),
-                    qBound(min, pixel.b, max));
-}
+    // Tracing, "--trace FILE" saves the time spent in each stage, by
+    // thread, while the program runs, as CSV if FILE ends in ".csv" or as a
+    // Chrome trace otherwise. "--trace-counters" adds the cycles,
+    // instructions and cache misses of each stage, on Linux.
+    DenoiseTrace *trace = DenoiseTrace::globalInstance();
 
-template<typename T> inline Pixel<T> integralSum(const Pixel<T> *integral,
-                                                 int lineWidth,
-                                                 int x, int y, int kw, int kh)
-{
+    if (trace->parseArguments(a.arguments()))
+        trace->start();
 
-    const Pixel<T> *p0 = integral + x + y * lineWidth;
-    const Pixel<T> *p1 = p0 + kw;
-    const Pixel<T> *p2 = p0 + kh * lineWidth;
-    const Pixel<T> *p3 = p2 + kw;
+    // Number of threads used by the filter, 0 uses one thread per core.
+    int threads = 0;
+    TileScheduler scheduler(threads);
 
-    return *p0 + *p3 - *p1 - *p2;
-}
+    // Here we configure the denoise parameters.
+    MeanFilter filter(&scheduler);
+    filter.radius = 3;
+    filter.mu = 0;
+    filter.sigma = 1;
+
+    // MeanMethodHistogram is faster for big radius, and MeanMethodFloat is
+    // about 4 times faster than the direct method, both with an error of 1
+    // level at most.
+    filter.method = filter.radius > 6? MeanMethodHistogram: MeanMethodDirect;
+    filter.tiledIntegral = true;
+    filter.border = DenoiseBorderClipped;
+
+    // DenoiseColorsLuma only filters the brightness, about 3 times faster,
+    // the weights of the mean cost much more than the YCbCr conversion.
+    filter.colors = DenoiseColorsRGB;
+
+    // Tuning, "--tune FILE" replaces the method above with the fastest
+    // one for each image, with an error of 1 level at most. The methods are
+    // measured in the first run, and the costs are cached in FILE.
+    DenoiseTuner tuner(&scheduler);
+    tuner.maxError = 1;
+
+    if (tuner.parseArguments(a.arguments()) && tuner.calibrate())
+        filter.tuner = &tuner;
+
+    // Streaming mode, "--stream" filters the frames read from the standard
+    // input and writes them to the standard output, "--incremental" only
+    // filters the parts of the frames that changed.
+    DenoiseStream stream(&filter);
+
+    if (stream.parseArguments(a.arguments())) {
+        if (!stream.run(stdin, stdout)) {
+            qCritical() << qPrintable(stream.errorString());
+
+            return EXIT_FAILURE;
+        }
+
+        qDebug() << "Frames:" << stream.frames()
+                 << "FPS:" << stream.framesPerSecond()
+                 << "Latency:" << stream.averageLatency()
+                 << "ms, max:" << stream.maxLatency() << "ms"
+                 << "Dirty:" << stream.dirtyRatio();
+
+        return EXIT_SUCCESS;
+    }
 
-template <typename T> inline Pixel<quint32> operator *(quint32 c, const Pixel<T> &pixel)
-{
-    return Pixel<quint32>(c * pixel.r,
-                          c * pixel.g,
-                          c * pixel.b);
-}
+    // Batch mode, "--batch INPUT OUTPUT" filters all the images of the
+    // INPUT directory, or list of files, and saves them in OUTPUT.
+    DenoiseBatch batch(&filter);
 
-void integralImage(const QImage &image,
-                   QVector<PixelU8> &planes,
-                   QVector<PixelU32> &integral,
-                   QVector<PixelU64> &integral2)
-{
-    int oWidth = image.width() + 1;
-    int oHeight = image.height() + 1;
-    planes.resize(image.width() * image.height());
-    integral.resize(oWidth * oHeight);
-    integral2.resize(oWidth * oHeight);
+    if (batch.parseArguments(a.arguments())) {
+        bool ok = batch.run();
 
-    for (int y = 1; y < oHeight; y++) {
-        const QRgb *line = (const QRgb *) image.constScanLine(y - 1);
-        PixelU8 *planesLine = planes.data()
-                              + (y - 1) * image.width();
+        if (!ok)
+            qCritical() << qPrintable(batch.errorString());
 
-        // Reset current line summation.
-        PixelU32 sum;
-        PixelU64 sum2;
+        qDebug() << "Images:" << batch.images()
+                 << "Failed:" << batch.failedImages()
+                 << "Images/s:" << batch.imagesPerSecond()
+                 << "MP/s:" << batch.megapixelsPerSecond()
+                 << "Peak memory:" << (batch.peakMemory() >> 20) << "MB";
 
-        for (int x = 1; x < oWidth; x++) {
-            QRgb pixel = line[x - 1];
+        return ok? EXIT_SUCCESS: EXIT_FAILURE;
+    }
 
-            // Accumulate pixels in current line.
-            sum += pixel;
-            sum2 += pow2(pixel);
+    // Strips mode, "--strips INPUT OUTPUT" filters a binary PGM or PPM image
+    // of any size a few lines at a time, "--strip-height N" sets the lines
+    // of each strip.
+    DenoiseStrips strips(&filter);
 
-            // Offset to the current line.
-            int offset = x + y * oWidth;
+    if (strips.parseArguments(a.arguments())) {
+        bool ok = strips.run();
 
-            // Offset to the previous line.
-            // equivalent to x + (y - 1) * oWidth;
-            int offsetPrevious = offset - oWidth;
+        if (!ok)
+            qCritical() << qPrintable(strips.errorString());
 
-            planesLine[x - 1] = pixel;
+        qDebug() << "Size:" << strips.imageSize().width()
+                 << "x" << strips.imageSize().height()
+                 << "MP/s:" << strips.megapixelsPerSecond()
+                 << "Peak memory:" << (strips.peakMemory() >> 20) << "MB";
 
-            // Accumulate current line and previous line.
-            integral[offset] = sum + integral[offsetPrevious];
-            integral2[offset] = sum2 + integral2[offsetPrevious];
-        }
+        return ok? EXIT_SUCCESS: EXIT_FAILURE;
     }
-}
-
-int main(int argc, char *argv[])
-{
-    QCoreApplication a(argc, argv);
-    Q_UNUSED(a)
 
+    DenoiseTraceScope stage("load");
     QImage inImage("lena.png");
+    stage.next("convert");
     inImage = inImage.convertToFormat(QImage::Format_RGB32);
     QImage outImage(inImage.size(), inImage.format());
 
-    // Here we configure the denoise parameters.
-    int radius = 3;
-    int mu = 0;
-    qreal sigma = 1;
-
     // Add noise to the image
+    stage.next("noise");
     qsrand(QTime::currentTime().msec());
 
     for (int i = 0; i < 100000; i++) {
@@ -274,65 +154,27 @@ int main(int argc, char *argv[])
                               qrand() % 256));
     }
 
-    int oWidth = inImage.width() + 1;
-    QVector<PixelU8> planes;
-    QVector<PixelU32> integral;
-    QVector<PixelU64> integral2;
-    integralImage(inImage, planes, integral, integral2);
+    stage.next(0);
+
+    // The filter works directly over the pixels of the images.
+    DenoiseImage in(inImage.constBits(),
+                    inImage.width(),
+                    inImage.height(),
+                    inImage.bytesPerLine(),
+                    DenoiseFormatRGB32);
+    DenoiseImage out(outImage.bits(),
+                     outImage.width(),
+                     outImage.height(),
+                     outImage.bytesPerLine(),
+                     DenoiseFormatRGB32);
 
     QElapsedTimer timer;
     timer.start();
-
-    for (int y = 0, pos = 0; y < inImage.height(); y++) {
-        const QRgb *iLine = (const QRgb *) inImage.constScanLine(y);
-        QRgb *oLine = (QRgb *) outImage.scanLine(y);
-        int yp = qMax(y - radius, 0);
-        int kh = qMin(y + radius, inImage.height() - 1) - yp + 1;
-
-        for (int x = 0; x < inImage.width(); x++, pos++) {
-            int xp = qMax(x - radius, 0);
-            int kw = qMin(x + radius, inImage.width() - 1) - xp + 1;
-
-            // Calculate summation and cuadratic summation of the pixels.
-            PixelU32 sum = integralSum(integral.constData(), oWidth,
-                                       xp, yp, kw, kh);
-            PixelU64 sum2 = integralSum(integral2.constData(), oWidth,
-                                        xp, yp, kw, kh);
-            qreal ks = kw * kh;
-
-            // Calculate mean and standard deviation.
-            PixelReal mean = sum / ks;
-            PixelReal dev = sqrt(ks * sum2 - pow2(sum)) / ks;
-
-            mean = bound(0., mean + mu, 255.);
-            dev = bound(0., mult(sigma, dev), 127.);
-
-            PixelReal sumP;
-            PixelReal sumW;
-
-            for (int j = 0; j < kh; j++) {
-                const PixelU8 *line = planes.constData()
-                                      + (yp + j) * inImage.width();
-
-                for (int i = 0; i < kw; i++) {
-                    // Calculate weighted avverage.
-                    PixelU8 pixel = line[xp + i];
-                    PixelReal d = mean - pixel;
-                    PixelReal h = mult(-2., dev * dev);
-                    PixelReal weight = exp(d * d / h);
-                    sumP += weight * pixel;
-                    sumW += weight;
-                }
-            }
-
-            // Normalize result.
-            sumP /= sumW;
-
-            oLine[x] = qRgba(sumP.r, sumP.g, sumP.b, qAlpha(iLine[x]));
-        }
-    }
-
+    filter.process(in, out);
     qDebug() << timer.elapsed();
+    qDebug() << "Integral image size:" << filter.integralSize();
+
+    stage.next("save");
     outImage.save("mean.png");
 
     return EXIT_SUCCESS;
@@ -26,3 +26,5 @@ CONFIG -= app_bundle
 TEMPLATE = app
 
 SOURCES += main.cpp
+
+include(../DenoiseLib/DenoiseLib.pri)
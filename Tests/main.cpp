@@ -0,0 +1,1581 @@
+/* DenoiseFilters, Implementation of Gauss, Mean and Median filters in Qt/C++.
+ * Copyright (C) 2015  Gonzalo Exequiel Pedone
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Email   : hipersayan DOT x AT gmail DOT com
+ * Web-Site: http://github.com/hipersayanX/DenoiseFilters
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QtAlgorithms>
+#include <QVector>
+#include <QtMath>
+
+#include "allocationcounter.h"
+#include "denoisechain.h"
+#include "denoiseincremental.h"
+#include "denoisestrips.h"
+#include "denoisetrace.h"
+#include "gaussfilter.h"
+#include "meanfilter.h"
+#include "medianfilter.h"
+#include "pseudomedianfilter.h"
+#include "tilescheduler.h"
+
+static const int testWidth = 320;
+static const int testHeight = 240;
+static const int testRadius = 3;
+
+// Fixed pseudo random samples.
+class TestRandom
+{
+    public:
+        explicit TestRandom(quint32 seed):
+            state(seed)
+        {
+        }
+
+        quint32 next()
+        {
+            this->state = 1664525 * this->state + 1013904223;
+
+            return this->state >> 8;
+        }
+
+    private:
+        quint32 state;
+};
+
+// A chain that owns its filters.
+class TestChainFilter: public DenoiseChain
+{
+    public:
+        explicit TestChainFilter(TileScheduler *scheduler):
+            DenoiseChain(scheduler)
+        {
+        }
+
+        ~TestChainFilter()
+        {
+            qDeleteAll(this->filters);
+        }
+};
+
+// A luma filter that owns its chroma filter.
+class TestLumaFilter: public MedianFilter
+{
+    public:
+        explicit TestLumaFilter(TileScheduler *scheduler):
+            MedianFilter(scheduler)
+        {
+        }
+
+        ~TestLumaFilter()
+        {
+            delete this->chromaFilter;
+        }
+};
+
+// The 2D Gauss kernel applied pixel by pixel, the windows are clipped and
+// the weights normalized by their sum inside the image.
+class TestGaussKernel: public DenoiseFilter
+{
+    public:
+        TestGaussKernel(TileScheduler *scheduler, int radius, qreal sigma):
+            DenoiseFilter(scheduler),
+            radius(radius),
+            sigma(sigma)
+        {
+        }
+
+    protected:
+        void filter(const DenoiseChannel &in, const DenoiseChannel &out)
+        {
+            this->filterKernel(in, out);
+        }
+
+        void filter(const DenoiseChannel16 &in, const DenoiseChannel16 &out)
+        {
+            this->filterKernel(in, out);
+        }
+
+        void filter(const DenoiseChannelFloat &in,
+                    const DenoiseChannelFloat &out)
+        {
+            this->filterKernel(in, out);
+        }
+
+    private:
+        int radius;
+        qreal sigma;
+
+        template <typename T>
+        void filterKernel(const DenoiseTypedChannel<T> &in,
+                          const DenoiseTypedChannel<T> &out) const
+        {
+            qreal sigma2 = -2 * this->sigma * this->sigma;
+
+            for (int y = 0; y < in.height; y++)
+                for (int x = 0; x < in.width; x++) {
+                    qreal sum = 0;
+                    qreal sumW = 0;
+
+                    for (int j = -this->radius; j <= this->radius; j++) {
+                        if (y + j < 0 || y + j >= in.height)
+                            continue;
+
+                        for (int i = -this->radius; i <= this->radius; i++) {
+                            if (x + i < 0 || x + i >= in.width)
+                                continue;
+
+                            qreal weight = qExp((i * i + j * j) / sigma2);
+                            sum += weight * in.pixel(x + i, y + j);
+                            sumW += weight;
+                        }
+                    }
+
+                    sum /= sumW;
+                    out.pixel(x, y) = DenoiseSampleTraits<T>::fromReal(sum);
+                }
+        }
+};
+
+struct TestFilter
+{
+    const char *name;
+    DenoiseFilter *(*create)(TileScheduler *scheduler);
+};
+
+static const TestFilter testFilters[] = {
+    {"gauss/separable", [] (TileScheduler *scheduler) -> DenoiseFilter * {
+         GaussFilter *filter = new GaussFilter(scheduler);
+         filter->radius = testRadius;
+         filter->method = GaussMethodSeparable;
+
+         return filter;
+     }},
+    {"gauss/recursive", [] (TileScheduler *scheduler) -> DenoiseFilter * {
+         GaussFilter *filter = new GaussFilter(scheduler);
+         filter->radius = testRadius;
+         filter->method = GaussMethodRecursive;
+
+         return filter;
+     }},
+    {"gauss/recursive sigma 3",
+     [] (TileScheduler *scheduler) -> DenoiseFilter * {
+         GaussFilter *filter = new GaussFilter(scheduler);
+         filter->radius = testRadius;
+         filter->sigma = testRadius;
+         filter->method = GaussMethodRecursive;
+
+         return filter;
+     }},
+    {"gauss/fixedpoint", [] (TileScheduler *scheduler) -> DenoiseFilter * {
+         GaussFilter *filter = new GaussFilter(scheduler);
+         filter->radius = testRadius;
+         filter->method = GaussMethodFixedPoint;
+
+         return filter;
+     }},
+    {"gauss/box", [] (TileScheduler *scheduler) -> DenoiseFilter * {
+         GaussFilter *filter = new GaussFilter(scheduler);
+         filter->radius = testRadius;
+         filter->method = GaussMethodBox;
+
+         return filter;
+     }},
+    {"gauss/reflect", [] (TileScheduler *scheduler) -> DenoiseFilter * {
+         GaussFilter *filter = new GaussFilter(scheduler);
+         filter->radius = testRadius;
+         filter->border = DenoiseBorderReflect;
+
+         return filter;
+     }},
+    {"mean/direct", [] (TileScheduler *scheduler) -> DenoiseFilter * {
+         MeanFilter *filter = new MeanFilter(scheduler);
+         filter->radius = testRadius;
+         filter->method = MeanMethodDirect;
+
+         return filter;
+     }},
+    {"mean/histogram", [] (TileScheduler *scheduler) -> DenoiseFilter * {
+         MeanFilter *filter = new MeanFilter(scheduler);
+         filter->radius = testRadius;
+         filter->method = MeanMethodHistogram;
+
+         return filter;
+     }},
+    {"mean/float", [] (TileScheduler *scheduler) -> DenoiseFilter * {
+         MeanFilter *filter = new MeanFilter(scheduler);
+         filter->radius = testRadius;
+         filter->method = MeanMethodFloat;
+
+         return filter;
+     }},
+    {"median/sort", [] (TileScheduler *scheduler) -> DenoiseFilter * {
+         MedianFilter *filter = new MedianFilter(scheduler);
+         filter->radius = testRadius;
+         filter->method = MedianMethodSort;
+
+         return filter;
+     }},
+    {"median/histogram", [] (TileScheduler *scheduler) -> DenoiseFilter * {
+         MedianFilter *filter = new MedianFilter(scheduler);
+         filter->radius = testRadius;
+         filter->method = MedianMethodHistogram;
+
+         return filter;
+     }},
+    {"median/network", [] (TileScheduler *scheduler) -> DenoiseFilter * {
+         MedianFilter *filter = new MedianFilter(scheduler);
+         filter->radius = testRadius;
+         filter->method = MedianMethodNetwork;
+
+         return filter;
+     }},
+    {"median/switching", [] (TileScheduler *scheduler) -> DenoiseFilter * {
+         MedianFilter *filter = new MedianFilter(scheduler);
+         filter->radius = testRadius;
+         filter->switching = true;
+
+         return filter;
+     }},
+    {"median/luma", [] (TileScheduler *scheduler) -> DenoiseFilter * {
+         MedianFilter *filter = new MedianFilter(scheduler);
+         filter->radius = testRadius;
+         filter->colors = DenoiseColorsLuma;
+
+         return filter;
+     }},
+    {"median/luma+chroma", [] (TileScheduler *scheduler) -> DenoiseFilter * {
+         // The windows of the chroma are bigger than the ones of the luma.
+         TestLumaFilter *filter = new TestLumaFilter(scheduler);
+         filter->radius = 1;
+         filter->colors = DenoiseColorsLuma;
+         MeanFilter *chroma = new MeanFilter(scheduler);
+         chroma->radius = 3 * testRadius;
+         filter->chromaFilter = chroma;
+
+         return filter;
+     }},
+    {"pseudomedian", [] (TileScheduler *scheduler) -> DenoiseFilter * {
+         PseudoMedianFilter *filter = new PseudoMedianFilter(scheduler);
+         filter->radius = testRadius;
+
+         return filter;
+     }},
+    {"chain", [] (TileScheduler *scheduler) -> DenoiseFilter * {
+         TestChainFilter *chain = new TestChainFilter(scheduler);
+         MedianFilter *median = new MedianFilter(scheduler);
+         median->radius = testRadius;
+         median->method = MedianMethodHistogram;
+         GaussFilter *gauss = new GaussFilter(scheduler);
+         gauss->radius = testRadius;
+         chain->filters << median << gauss;
+
+         return chain;
+     }},
+};
+
+struct TestFormat
+{
+    const char *name;
+    DenoiseFormat format;
+    int bytesPerPixel;
+};
+
+static const TestFormat testFormats[] = {
+    {"rgb32", DenoiseFormatRGB32, 4},
+    {"gray16", DenoiseFormatGray16, 2},
+    {"rgbafloat", DenoiseFormatRGBAFloat, 16},
+};
+
+// Random samples for each format, the floating point samples are kept in
+// [0, 1].
+static QVector<quint8> testImage(const TestFormat &format)
+{
+    QVector<quint8> image(testWidth * testHeight * format.bytesPerPixel);
+    TestRandom random(1);
+
+    if (format.format == DenoiseFormatRGBAFloat) {
+        float *samples = reinterpret_cast<float *>(image.data());
+
+        for (int i = 0; i < image.size() / 4; i++)
+            samples[i] = float(random.next() % 256) / 255;
+    } else {
+        for (int i = 0; i < image.size(); i++)
+            image[i] = quint8(random.next());
+    }
+
+    return image;
+}
+
+// A diagonal gradient with 2 bits of noise, the averages of its windows are
+// often close to an integer.
+static QVector<quint8> testSmoothImage(const TestFormat &format)
+{
+    QVector<quint8> image(testWidth * testHeight * format.bytesPerPixel);
+    int samples = format.format == DenoiseFormatRGBAFloat?
+                      image.size() / 4:
+                  format.format == DenoiseFormatGray16?
+                      image.size() / 2: image.size();
+    int lineSamples = samples / testHeight;
+    TestRandom random(5);
+
+    for (int i = 0; i < samples; i++) {
+        int x = i % lineSamples * testWidth / lineSamples;
+        int y = i / lineSamples;
+        int value = qMin(252 * (x + y) / (testWidth + testHeight)
+                         + int(random.next() % 4), 255);
+
+        if (format.format == DenoiseFormatRGBAFloat)
+            reinterpret_cast<float *>(image.data())[i] = float(value) / 255;
+        else if (format.format == DenoiseFormatGray16)
+            reinterpret_cast<quint16 *>(image.data())[i] = quint16(257 * value);
+        else
+            image[i] = quint8(value);
+    }
+
+    return image;
+}
+
+// A gray floating point image over samples.
+static DenoiseImage testGrayFloat(QVector<float> &samples,
+                                  int width,
+                                  int height)
+{
+    return DenoiseImage(reinterpret_cast<uchar *>(samples.data()),
+                        width, height, width * int(sizeof(float)),
+                        DenoiseFormatGrayFloat);
+}
+
+// Largest difference between two images of the format, in 8 bits levels.
+static qreal testDifference(const QVector<quint8> &image1,
+                            const QVector<quint8> &image2,
+                            const TestFormat &format)
+{
+    qreal difference = 0;
+
+    if (format.format == DenoiseFormatRGBAFloat) {
+        const float *samples1 =
+            reinterpret_cast<const float *>(image1.constData());
+        const float *samples2 =
+            reinterpret_cast<const float *>(image2.constData());
+
+        for (int i = 0; i < image1.size() / 4; i++)
+            difference = qMax(difference,
+                              255 * qAbs(qreal(samples1[i]) - samples2[i]));
+    } else if (format.format == DenoiseFormatGray16) {
+        const quint16 *samples1 =
+            reinterpret_cast<const quint16 *>(image1.constData());
+        const quint16 *samples2 =
+            reinterpret_cast<const quint16 *>(image2.constData());
+
+        for (int i = 0; i < image1.size() / 2; i++)
+            difference = qMax(difference,
+                              qAbs(qreal(samples1[i]) - samples2[i]) / 257);
+    } else {
+        for (int i = 0; i < image1.size(); i++)
+            difference = qMax(difference,
+                              qAbs(qreal(image1[i]) - image2[i]));
+    }
+
+    return difference;
+}
+
+// Filters the test image of the format, returns false if it failed.
+static bool testProcess(DenoiseFilter *filter,
+                        const TestFormat &format,
+                        const QVector<quint8> &input,
+                        QVector<quint8> &output)
+{
+    int stride = testWidth * format.bytesPerPixel;
+    output.fill(0, input.size());
+
+    return filter->process(DenoiseImage(input.constData(),
+                                        testWidth, testHeight, stride,
+                                        format.format),
+                           DenoiseImage(output.data(),
+                                        testWidth, testHeight, stride,
+                                        format.format));
+}
+
+// A method that must give the same output as the reference one, up to
+// maxError 8 bits levels, including the borders.
+struct TestEquivalence
+{
+    const char *name;
+    int radius;
+    DenoiseFilter *(*create)(TileScheduler *scheduler, int radius);
+    DenoiseFilter *(*reference)(TileScheduler *scheduler, int radius);
+    qreal maxError;
+};
+
+static DenoiseFilter *testMedian(TileScheduler *scheduler, int radius)
+{
+    MedianFilter *filter = new MedianFilter(scheduler);
+    filter->radius = radius;
+    filter->method = MedianMethodSort;
+
+    return filter;
+}
+
+static DenoiseFilter *testMedianHistogram(TileScheduler *scheduler,
+                                          int radius)
+{
+    MedianFilter *filter = new MedianFilter(scheduler);
+    filter->radius = radius;
+    filter->method = MedianMethodHistogram;
+
+    return filter;
+}
+
+static DenoiseFilter *testMedianNetwork(TileScheduler *scheduler,
+                                        int radius)
+{
+    MedianFilter *filter = new MedianFilter(scheduler);
+    filter->radius = radius;
+    filter->method = MedianMethodNetwork;
+
+    return filter;
+}
+
+static DenoiseFilter *testMean(TileScheduler *scheduler, int radius)
+{
+    MeanFilter *filter = new MeanFilter(scheduler);
+    filter->radius = radius;
+    filter->method = MeanMethodDirect;
+
+    return filter;
+}
+
+static DenoiseFilter *testMeanHistogram(TileScheduler *scheduler, int radius)
+{
+    MeanFilter *filter = new MeanFilter(scheduler);
+    filter->radius = radius;
+    filter->method = MeanMethodHistogram;
+
+    return filter;
+}
+
+// The other mean filters use the default tiled integral images.
+static DenoiseFilter *testMeanFullFrame(TileScheduler *scheduler, int radius)
+{
+    MeanFilter *filter = new MeanFilter(scheduler);
+    filter->radius = radius;
+    filter->tiledIntegral = false;
+
+    return filter;
+}
+
+static DenoiseFilter *testPseudoMedian(TileScheduler *scheduler, int radius)
+{
+    PseudoMedianFilter *filter = new PseudoMedianFilter(scheduler);
+    filter->radius = radius;
+
+    return filter;
+}
+
+// The line by line version of the pseudo median, only the 8 bits chains
+// are fused.
+static DenoiseFilter *testPseudoMedianLines(TileScheduler *scheduler,
+                                            int radius)
+{
+    TestChainFilter *chain = new TestChainFilter(scheduler);
+    chain->filters << testPseudoMedian(scheduler, radius);
+
+    return chain;
+}
+
+static DenoiseFilter *testGauss(TileScheduler *scheduler, int radius)
+{
+    GaussFilter *filter = new GaussFilter(scheduler);
+    filter->radius = radius;
+    filter->sigma = radius;
+
+    return filter;
+}
+
+static DenoiseFilter *testGaussFixedPoint(TileScheduler *scheduler,
+                                          int radius)
+{
+    GaussFilter *filter = new GaussFilter(scheduler);
+    filter->radius = radius;
+    filter->sigma = radius;
+    filter->method = GaussMethodFixedPoint;
+
+    return filter;
+}
+
+// The separable Gauss filter against the 2D kernel, with a sigma other
+// than the radius.
+static DenoiseFilter *testGaussSigma(TileScheduler *scheduler,
+                                     int radius,
+                                     qreal sigma)
+{
+    GaussFilter *filter = new GaussFilter(scheduler);
+    filter->radius = radius;
+    filter->sigma = sigma;
+    filter->method = GaussMethodSeparable;
+
+    return filter;
+}
+
+static DenoiseFilter *testGaussKernel(TileScheduler *scheduler, int radius)
+{
+    return new TestGaussKernel(scheduler, radius, radius);
+}
+
+static const TestEquivalence testEquivalences[] = {
+    {"median/histogram radius 1", 1, testMedianHistogram, testMedian, 0},
+    {"median/histogram radius 3", 3, testMedianHistogram, testMedian, 0},
+    {"median/histogram radius 7", 7, testMedianHistogram, testMedian, 0},
+    {"median/histogram reflect", 3,
+     [] (TileScheduler *scheduler, int radius) {
+         DenoiseFilter *filter = testMedianHistogram(scheduler, radius);
+         filter->border = DenoiseBorderReflect;
+
+         return filter;
+     },
+     [] (TileScheduler *scheduler, int radius) {
+         DenoiseFilter *filter = testMedian(scheduler, radius);
+         filter->border = DenoiseBorderReflect;
+
+         return filter;
+     }, 0},
+    {"median/network radius 1", 1, testMedianNetwork, testMedian, 0},
+    {"median/network radius 2", 2, testMedianNetwork, testMedian, 0},
+    {"median/network radius 3", 3, testMedianNetwork, testMedian, 0},
+    {"median/network replicate", 1,
+     [] (TileScheduler *scheduler, int radius) {
+         DenoiseFilter *filter = testMedianNetwork(scheduler, radius);
+         filter->border = DenoiseBorderReplicate;
+
+         return filter;
+     },
+     [] (TileScheduler *scheduler, int radius) {
+         DenoiseFilter *filter = testMedian(scheduler, radius);
+         filter->border = DenoiseBorderReplicate;
+
+         return filter;
+     }, 0},
+    {"mean/histogram radius 1", 1, testMeanHistogram, testMean, 0},
+    {"mean/histogram radius 3", 3, testMeanHistogram, testMean, 0},
+    {"mean/histogram radius 7", 7, testMeanHistogram, testMean, 0},
+    {"mean/tiled radius 1", 1, testMean, testMeanFullFrame, 0},
+    {"mean/tiled radius 7", 7, testMean, testMeanFullFrame, 0},
+    {"mean/tiled radius 20", 20, testMean, testMeanFullFrame, 0},
+    {"pseudomedian/bands radius 1", 1,
+     testPseudoMedian, testPseudoMedianLines, 0},
+    {"pseudomedian/bands radius 4", 4,
+     testPseudoMedian, testPseudoMedianLines, 0},
+    {"pseudomedian/bands radius 20", 20,
+     testPseudoMedian, testPseudoMedianLines, 0},
+    {"gauss/fixedpoint radius 1", 1, testGaussFixedPoint, testGauss, 1},
+    {"gauss/fixedpoint radius 3", 3, testGaussFixedPoint, testGauss, 1},
+    {"gauss/fixedpoint radius 8", 8, testGaussFixedPoint, testGauss, 1},
+    {"gauss/separable radius 1", 1, testGauss, testGaussKernel, 1},
+    {"gauss/separable radius 3", 3, testGauss, testGaussKernel, 1},
+    {"gauss/separable radius 8", 8, testGauss, testGaussKernel, 1},
+    {"gauss/separable sigma 0.5", 3,
+     [] (TileScheduler *scheduler, int radius) {
+         return testGaussSigma(scheduler, radius, 0.5);
+     },
+     [] (TileScheduler *scheduler, int radius) -> DenoiseFilter * {
+         return new TestGaussKernel(scheduler, radius, 0.5);
+     }, 1},
+    {"gauss/separable sigma 1", 5,
+     [] (TileScheduler *scheduler, int radius) {
+         return testGaussSigma(scheduler, radius, 1);
+     },
+     [] (TileScheduler *scheduler, int radius) -> DenoiseFilter * {
+         return new TestGaussKernel(scheduler, radius, 1);
+     }, 1},
+    {"gauss/separable sigma 20", 4,
+     [] (TileScheduler *scheduler, int radius) {
+         return testGaussSigma(scheduler, radius, 20);
+     },
+     [] (TileScheduler *scheduler, int radius) -> DenoiseFilter * {
+         return new TestGaussKernel(scheduler, radius, 20);
+     }, 1},
+};
+
+// The histogram mean adds the weighted pixels in another order than the
+// direct method, in smooth images the truncation changes some pixels by 1
+// level.
+static const TestEquivalence testSmoothEquivalences[] = {
+    {"mean/histogram smooth radius 1", 1, testMeanHistogram, testMean, 1},
+    {"mean/histogram smooth radius 3", 3, testMeanHistogram, testMean, 1},
+    {"mean/histogram smooth radius 7", 7, testMeanHistogram, testMean, 1},
+};
+
+// A chain of up to 3 filters, the fused chain must give the same output as
+// the filters applied one after the other.
+struct TestStage
+{
+    DenoiseFilter *(*create)(TileScheduler *scheduler, int radius);
+    int radius;
+};
+
+struct TestChain
+{
+    const char *name;
+    TestStage stages[3];
+};
+
+static const TestChain testChains[] = {
+    {"chain median/network+gauss",
+     {{testMedianNetwork, 1}, {testGauss, 3}}},
+    {"chain median/histogram+mean+pseudomedian",
+     {{testMedianHistogram, 2}, {testMean, 2}, {testPseudoMedian, 1}}},
+    {"chain gauss/fixedpoint+median/sort",
+     {{testGaussFixedPoint, 2}, {testMedian, 3}}},
+};
+
+// Prints the result of a test, returns 1 if it failed.
+static int testResult(bool ok, const char *name, const QByteArray &variant)
+{
+    if (ok) {
+        qDebug() << "PASS" << name << variant.constData();
+
+        return 0;
+    }
+
+    qCritical() << "FAIL" << name << variant.constData();
+
+    return 1;
+}
+
+// The filters must not allocate memory after the first image of a size,
+// they keep their buffers and scratch arenas between calls, and the threads
+// of the scheduler wait for the jobs.
+static int testAllocations()
+{
+    if (!AllocationCounter::isSupported()) {
+        qDebug() << "The allocations can't be counted, skipping the test";
+
+        return 0;
+    }
+
+    TileScheduler scheduler(4);
+    int failed = 0;
+
+    for (const TestFormat &format: testFormats) {
+        QVector<quint8> input = testImage(format);
+        QVector<quint8> output(input.size());
+        int stride = testWidth * format.bytesPerPixel;
+        DenoiseImage in(input.constData(),
+                        testWidth, testHeight, stride,
+                        format.format);
+        DenoiseImage out(output.data(),
+                         testWidth, testHeight, stride,
+                         format.format);
+
+        for (const TestFilter &test: testFilters) {
+            DenoiseFilter *filter = test.create(&scheduler);
+
+            // The first call allocates the buffers.
+            bool ok = filter->process(in, out);
+            AllocationCounter counter;
+            ok = filter->process(in, out) && ok;
+            qint64 allocations = counter.allocations();
+            delete filter;
+
+            if (allocations != 0)
+                qCritical() << "Allocations:" << allocations;
+
+            failed += testResult(ok && allocations == 0,
+                                 test.name,
+                                 format.name);
+        }
+    }
+
+    return failed;
+}
+
+// The recursive gauss starts both ends of each line as if it were extended
+// with its border pixels, so it must give the same output as a line padded
+// with enough copies of them for the response to vanish.
+static int testRecursiveBorders()
+{
+    static const qreal sigmas[] = {1, 3, 10, 30};
+    static const char *names[] = {"sigma 1", "sigma 3", "sigma 10", "sigma 30"};
+    TileScheduler scheduler(1);
+    int failed = 0;
+
+    for (int i = 0; i < 4; i++) {
+        int pad = qCeil(30 * sigmas[i]);
+        int width = testWidth + 2 * pad;
+        QVector<float> input(testWidth);
+        QVector<float> padded(width);
+        TestRandom random(2);
+
+        for (int x = 0; x < testWidth; x++)
+            input[x] = float(random.next() % 256) / 255;
+
+        for (int x = 0; x < width; x++)
+            padded[x] = input[qBound(0, x - pad, testWidth - 1)];
+
+        QVector<float> output(testWidth);
+        QVector<float> paddedOutput(width);
+        GaussFilter filter(&scheduler);
+        filter.sigma = sigmas[i];
+        filter.method = GaussMethodRecursive;
+        bool ok =
+            filter.process(testGrayFloat(input, testWidth, 1),
+                           testGrayFloat(output, testWidth, 1));
+        ok = filter.process(testGrayFloat(padded, width, 1),
+                            testGrayFloat(paddedOutput, width, 1)) && ok;
+
+        // In 8 bits levels.
+        qreal error = 0;
+
+        for (int x = 0; x < testWidth; x++)
+            error = qMax(error,
+                         255 * qAbs(qreal(output[x])
+                                    - paddedOutput[x + pad]));
+
+        if (error >= 0.01)
+            qCritical() << "Error:" << error;
+
+        failed += testResult(ok && error < 0.01,
+                             "gauss/recursive borders",
+                             names[i]);
+    }
+
+    return failed;
+}
+
+// A pixel of the window extended past the borders of the image, at (dx, dy)
+// from its center.
+struct TestWindowPixel
+{
+    int dx;
+    int dy;
+    qreal value;
+};
+
+// A filter and the brute force value of one of its windows. The integer
+// references calculate as the 8 bits filters.
+struct TestBorderFilter
+{
+    const char *name;
+    DenoiseFilter *(*create)(TileScheduler *scheduler, int radius);
+    qreal (*reference)(const QVector<TestWindowPixel> &window,
+                       int radius,
+                       bool integer);
+    qreal maxError;
+};
+
+static qreal testMedianReference(const QVector<TestWindowPixel> &window,
+                                 int radius,
+                                 bool integer)
+{
+    Q_UNUSED(radius)
+    Q_UNUSED(integer)
+    QVector<qreal> values;
+
+    for (const TestWindowPixel &pixel: window)
+        values << pixel.value;
+
+    std::sort(values.begin(), values.end());
+
+    return values[values.size() / 2];
+}
+
+static qreal testPseudoMedianReference(const QVector<TestWindowPixel> &window,
+                                       int radius,
+                                       bool integer)
+{
+    Q_UNUSED(radius)
+    qreal min = window[0].value;
+    qreal max = window[0].value;
+
+    for (const TestWindowPixel &pixel: window) {
+        min = qMin(min, pixel.value);
+        max = qMax(max, pixel.value);
+    }
+
+    return integer? qFloor((min + max) / 2): (min + max) / 2;
+}
+
+// sigma is the radius.
+static qreal testGaussReference(const QVector<TestWindowPixel> &window,
+                                int radius,
+                                bool integer)
+{
+    Q_UNUSED(integer)
+    qreal sum = 0;
+    qreal sumW = 0;
+
+    for (const TestWindowPixel &pixel: window) {
+        qreal weight = qExp(-(pixel.dx * pixel.dx + pixel.dy * pixel.dy)
+                            / (2. * radius * radius));
+        sum += weight * pixel.value;
+        sumW += weight;
+    }
+
+    return sum / sumW;
+}
+
+// mu is 0 and sigma is 1, the 8 bits deviation is truncated to 1 / ks.
+static qreal testMeanReference(const QVector<TestWindowPixel> &window,
+                               int radius,
+                               bool integer)
+{
+    Q_UNUSED(radius)
+    qreal ks = window.size();
+    qreal sum = 0;
+    qreal sum2 = 0;
+
+    for (const TestWindowPixel &pixel: window) {
+        sum += pixel.value;
+        sum2 += pixel.value * pixel.value;
+    }
+
+    qreal mean = sum / ks;
+    qreal dev = integer?
+                    qMin(qFloor(qSqrt(ks * sum2 - sum * sum)) / ks, 127.):
+                    qSqrt(qMax(sum2 / ks - mean * mean, 0.));
+
+    if (dev <= 0)
+        return mean;
+
+    qreal sumP = 0;
+    qreal sumW = 0;
+
+    for (const TestWindowPixel &pixel: window) {
+        qreal d = mean - pixel.value;
+        qreal weight = qExp(-d * d / (2 * dev * dev));
+        sumP += weight * pixel.value;
+        sumW += weight;
+    }
+
+    return sumP / sumW;
+}
+
+static const TestBorderFilter testBorderFilters[] = {
+    {"gauss", testGauss, testGaussReference, 1},
+    {"mean", testMean, testMeanReference, 1},
+    {"median/sort", testMedian, testMedianReference, 0},
+    {"median/histogram", testMedianHistogram, testMedianReference, 0},
+    {"median/network", testMedianNetwork, testMedianReference, 0},
+    {"pseudomedian", testPseudoMedian, testPseudoMedianReference, 0},
+};
+
+// The coordinate i of a line of the length extended as the border, folding
+// it at the border pixels until it's inside, returns -1 for the pixels
+// outside of the image.
+static int testBorderCoordinate(int i, int length, DenoiseBorder border)
+{
+    if (i >= 0 && i < length)
+        return i;
+
+    switch (border) {
+    case DenoiseBorderReplicate:
+        return i < 0? 0: length - 1;
+    case DenoiseBorderReflect:
+        if (length < 2)
+            return 0;
+
+        while (i < 0 || i >= length)
+            i = i < 0? -i: 2 * (length - 1) - i;
+
+        return i;
+    default:
+        return -1;
+    }
+}
+
+// Filters a random image of the size, and returns the largest difference
+// with the brute force windows, in 8 bits levels. The windows are extended
+// explicitly, pixel by pixel.
+static qreal testBorderError(const TestBorderFilter &test,
+                             DenoiseBorder border,
+                             const QSize &size,
+                             int radius,
+                             bool integer,
+                             TileScheduler &scheduler,
+                             bool *ok)
+{
+    static const qreal borderValue = 100;
+    int width = size.width();
+    int height = size.height();
+    qreal scale = integer? 1: 1. / 255;
+    DenoiseFormat format = integer? DenoiseFormatGray8: DenoiseFormatGrayFloat;
+    int stride = width * (integer? 1: int(sizeof(float)));
+    QVector<qreal> values(width * height);
+    QVector<quint8> input(stride * height);
+    QVector<quint8> output(input.size());
+    float *floatInput = reinterpret_cast<float *>(input.data());
+    const float *floatOutput =
+        reinterpret_cast<const float *>(output.constData());
+    TestRandom random(quint32(3 + radius));
+
+    for (int i = 0; i < values.size(); i++) {
+        values[i] = scale * (random.next() % 256);
+
+        if (integer)
+            input[i] = quint8(values[i]);
+        else
+            floatInput[i] = float(values[i]);
+    }
+
+    DenoiseFilter *filter = test.create(&scheduler, radius);
+    filter->border = border;
+    filter->borderValue = scale * borderValue;
+    *ok = filter->process(DenoiseImage(input.constData(),
+                                       width, height, stride, format),
+                          DenoiseImage(output.data(),
+                                       width, height, stride, format))
+          && *ok;
+    delete filter;
+    qreal error = 0;
+
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++) {
+            QVector<TestWindowPixel> window;
+
+            for (int dy = -radius; dy <= radius; dy++)
+                for (int dx = -radius; dx <= radius; dx++) {
+                    int xs = testBorderCoordinate(x + dx, width, border);
+                    int ys = testBorderCoordinate(y + dy, height, border);
+
+                    if (xs >= 0 && ys >= 0)
+                        window << TestWindowPixel {dx, dy,
+                                                   values[ys * width + xs]};
+                    else if (border == DenoiseBorderConstant)
+                        window << TestWindowPixel {dx, dy,
+                                                   scale * borderValue};
+                }
+
+            qreal reference = test.reference(window, radius, integer);
+            qreal pixel;
+
+            if (integer) {
+                reference = quint8(reference);
+                pixel = output[y * width + x];
+            } else {
+                pixel = floatOutput[y * width + x];
+            }
+
+            error = qMax(error, qAbs(pixel - reference) / scale);
+        }
+
+    return error;
+}
+
+// The tiny images have sides shorter than the radius, so most of the
+// windows are outside of the image, and reflect folds them several times.
+static int testBorders()
+{
+    static const QSize sizes[] = {{1, 1}, {1, 5}, {5, 1}, {2, 1}, {1, 2},
+                                  {3, 4}, {9, 7}};
+    static const DenoiseBorder borders[] = {DenoiseBorderClipped,
+                                            DenoiseBorderReplicate,
+                                            DenoiseBorderReflect,
+                                            DenoiseBorderConstant};
+    static const char *borderNames[] = {"clipped", "replicate",
+                                        "reflect", "constant"};
+    TileScheduler scheduler(4);
+    int failed = 0;
+
+    for (bool integer: {true, false})
+        for (const TestBorderFilter &test: testBorderFilters)
+            for (int b = 0; b < 4; b++) {
+                bool ok = true;
+                qreal error = 0;
+
+                for (const QSize &size: sizes)
+                    for (int radius = 1; radius <= 4; radius++)
+                        error = qMax(error,
+                                     testBorderError(test, borders[b], size,
+                                                     radius, integer,
+                                                     scheduler, &ok));
+
+                // The floating point samples only differ in the rounding.
+                qreal maxError = integer? test.maxError: 0.01;
+
+                if (error > maxError)
+                    qCritical() << "Error:" << error;
+
+                failed += testResult(ok && error <= maxError,
+                                     QByteArray("borders ")
+                                     .append(test.name).constData(),
+                                     QByteArray(borderNames[b])
+                                     .append(integer? " gray8":
+                                                      " grayfloat"));
+            }
+
+    return failed;
+}
+
+// Compare the methods of a table on input.
+template <int N>
+static int testEquivalentTable(const TestEquivalence (&tests)[N],
+                               const TestFormat &format,
+                               const QVector<quint8> &input,
+                               TileScheduler &scheduler)
+{
+    QVector<quint8> output;
+    QVector<quint8> reference;
+    int failed = 0;
+
+    for (const TestEquivalence &test: tests) {
+        DenoiseFilter *filter = test.create(&scheduler, test.radius);
+        DenoiseFilter *referenceFilter = test.reference(&scheduler,
+                                                        test.radius);
+        bool ok = testProcess(filter, format, input, output);
+        ok = testProcess(referenceFilter, format, input, reference) && ok;
+        delete filter;
+        delete referenceFilter;
+        qreal difference = testDifference(output, reference, format);
+
+        if (difference > test.maxError)
+            qCritical() << "Difference:" << difference;
+
+        failed += testResult(ok && difference <= test.maxError,
+                             test.name,
+                             format.name);
+    }
+
+    return failed;
+}
+
+// The fast methods against the simple ones, on several threads so the
+// tiles are also checked.
+static int testEquivalent()
+{
+    TileScheduler scheduler(4);
+    int failed = 0;
+
+    for (const TestFormat &format: testFormats) {
+        failed += testEquivalentTable(testEquivalences,
+                                      format,
+                                      testImage(format),
+                                      scheduler);
+        failed += testEquivalentTable(testSmoothEquivalences,
+                                      format,
+                                      testSmoothImage(format),
+                                      scheduler);
+    }
+
+    return failed;
+}
+
+// The 8 bits samples must give the same mean as the same image in 16 bits,
+// up to the truncation of the 8 bits output. The variance of the radius 20
+// windows doesn't fit in 32 bits.
+static int testMeanDepths()
+{
+    static const MeanMethod methods[] = {MeanMethodDirect,
+                                         MeanMethodHistogram};
+    static const char *names[] = {"direct", "histogram"};
+    TileScheduler scheduler(4);
+    QVector<quint8> input(testWidth * testHeight);
+    QVector<quint16> input16(input.size());
+    TestRandom random(3);
+
+    for (int i = 0; i < input.size(); i++) {
+        input[i] = quint8(random.next());
+        input16[i] = quint16(257 * input[i]);
+    }
+
+    int failed = 0;
+
+    for (int i = 0; i < 2; i++) {
+        QVector<quint8> output(input.size());
+        QVector<quint16> output16(input.size());
+        MeanFilter filter(&scheduler);
+        filter.radius = 20;
+        filter.method = methods[i];
+        int stride16 = testWidth * int(sizeof(quint16));
+        bool ok =
+            filter.process(DenoiseImage(input.constData(),
+                                        testWidth, testHeight, testWidth,
+                                        DenoiseFormatGray8),
+                           DenoiseImage(output.data(),
+                                        testWidth, testHeight, testWidth,
+                                        DenoiseFormatGray8));
+        ok = filter.process(
+                 DenoiseImage(reinterpret_cast<const uchar *>(input16.constData()),
+                              testWidth, testHeight, stride16,
+                              DenoiseFormatGray16),
+                 DenoiseImage(reinterpret_cast<uchar *>(output16.data()),
+                              testWidth, testHeight, stride16,
+                              DenoiseFormatGray16)) && ok;
+        qreal difference = 0;
+
+        for (int j = 0; j < output.size(); j++)
+            difference = qMax(difference,
+                              qAbs(output[j] - qreal(output16[j]) / 257));
+
+        if (difference > 1)
+            qCritical() << "Difference:" << difference;
+
+        failed += testResult(ok && difference <= 1,
+                             "mean/8 bits vs 16 bits radius 20",
+                             names[i]);
+    }
+
+    return failed;
+}
+
+// Salt and pepper noise on a smooth gradient, the switching median must
+// detect the impulses, copy the other pixels, and replace the impulses by
+// the median of their window. The median of median/sort also counts the
+// impulses of the window, that move it by a level at most on the gradient.
+// The density is low enough for the impulses to not hide each other in the
+// 3x3 windows of the detector.
+static int testSwitchingMedian()
+{
+    static const qreal density = 0.02;
+    TileScheduler scheduler(4);
+    QVector<quint8> input(testWidth * testHeight);
+    QVector<quint8> noise(input.size());
+    TestRandom random(4);
+    qint64 injected = 0;
+
+    for (int y = 0; y < testHeight; y++)
+        for (int x = 0; x < testWidth; x++) {
+            int i = x + y * testWidth;
+            input[i] = quint8(64 + (x + 2 * y) / 16);
+
+            if (random.next() % 10000 < quint32(10000 * density)) {
+                input[i] = random.next() & 1? 255: 0;
+                noise[i] = 1;
+                injected++;
+            }
+        }
+
+    QVector<quint8> output(input.size());
+    QVector<quint8> reference(input.size());
+    DenoiseImage in(input.constData(),
+                    testWidth, testHeight, testWidth,
+                    DenoiseFormatGray8);
+    MedianFilter filter(&scheduler);
+    filter.radius = testRadius;
+    filter.switching = true;
+    bool ok = filter.process(in,
+                             DenoiseImage(output.data(),
+                                          testWidth, testHeight, testWidth,
+                                          DenoiseFormatGray8));
+    DenoiseFilter *median = testMedian(&scheduler, testRadius);
+    ok = median->process(in,
+                         DenoiseImage(reference.data(),
+                                      testWidth, testHeight, testWidth,
+                                      DenoiseFormatGray8)) && ok;
+    delete median;
+    int changed = 0;
+    qreal difference = 0;
+
+    for (int i = 0; i < input.size(); i++)
+        if (noise[i])
+            difference = qMax(difference,
+                              qAbs(qreal(output[i]) - reference[i]));
+        else if (output[i] != input[i])
+            changed++;
+
+    qreal fraction = qreal(injected) / input.size();
+    int failed = 0;
+
+    if (changed > 0)
+        qCritical() << "Changed pixels:" << changed;
+
+    failed += testResult(ok && changed == 0,
+                         "median/switching",
+                         "untouched pixels");
+
+    if (qAbs(filter.impulseFraction() - fraction) > 0.001)
+        qCritical() << "Impulses:" << filter.impulseFraction()
+                    << "injected:" << fraction;
+
+    failed += testResult(ok
+                         && qAbs(filter.impulseFraction() - fraction) <= 0.001,
+                         "median/switching",
+                         "impulse fraction");
+
+    if (difference > 1)
+        qCritical() << "Difference:" << difference;
+
+    failed += testResult(ok && difference <= 1,
+                         "median/switching",
+                         "impulses");
+
+    // The fraction counts the 3 channels of the color images, here the
+    // impulses are only in the first one, and the counters start again in
+    // each call.
+    QVector<quint8> color(4 * input.size());
+    QVector<quint8> colorOutput(color.size());
+
+    for (int i = 0; i < input.size(); i++) {
+        color[4 * i] = input[i];
+        color[4 * i + 1] = quint8(64 + (i % testWidth + 2 * (i / testWidth))
+                                       / 16);
+        color[4 * i + 2] = color[4 * i + 1];
+        color[4 * i + 3] = 255;
+    }
+
+    DenoiseImage colorIn(color.constData(),
+                         testWidth, testHeight, 4 * testWidth,
+                         DenoiseFormatRGB32);
+    DenoiseImage colorOut(colorOutput.data(),
+                          testWidth, testHeight, 4 * testWidth,
+                          DenoiseFormatRGB32);
+    ok = filter.process(colorIn, colorOut);
+    ok = filter.process(colorIn, colorOut) && ok;
+
+    if (qAbs(3 * filter.impulseFraction() - fraction) > 0.001)
+        qCritical() << "Impulses:" << filter.impulseFraction()
+                    << "injected:" << fraction / 3;
+
+    failed += testResult(ok
+                         && qAbs(3 * filter.impulseFraction() - fraction)
+                            <= 0.001,
+                         "median/switching",
+                         "impulse fraction rgb32");
+
+    return failed;
+}
+
+// The chains with one thread and with several bands, the 8 bits chains
+// must be fused.
+static int testChain()
+{
+    static const int threads[] = {1, 4};
+    int failed = 0;
+
+    for (int nThreads: threads) {
+        TileScheduler scheduler(nThreads);
+
+        for (const TestFormat &format: testFormats) {
+            QByteArray variant = QByteArray(format.name) + ", "
+                                 + QByteArray::number(nThreads) + " threads";
+            QVector<quint8> input = testImage(format);
+            QVector<quint8> output;
+
+            for (const TestChain &test: testChains) {
+                DenoiseChain chain(&scheduler);
+
+                for (const TestStage &stage: test.stages)
+                    if (stage.create)
+                        chain.filters << stage.create(&scheduler,
+                                                      stage.radius);
+
+                bool ok = testProcess(&chain, format, input, output);
+
+                if (format.format == DenoiseFormatRGB32 && !chain.isFused()) {
+                    qCritical() << "The chain is not fused";
+                    ok = false;
+                }
+
+                QVector<quint8> reference = input;
+                QVector<quint8> stageOutput;
+
+                for (DenoiseFilter *filter: chain.filters) {
+                    ok = testProcess(filter, format, reference, stageOutput)
+                         && ok;
+                    reference = stageOutput;
+                }
+
+                qDeleteAll(chain.filters);
+                qreal difference = testDifference(output, reference, format);
+
+                if (difference > 0)
+                    qCritical() << "Difference:" << difference;
+
+                failed += testResult(ok && difference == 0,
+                                     test.name,
+                                     variant);
+            }
+        }
+    }
+
+    return failed;
+}
+
+// Two frames with a square that moves, the second frame filtered
+// incrementally must be the same as filtered completely. The recursive gauss
+// cuts its response at 3 sigma around the dirty tiles.
+static int testIncremental()
+{
+    TileScheduler scheduler(4);
+    int failed = 0;
+
+    for (const TestFormat &format: testFormats) {
+        QVector<quint8> frames[2];
+        int stride = testWidth * format.bytesPerPixel;
+
+        for (int i = 0; i < 2; i++) {
+            frames[i] = testImage(format);
+
+            for (int y = 40 + 10 * i; y < 72 + 10 * i; y++) {
+                quint8 *line = frames[i].data() + y * stride;
+
+                if (format.format == DenoiseFormatRGBAFloat) {
+                    float *samples = reinterpret_cast<float *>(line);
+
+                    for (int x = 4 * (50 + 20 * i); x < 4 * (82 + 20 * i); x++)
+                        samples[x] = 1;
+                } else {
+                    memset(line + (50 + 20 * i) * format.bytesPerPixel,
+                           0xff,
+                           size_t(32 * format.bytesPerPixel));
+                }
+            }
+        }
+
+        QVector<quint8> output(frames[0].size());
+        QVector<quint8> reference;
+
+        for (const TestFilter &test: testFilters) {
+            DenoiseFilter *filter = test.create(&scheduler);
+            DenoiseIncremental incremental(filter);
+            incremental.tileSize = 16;
+            bool ok = true;
+
+            for (const QVector<quint8> &frame: frames)
+                ok = incremental.process(DenoiseImage(frame.constData(),
+                                                      testWidth, testHeight,
+                                                      stride, format.format),
+                                         DenoiseImage(output.data(),
+                                                      testWidth, testHeight,
+                                                      stride, format.format))
+                     && ok;
+
+            // Unless the halo covers the whole frame.
+            if (incremental.dirtyRatio() >= 1
+                && filter->borderSize() < testHeight) {
+                qCritical() << "The whole frame was filtered";
+                ok = false;
+            }
+
+            ok = testProcess(filter, format, frames[1], reference) && ok;
+            delete filter;
+            qreal difference = testDifference(output, reference, format);
+            qreal maxError =
+                qstrncmp(test.name, "gauss/recursive", 15)? 0: 1;
+
+            if (difference > maxError)
+                qCritical() << "Difference:" << difference;
+
+            failed += testResult(ok && difference <= maxError,
+                                 (QByteArray("incremental ") + test.name)
+                                 .constData(),
+                                 format.name);
+        }
+    }
+
+    return failed;
+}
+
+// A 16 bits PGM and an 8 bits PPM filtered in strips must be the same as
+// the whole image filtered. The strips are smaller than the halo of the
+// filters, so each strip is filtered with the lines of several strips
+// around it.
+static int testStrips()
+{
+    static const TestFormat formats[] = {
+        {"gray16", DenoiseFormatGray16, 2},
+        {"rgb888", DenoiseFormatRGB888, 3},
+    };
+    QTemporaryDir dir;
+
+    if (!dir.isValid()) {
+        qCritical() << "Can't create a temporary directory";
+
+        return 1;
+    }
+
+    TileScheduler scheduler(4);
+    int failed = 0;
+
+    for (const TestFormat &format: formats) {
+        bool is16 = format.format == DenoiseFormatGray16;
+
+        // The PGM samples are big endian.
+        QVector<quint8> input = testImage(format);
+        QByteArray header = QString("P%1\n%2 %3\n%4\n")
+                            .arg(is16? 5: 6)
+                            .arg(testWidth)
+                            .arg(testHeight)
+                            .arg(is16? 65535: 255)
+                            .toLatin1();
+        QByteArray image = header;
+
+        for (int i = 0; i < input.size(); i++)
+            image.append(char(input[is16? i ^ 1: i]));
+
+        QFile inputFile(dir.filePath("input.pnm"));
+
+        if (!inputFile.open(QIODevice::WriteOnly)
+            || inputFile.write(image) != image.size()) {
+            qCritical() << "Can't write the input image";
+
+            return failed + 1;
+        }
+
+        inputFile.close();
+
+        for (const TestFilter &test: testFilters) {
+            DenoiseFilter *filter = test.create(&scheduler);
+            DenoiseStrips strips(filter);
+            strips.input = dir.filePath("input.pnm");
+            strips.output = dir.filePath("output.pnm");
+            strips.stripHeight = 2;
+            bool ok = strips.run();
+
+            if (!ok)
+                qCritical() << strips.errorString();
+
+            QVector<quint8> reference;
+            ok = testProcess(filter, format, input, reference) && ok;
+            delete filter;
+            QFile outputFile(strips.output);
+            QByteArray result;
+
+            if (outputFile.open(QIODevice::ReadOnly))
+                result = outputFile.readAll();
+
+            QVector<quint8> output(input.size());
+
+            if (result.size() == image.size()) {
+                for (int i = 0; i < output.size(); i++)
+                    output[i] = quint8(result[header.size()
+                                              + (is16? i ^ 1: i)]);
+            } else {
+                qCritical() << "Wrong output size:" << result.size();
+                ok = false;
+            }
+
+            qreal difference = testDifference(output, reference, format);
+            qreal maxError =
+                qstrncmp(test.name, "gauss/recursive", 15)? 0: 1;
+
+            if (difference > maxError)
+                qCritical() << "Difference:" << difference;
+
+            failed += testResult(ok && difference <= maxError,
+                                 (QByteArray("strips ") + test.name)
+                                 .constData(),
+                                 format.name);
+        }
+    }
+
+    return failed;
+}
+
+// The line filters of a chain must follow the parameters of its filters
+// changed between two calls.
+static int testChainParameters()
+{
+    static const TestFormat &format = testFormats[0];
+    TileScheduler scheduler(4);
+    QVector<quint8> input = testImage(format);
+    QVector<quint8> output;
+    GaussFilter gauss(&scheduler);
+    gauss.radius = 2;
+    gauss.sigma = 1;
+    MeanFilter mean(&scheduler);
+    mean.radius = 1;
+    DenoiseChain chain(&scheduler);
+    chain.filters << &gauss << &mean;
+    bool ok = testProcess(&chain, format, input, output);
+    gauss.radius = 4;
+    gauss.sigma = 3;
+    gauss.method = GaussMethodFixedPoint;
+    mean.radius = 3;
+    mean.mu = 10;
+    ok = testProcess(&chain, format, input, output) && ok;
+    ok = chain.isFused() && ok;
+    QVector<quint8> stageOutput;
+    ok = testProcess(&gauss, format, input, stageOutput) && ok;
+    QVector<quint8> reference;
+    ok = testProcess(&mean, format, stageOutput, reference) && ok;
+    qreal difference = testDifference(output, reference, format);
+
+    if (difference > 0)
+        qCritical() << "Difference:" << difference;
+
+    return testResult(ok && difference == 0,
+                      "chain parameters",
+                      format.name);
+}
+
+// The trace writes the buffers of the threads to the file while recording,
+// so they don't keep all the events, and the file has all of them after
+// saving it.
+static int testTrace()
+{
+    static const int events = 10000;
+    QTemporaryDir dir;
+
+    if (!dir.isValid()) {
+        qCritical() << "Can't create a temporary directory";
+
+        return 1;
+    }
+
+    DenoiseTrace *trace = DenoiseTrace::globalInstance();
+    trace->fileName = dir.filePath("trace.csv");
+    trace->start();
+
+    for (int i = 0; i < events; i++)
+        DenoiseTraceScope stage("test");
+
+    trace->stop();
+    int buffered = trace->events().size();
+    bool ok = trace->save();
+    QFile file(trace->fileName);
+    int lines = 0;
+
+    if (file.open(QIODevice::ReadOnly))
+        lines = file.readAll().count('\n');
+
+    // The global trace is saved again at exit.
+    trace->fileName.clear();
+
+    if (buffered >= events || lines != events + 1)
+        qCritical() << "Buffered events:" << buffered << "lines:" << lines;
+
+    return testResult(ok && buffered < events && lines == events + 1,
+                      "trace",
+                      "buffers");
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    int failed = 0;
+    failed += testAllocations();
+    failed += testRecursiveBorders();
+    failed += testBorders();
+    failed += testEquivalent();
+    failed += testMeanDepths();
+    failed += testSwitchingMedian();
+    failed += testChain();
+    failed += testChainParameters();
+    failed += testIncremental();
+    failed += testStrips();
+    failed += testTrace();
+
+    return failed? EXIT_FAILURE: EXIT_SUCCESS;
+}